@@ -0,0 +1,249 @@
+#include "benchmark.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+FrameStats computeStats(std::vector<double> samples)
+{
+	FrameStats stats;
+	if (samples.empty())
+		return stats;
+	std::sort(samples.begin(), samples.end());
+	stats.count = (int)samples.size();
+	double sum = 0.0;
+	for (double sample : samples)
+		sum += sample;
+	stats.mean = sum / samples.size();
+	// 最近秩：第ceil(p*n)个样本
+	auto percentile = [&samples](double p) {
+		size_t rank = (size_t)std::ceil(p * samples.size());
+		return samples[rank > 0 ? rank - 1 : 0];
+	};
+	stats.p50 = percentile(0.50);
+	stats.p95 = percentile(0.95);
+	stats.p99 = percentile(0.99);
+	stats.min = samples.front();
+	stats.max = samples.back();
+	return stats;
+}
+
+double peakResidentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0.0;
+	return (double)counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0.0;
+#ifdef __APPLE__
+	return (double)usage.ru_maxrss;				// macOS上单位是字节
+#else
+	return (double)usage.ru_maxrss * 1024.0;	// Linux上单位是KiB
+#endif
+#endif
+}
+
+// JSON字符串转义，路径在Windows上会带反斜杠
+static std::string jsonString(const std::string &text)
+{
+	std::string out = "\"";
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			out += '\\';
+		if ((unsigned char)c < 0x20)
+			out += ' ';
+		else
+			out += c;
+	}
+	return out + "\"";
+}
+
+static void writeStats(FILE *file, const FrameStats &stats)
+{
+	fprintf(file, "{\"count\": %d, \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"min\": %.4f, \"max\": %.4f}",
+			stats.count, stats.mean, stats.p50, stats.p95, stats.p99, stats.min, stats.max);
+}
+
+// 预热帧之后的全部采样
+struct BenchmarkSamples
+{
+	std::vector<double> frameMs, cpuMs, gpuMs;
+	std::vector<std::vector<double>> passCpuMs, passGpuMs;
+};
+
+static BenchmarkSamples collectSamples(const BenchmarkInfo &info, const FrameProfiler &profiler)
+{
+	const std::vector<FrameProfiler::FrameRecord> &frames = profiler.history();
+	BenchmarkSamples samples;
+	samples.passCpuMs.resize(profiler.passCount());
+	samples.passGpuMs.resize(profiler.passCount());
+	for (size_t i = info.warmupFrames; i < frames.size(); i++)
+	{
+		const FrameProfiler::FrameRecord &frame = frames[i];
+		samples.frameMs.push_back(frame.frameMs);
+		samples.cpuMs.push_back(frame.cpuMs);
+		if (frame.gpuValid)
+			samples.gpuMs.push_back(frame.gpuMs);
+		// 每个pass只统计真正执行了的帧，命中缓存被跳过的不算
+		for (int pass = 0; pass < profiler.passCount(); pass++)
+		{
+			if (!frame.issued[pass])
+				continue;
+			samples.passCpuMs[pass].push_back(frame.passes[pass].cpuMs);
+			if (frame.gpuValid)
+				samples.passGpuMs[pass].push_back(frame.passes[pass].gpuMs);
+		}
+	}
+	return samples;
+}
+
+bool writeBenchmarkReport(const std::string &path, const BenchmarkInfo &info, const FrameProfiler &profiler)
+{
+	BenchmarkSamples samples = collectSamples(info, profiler);
+	const std::vector<double> &frameMs = samples.frameMs, &cpuMs = samples.cpuMs, &gpuMs = samples.gpuMs;
+	const std::vector<std::vector<double>> &passCpuMs = samples.passCpuMs, &passGpuMs = samples.passGpuMs;
+
+	FILE *file = fopen(path.c_str(), "w");
+	if (!file)
+	{
+		std::cout << "Failed to open benchmark report " << path << std::endl;
+		return false;
+	}
+	fprintf(file, "{\n");
+	fprintf(file, "  \"config\": {\"scene\": %s, \"camera_path\": %s, \"engine\": %s, \"renderer\": %s, \"cubes\": %d, \"lights\": %d, \"shadow_size\": %d, \"width\": %d, \"height\": %d,\n",
+			jsonString(info.scenePath).c_str(), jsonString(info.cameraPath).c_str(), jsonString(info.engine).c_str(),
+			jsonString(info.renderer).c_str(),
+			info.cubes, info.lights, info.shadowSize, info.width, info.height);
+	fprintf(file, "             \"warmup_frames\": %d, \"measured_frames\": %d, \"timeline_fps\": %.1f, \"draw_mode\": \"%s\", \"shadow_cache\": %s,\n",
+			info.warmupFrames, info.measuredFrames, info.timelineFps, info.instancing ? "instanced" : "loop",
+			info.shadowCache ? "true" : "false");
+	fprintf(file, "             \"shadow_filter\": %s,\n", jsonString(info.shadowFilter).c_str());
+	fprintf(file, "             \"visibility_bytes\": %.0f, \"peak_rss_bytes\": %.0f},\n", info.visibilityBytes, peakResidentBytes());
+	fprintf(file, "  \"frame_ms\": ");
+	writeStats(file, computeStats(frameMs));
+	fprintf(file, ",\n  \"cpu_ms\": ");
+	writeStats(file, computeStats(cpuMs));
+	fprintf(file, ",\n  \"gpu_ms\": ");
+	writeStats(file, computeStats(gpuMs));
+	fprintf(file, ",\n  \"passes\": {");
+	for (int pass = 0; pass < profiler.passCount(); pass++)
+	{
+		fprintf(file, "%s\n    %s: {\"cpu_ms\": ", pass ? "," : "", jsonString(profiler.passName(pass)).c_str());
+		writeStats(file, computeStats(passCpuMs[pass]));
+		fprintf(file, ", \"gpu_ms\": ");
+		writeStats(file, computeStats(passGpuMs[pass]));
+		fprintf(file, "}");
+	}
+	fprintf(file, "\n  },\n  \"counters\": {");
+	for (size_t i = 0; i < info.counters.size(); i++)
+		fprintf(file, "%s%s: %.6g", i ? ", " : "", jsonString(info.counters[i].first).c_str(), info.counters[i].second);
+	fprintf(file, "}\n}\n");
+	fclose(file);
+
+	FrameStats frameStats = computeStats(frameMs), gpuStats = computeStats(gpuMs);
+	std::cout << "Benchmark: " << frameStats.count << " frames, frame mean " << frameStats.mean << " ms, p95 "
+			  << frameStats.p95 << " ms, p99 " << frameStats.p99 << " ms, GPU mean " << gpuStats.mean << " ms -> " << path << std::endl;
+	return true;
+}
+
+bool appendBenchmarkCsv(const std::string &path, const BenchmarkInfo &info, const FrameProfiler &profiler)
+{
+	BenchmarkSamples samples = collectSamples(info, profiler);
+	FILE *file = fopen(path.c_str(), "a");
+	if (!file)
+	{
+		std::cout << "Failed to open benchmark CSV " << path << std::endl;
+		return false;
+	}
+	// 追加模式下文件位置在末尾，位置为0说明是新文件
+	fseek(file, 0, SEEK_END);
+	if (ftell(file) == 0)
+	{
+		fprintf(file, "engine,width,height,cubes,lights,shadow_size,draw_mode,frames,frame_mean_ms,frame_p50_ms,frame_p95_ms,frame_p99_ms,frame_max_ms,"
+					  "cpu_mean_ms,gpu_mean_ms,cubes_per_second,visibility_mb");
+		for (int pass = 0; pass < profiler.passCount(); pass++)
+		{
+			// pass名里的空格换成下划线，表头才好用
+			std::string column = profiler.passName(pass);
+			std::replace(column.begin(), column.end(), ' ', '_');
+			fprintf(file, ",%s_cpu_ms,%s_gpu_ms", column.c_str(), column.c_str());
+		}
+		fprintf(file, "\n");
+	}
+	FrameStats frame = computeStats(samples.frameMs);
+	double cubesPerSecond = frame.mean > 0.0 ? info.cubes * 1000.0 / frame.mean : 0.0;
+	fprintf(file, "%s,%d,%d,%d,%d,%d,%s,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.0f,%.3f",
+			info.engine.c_str(), info.width, info.height, info.cubes, info.lights, info.shadowSize, info.instancing ? "instanced" : "loop", frame.count,
+			frame.mean, frame.p50, frame.p95, frame.p99, frame.max,
+			computeStats(samples.cpuMs).mean, computeStats(samples.gpuMs).mean, cubesPerSecond,
+			info.visibilityBytes / (1024.0 * 1024.0));
+	for (int pass = 0; pass < profiler.passCount(); pass++)
+		fprintf(file, ",%.4f,%.4f", computeStats(samples.passCpuMs[pass]).mean, computeStats(samples.passGpuMs[pass]).mean);
+	fprintf(file, "\n");
+	fclose(file);
+	return true;
+}
+
+// info.counters中名为name的计数，没有时返回false
+static bool findCounter(const BenchmarkInfo &info, const char *name, double &value)
+{
+	for (const std::pair<std::string, double> &counter : info.counters)
+		if (counter.first == name)
+		{
+			value = counter.second;
+			return true;
+		}
+	return false;
+}
+
+// 追加一列：有这个计数时按format写出，没有时留空
+static void writeCounterColumn(FILE *file, const BenchmarkInfo &info, const char *name, const char *format)
+{
+	double value;
+	fprintf(file, ",");
+	if (findCounter(info, name, value))
+		fprintf(file, format, value);
+}
+
+bool appendComparisonCsv(const std::string &path, const BenchmarkInfo &info, const FrameProfiler &profiler)
+{
+	BenchmarkSamples samples = collectSamples(info, profiler);
+	FILE *file = fopen(path.c_str(), "a");
+	if (!file)
+	{
+		std::cout << "Failed to open comparison CSV " << path << std::endl;
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	if (ftell(file) == 0)
+		fprintf(file, "engine,width,height,cubes,triangles,frames,frame_mean_ms,frame_p95_ms,visibility_mean_ms,"
+					  "peak_rss_mb,visibility_mb,work_per_pixel,psnr_db,mean_abs_error,mismatch_percent\n");
+	FrameStats frame = computeStats(samples.frameMs);
+	// 消隐pass：GL是lit pass（有GPU计时就用GPU时间），CPU渲染器是visibility pass（包括着色）
+	double visibleMs = 0.0;
+	for (int pass = 0; pass < profiler.passCount(); pass++)
+		if (profiler.passName(pass) == "lit pass" || profiler.passName(pass) == "visibility pass")
+			visibleMs = computeStats(samples.passGpuMs[pass].empty() ? samples.passCpuMs[pass] : samples.passGpuMs[pass]).mean;
+	fprintf(file, "%s,%d,%d,%d", info.engine.c_str(), info.width, info.height, info.cubes);
+	writeCounterColumn(file, info, "triangles", "%.0f");
+	fprintf(file, ",%d,%.4f,%.4f,%.4f,%.1f,%.3f", frame.count, frame.mean, frame.p95, visibleMs,
+			peakResidentBytes() / (1024.0 * 1024.0), info.visibilityBytes / (1024.0 * 1024.0));
+	writeCounterColumn(file, info, "visibility_work_per_pixel", "%.3f");
+	writeCounterColumn(file, info, "image_psnr_db", "%.2f");
+	writeCounterColumn(file, info, "image_mean_abs_error", "%.4f");
+	writeCounterColumn(file, info, "image_mismatch_percent", "%.4f");
+	fprintf(file, "\n");
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,61 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "profiler.h"
+
+// 基准测试：固定时间线上先跑若干预热帧，再统计测量帧的帧时间、CPU时间、GPU时间，输出JSON报告，
+// 用来在改动前后比较性能。
+
+// 一组采样的统计量（毫秒），百分位数取最近秩
+struct FrameStats
+{
+	int count = 0;
+	double mean = 0.0;
+	double p50 = 0.0;
+	double p95 = 0.0;
+	double p99 = 0.0;
+	double min = 0.0;
+	double max = 0.0;
+};
+
+FrameStats computeStats(std::vector<double> samples);
+
+// 报告中记录的运行配置
+struct BenchmarkInfo
+{
+	std::string scenePath;
+	std::string cameraPath;		// 为空表示默认的环绕相机
+	std::string renderer;		// GL_RENDERER，CPU渲染器为引擎名和线程数
+	std::string engine = "gl";	// --renderer的值
+	int cubes = 0;
+	int lights = 0;
+	int shadowSize = 0;
+	int width = 0;
+	int height = 0;
+	int warmupFrames = 0;
+	int measuredFrames = 0;
+	double timelineFps = 60.0;
+	bool instancing = true;
+	bool shadowCache = true;
+	std::string shadowFilter;	// --shadow-filter的值
+	double visibilityBytes = 0.0;	// 消隐用的内存：GL是整屏深度缓冲，CPU渲染器是深度存储加上各自的表
+	std::vector<std::pair<std::string, double>> counters;	// 其他计数，例如阴影pass的执行次数
+};
+
+// 进程到目前为止的峰值常驻内存（字节），取不到时返回0
+double peakResidentBytes();
+
+// 统计profiler.history()中预热帧之后的帧并写出JSON；需要在profiler.shutdown()之后调用，
+// 这样最后两帧的GPU结果也已取回
+bool writeBenchmarkReport(const std::string &path, const BenchmarkInfo &info, const FrameProfiler &profiler);
+// 把同样的统计压缩成CSV的一行追加到文件末尾，文件为空时先写表头；make bench用它拼出吞吐量曲线
+bool appendBenchmarkCsv(const std::string &path, const BenchmarkInfo &info, const FrameProfiler &profiler);
+// 引擎对比表的一行：列固定（不随pass变），不同引擎、分辨率、三角形数的结果可以追加到同一个文件里，
+// make bench-compare用它汇总时间、峰值内存、逐像素工作量和与参考帧的一致性。
+// 三角形数、工作量和一致性取自info.counters中的triangles、visibility_work_per_pixel和image_*，没有的列留空
+bool appendComparisonCsv(const std::string &path, const BenchmarkInfo &info, const FrameProfiler &profiler);
+
+#endif
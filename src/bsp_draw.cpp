@@ -0,0 +1,110 @@
+#include "bsp_draw.h"
+#include <chrono>
+
+BspDrawList::~BspDrawList()
+{
+	destroy();
+}
+
+void BspDrawList::build(const Scene &scene)
+{
+	auto start = std::chrono::steady_clock::now();
+	std::vector<SoftTriangle> triangles;
+	appendSceneTriangles(scene, triangles);
+	bsp.build(triangles, triangles.size());
+
+	// 每个片3个顶点，排布与地板相同：位置、法线、纹理坐标
+	const std::vector<BspFragment> &fragments = bsp.fragments();
+	std::vector<float> vertices;
+	vertices.reserve(fragments.size() * 3 * 8);
+	fragmentMaterial.resize(fragments.size());
+	for (size_t i = 0; i < fragments.size(); i++)
+	{
+		const BspFragment &fragment = fragments[i];
+		const SoftTriangle &source = triangles[fragment.source];
+		fragmentMaterial[i] = source.material;
+		for (int k = 0; k < 3; k++)
+		{
+			const glm::vec3 &b = fragment.bary[k];
+			glm::vec3 normal = source.v[0].normal * b.x + source.v[1].normal * b.y + source.v[2].normal * b.z;
+			glm::vec2 uv = source.v[0].uv * b.x + source.v[1].uv * b.y + source.v[2].uv * b.z;
+			const float vertex[8] = {fragment.position[k].x, fragment.position[k].y, fragment.position[k].z,
+									 normal.x, normal.y, normal.z, uv.x, uv.y};
+			vertices.insert(vertices.end(), vertex, vertex + 8);
+		}
+	}
+
+	if (!vao)
+	{
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
+	}
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3 * sizeof(float)));
+	glBindVertexArray(0);
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	bsp.printSummary(ms);
+}
+
+void BspDrawList::flush(int material, const SceneGpu &sceneGpu)
+{
+	if (firsts.empty())
+		return;
+	sceneGpu.bindMaterial(material);
+	glBindTexture(GL_TEXTURE_2D, sceneGpu.texture(material));
+	glMultiDrawArrays(GL_TRIANGLES, firsts.data(), counts.data(), (GLsizei)firsts.size());
+	firsts.clear();
+	counts.clear();
+	lastDrawCalls++;
+}
+
+void BspDrawList::draw(const glm::vec3 &eye, const SceneGpu &sceneGpu)
+{
+	lastDrawCalls = 0;
+	if (!vao)
+		return;
+	bsp.order(eye, false, nodeOrder);
+	glBindVertexArray(vao);
+	int material = -1;
+	for (int index : nodeOrder)
+	{
+		const BspTree::Node &node = bsp.nodes()[index];
+		for (unsigned int i = node.first; i < node.first + node.count; i++)
+		{
+			if (fragmentMaterial[i] != material)
+			{
+				flush(material, sceneGpu);
+				material = fragmentMaterial[i];
+			}
+			// 与上一段首尾相接时直接延长
+			GLint first = (GLint)i * 3;
+			if (!firsts.empty() && firsts.back() + counts.back() == first)
+				counts.back() += 3;
+			else
+			{
+				firsts.push_back(first);
+				counts.push_back(3);
+			}
+		}
+	}
+	flush(material, sceneGpu);
+}
+
+void BspDrawList::destroy()
+{
+	if (vao)
+	{
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &vbo);
+		vao = vbo = 0;
+	}
+	fragmentMaterial.clear();
+}
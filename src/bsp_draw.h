@@ -0,0 +1,44 @@
+#ifndef BSP_DRAW_H
+#define BSP_DRAW_H
+
+#include <glad/glad.h>
+#include <vector>
+#include "scene.h"
+#include "scene_gpu.h"
+#include "soft_bsp.h"
+
+// 按BSP树的顺序提交GL绘制：场景的所有三角形建一次BSP树，切开后的片以世界坐标放进一个静态顶点缓冲，
+// 每帧从相机出发从前到后遍历，按这个顺序画，深度测试可以提前剔除几乎所有被遮挡的片段。
+// 顶点已经在世界空间里，画的时候model和法线矩阵都取单位矩阵；同一材质的连续片合成一次glMultiDrawArrays
+class BspDrawList
+{
+public:
+	BspDrawList() = default;
+	~BspDrawList();
+	BspDrawList(const BspDrawList &) = delete;
+	BspDrawList &operator=(const BspDrawList &) = delete;
+
+	// 建树并上传顶点；场景的物体改变后要重新调用
+	void build(const Scene &scene);
+	// 绑定自己的VAO，从前到后画出所有片，每换一次材质绑定一次纹理和材质uniform
+	void draw(const glm::vec3 &eye, const SceneGpu &sceneGpu);
+	void destroy();
+
+	const BspTree &tree() const { return bsp; }
+	// 上一帧的绘制调用数
+	int drawCalls() const { return lastDrawCalls; }
+
+private:
+	void flush(int material, const SceneGpu &sceneGpu);
+
+	BspTree bsp;
+	GLuint vao = 0;
+	GLuint vbo = 0;
+	std::vector<int> fragmentMaterial;
+	std::vector<int> nodeOrder;
+	std::vector<GLint> firsts;
+	std::vector<GLsizei> counts;
+	int lastDrawCalls = 0;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#include "camera_path.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool CameraPath::load(const std::string &path)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cout << "Failed to open camera path " << path << std::endl;
+		return false;
+	}
+	std::vector<Key> loaded;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+		std::istringstream in(line);
+		Key key;
+		if (!(in >> key.time))
+		{
+			if (in.eof())
+				continue;	// 空行
+		}
+		else if (in >> key.eye.x >> key.eye.y >> key.eye.z >> key.target.x >> key.target.y >> key.target.z &&
+				 (loaded.empty() || key.time > loaded.back().time))
+		{
+			loaded.push_back(key);
+			continue;
+		}
+		// 字段不全或时间没有递增
+		std::cout << "ERROR::CAMERA_PATH::PARSE " << path << ":" << lineNumber << ": " << line << std::endl;
+		return false;
+	}
+	if (loaded.empty())
+	{
+		std::cout << "ERROR::CAMERA_PATH::EMPTY " << path << std::endl;
+		return false;
+	}
+	keys.swap(loaded);
+	return true;
+}
+
+void CameraPath::evaluate(double time, glm::vec3 &eye, glm::vec3 &target) const
+{
+	if (time <= keys.front().time)
+	{
+		eye = keys.front().eye;
+		target = keys.front().target;
+		return;
+	}
+	if (time >= keys.back().time)
+	{
+		eye = keys.back().eye;
+		target = keys.back().target;
+		return;
+	}
+	// 关键帧一般不多，顺序查找所在区间即可
+	size_t next = 1;
+	while (keys[next].time < time)
+		next++;
+	const Key &a = keys[next - 1], &b = keys[next];
+	float t = (float)((time - a.time) / (b.time - a.time));
+	eye = glm::mix(a.eye, b.eye, t);
+	target = glm::mix(a.target, b.target, t);
+}
@@ -0,0 +1,30 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// 录制好的相机路径：按时间排列的关键帧，关键帧之间线性插值，超出范围时停在首尾关键帧。
+// 文件每行一个关键帧，'#'开头为注释：
+//   time eyeX eyeY eyeZ targetX targetY targetZ
+class CameraPath
+{
+public:
+	bool load(const std::string &path);
+	bool empty() const { return keys.empty(); }
+	double duration() const { return keys.empty() ? 0.0 : keys.back().time; }
+	// 计算time时刻相机的位置和观察目标
+	void evaluate(double time, glm::vec3 &eye, glm::vec3 &target) const;
+
+private:
+	struct Key
+	{
+		double time;
+		glm::vec3 eye;
+		glm::vec3 target;
+	};
+	std::vector<Key> keys;
+};
+
+#endif
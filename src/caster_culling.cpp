@@ -0,0 +1,93 @@
+#include "caster_culling.h"
+#include <algorithm>
+
+// 二维叉积：b在a的逆时针一侧时为正
+static float cross2(const glm::vec2 &a, const glm::vec2 &b)
+{
+	return a.x * b.y - a.y * b.x;
+}
+
+// 单调链求凸包，结果逆时针，不含共线点
+static std::vector<glm::vec2> convexHull(std::vector<glm::vec2> points)
+{
+	std::sort(points.begin(), points.end(), [](const glm::vec2 &a, const glm::vec2 &b) {
+		return a.x < b.x || (a.x == b.x && a.y < b.y);
+	});
+	std::vector<glm::vec2> hull(points.size() * 2);
+	size_t k = 0;
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		while (k >= 2 && cross2(hull[k - 1] - hull[k - 2], points[i] - hull[k - 2]) <= 0.0f)
+			k--;
+		hull[k++] = points[i];
+	}
+	for (size_t i = points.size() - 1, lower = k + 1; i-- > 0;)
+	{
+		while (k >= lower && cross2(hull[k - 1] - hull[k - 2], points[i] - hull[k - 2]) <= 0.0f)
+			k--;
+		hull[k++] = points[i];
+	}
+	hull.resize(k > 1 ? k - 1 : k);
+	return hull;
+}
+
+void CasterCuller::setup(const glm::vec3 &lightPos, const glm::mat4 *lightSpaceMatrices, int count, const glm::mat4 *cameraView, float aspect)
+{
+	matrices.assign(lightSpaceMatrices, lightSpaceMatrices + count);
+	lightView = lightViewMatrix(lightPos);
+	extruded = false;
+	if (!cameraView)
+		return;
+
+	glm::vec3 corners[8];
+	cameraFrustumCorners(*cameraView, aspect, CAMERA_NEAR, CAMERA_FAR, corners);
+	std::vector<glm::vec2> points;
+	farthestZ = 1e30f;
+	for (const glm::vec3 &corner : corners)
+	{
+		glm::vec3 p = glm::vec3(lightView * glm::vec4(corner, 1.0f));
+		points.push_back(glm::vec2(p));
+		farthestZ = std::min(farthestZ, p.z);
+	}
+	hull = convexHull(points);
+	// 视锥体的边正好平行于光线时凸包会退化，这时只靠光源视锥体剔除
+	extruded = hull.size() >= 3;
+}
+
+bool CasterCuller::mayCastShadow(const Bounds &box) const
+{
+	// （1）正交投影是仿射变换，包围盒8个角变换后的包围盒与[-1, 1]^3不相交就整个在这个级联外面
+	bool inside = false;
+	for (size_t i = 0; i < matrices.size() && !inside; i++)
+	{
+		Bounds clip = transformedBounds(box, matrices[i]);
+		inside = clip.max.x >= -1.0f && clip.min.x <= 1.0f && clip.max.y >= -1.0f && clip.min.y <= 1.0f &&
+				 clip.max.z >= -1.0f && clip.min.z <= 1.0f;
+	}
+	if (!inside || !extruded)
+		return inside;
+
+	// （2）光源空间里：整个物体比视锥体最远的一点离光源还远，挡不到视锥体里的任何东西
+	Bounds light = transformedBounds(box, lightView);
+	if (light.max.z < farthestZ)
+		return false;
+	// xy上与凸包做分离轴测试：矩形的两个轴，加上凸包每条边的法线
+	glm::vec2 hullMin(1e30f), hullMax(-1e30f);
+	for (const glm::vec2 &p : hull)
+	{
+		hullMin = glm::min(hullMin, p);
+		hullMax = glm::max(hullMax, p);
+	}
+	if (light.max.x < hullMin.x || light.min.x > hullMax.x || light.max.y < hullMin.y || light.min.y > hullMax.y)
+		return false;
+	for (size_t i = 0; i < hull.size(); i++)
+	{
+		const glm::vec2 &a = hull[i], &b = hull[(i + 1) % hull.size()];
+		// 逆时针凸包的外法线；取矩形在法线方向上最靠里的角，它也在边的外侧就说明整个矩形在外面
+		glm::vec2 outward(b.y - a.y, a.x - b.x);
+		glm::vec2 nearest(outward.x > 0.0f ? light.min.x : light.max.x, outward.y > 0.0f ? light.min.y : light.max.y);
+		if (glm::dot(outward, nearest - a) > 0.0f)
+			return false;
+	}
+	return true;
+}
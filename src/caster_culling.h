@@ -0,0 +1,31 @@
+#ifndef CASTER_CULLING_H
+#define CASTER_CULLING_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "view_setup.h"
+
+// 阴影投射者裁剪：深度pass提交之前，剔除投不出看得见的阴影的物体。物体按世界空间的包围盒测试，要留下必须
+// （1）与至少一个级联的光源视锥体（正交投影的盒子）相交；
+// （2）拟合到相机时，还要与相机视锥体沿光线方向朝光源拉伸出来的柱体相交：在光源空间里，柱体的截面是视锥体8个角在xy上的凸包，
+//     深度方向从视锥体离光源最远的一点一直延伸到光源。柱体外的物体，影子只会落在相机看不见的地方。
+//     这里用整个相机视锥体而不只是前shadowDistance的一段：光源视锥体盖得到的地方，更远的片段也照样采样阴影贴图，
+//     （1）已经把范围限制在光源视锥体里，剔除前后画面完全相同
+// 其他拟合方式的光源矩阵与相机无关，阴影缓存只凭矩阵判断深度贴图是否还能用，所以剔除结果也不能随相机变，只做（1）
+class CasterCuller
+{
+public:
+	// 光源矩阵更新之后调用。cameraView为NULL时只按光源视锥体剔除，否则再按相机视锥体拉伸出的柱体剔除
+	void setup(const glm::vec3 &lightPos, const glm::mat4 *lightSpaceMatrices, int count, const glm::mat4 *cameraView, float aspect);
+	// 世界空间包围盒为box的物体可能投射出看得见的阴影
+	bool mayCastShadow(const Bounds &box) const;
+
+private:
+	std::vector<glm::mat4> matrices;
+	glm::mat4 lightView;
+	bool extruded = false;
+	std::vector<glm::vec2> hull;	// 视锥体在光源空间xy上的凸包，逆时针
+	float farthestZ = 0.0f;			// 视锥体离光源最远处的光源空间z（光源看向-z）
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "file_watcher.h"
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+	if (inotifyFd >= 0)
+		close(inotifyFd);
+#endif
+}
+
+bool FileWatcher::watch(const std::string &path)
+{
+	file = std::filesystem::absolute(path);
+	std::error_code error;
+	lastWrite = std::filesystem::last_write_time(file, error);
+#ifdef __linux__
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd < 0)
+	{
+		std::cout << "inotify_init1 failed, falling back to polling " << path << std::endl;
+		return true;
+	}
+	watchDescriptor = inotify_add_watch(inotifyFd, file.parent_path().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	if (watchDescriptor < 0)
+	{
+		std::cout << "Failed to watch " << file.parent_path() << std::endl;
+		close(inotifyFd);
+		inotifyFd = -1;
+		return false;
+	}
+#endif
+	return true;
+}
+
+bool FileWatcher::poll()
+{
+#ifdef __linux__
+	if (inotifyFd >= 0)
+	{
+		bool changed = false;
+		alignas(inotify_event) char buffer[4096];
+		for (;;)
+		{
+			ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+			if (length <= 0)
+				break;	// EAGAIN：没有新事件
+			for (char *p = buffer; p < buffer + length;)
+			{
+				inotify_event *event = (inotify_event *)p;
+				if (event->len > 0 && file.filename() == event->name)
+					changed = true;
+				p += sizeof(inotify_event) + event->len;
+			}
+		}
+		return changed;
+	}
+#endif
+	// 没有inotify时每30次调用查一次修改时间，避免每帧都去stat
+	if (++pollCounter < 30)
+		return false;
+	pollCounter = 0;
+	std::error_code error;
+	std::filesystem::file_time_type write = std::filesystem::last_write_time(file, error);
+	if (error || write == lastWrite)
+		return false;
+	lastWrite = write;
+	return true;
+}
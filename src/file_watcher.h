@@ -0,0 +1,30 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <string>
+#include <filesystem>
+
+// 监视单个文件的修改
+// Linux上用inotify监视文件所在的目录（编辑器保存时常常是写临时文件再rename，直接监视文件本身会丢事件），
+// 其他平台退化为定期比较文件的修改时间。poll()不阻塞，每帧调用一次即可。
+class FileWatcher
+{
+public:
+	FileWatcher() = default;
+	~FileWatcher();
+	FileWatcher(const FileWatcher &) = delete;
+	FileWatcher &operator=(const FileWatcher &) = delete;
+
+	bool watch(const std::string &path);
+	// 自上次调用以来文件被修改过则返回true
+	bool poll();
+
+private:
+	std::filesystem::path file;
+	int inotifyFd = -1;
+	int watchDescriptor = -1;
+	std::filesystem::file_time_type lastWrite;
+	int pollCounter = 0;
+};
+
+#endif
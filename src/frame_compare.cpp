@@ -0,0 +1,76 @@
+#include "frame_compare.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// 读二进制PPM（P6，最大值255），本项目的两个后端都用这种格式写帧
+static bool readPPM(const std::string &path, int &width, int &height, std::vector<unsigned char> &rgb)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		std::cout << "Failed to open " << path << std::endl;
+		return false;
+	}
+	int maxValue = 0;
+	bool ok = fscanf(file, "P6 %d %d %d", &width, &height, &maxValue) == 3 && width > 0 && height > 0 && maxValue == 255;
+	// 头部之后恰好一个空白字符
+	ok = ok && fgetc(file) != EOF;
+	if (ok)
+	{
+		rgb.resize((size_t)width * height * 3);
+		ok = fread(rgb.data(), 1, rgb.size(), file) == rgb.size();
+	}
+	fclose(file);
+	if (!ok)
+		std::cout << path << " is not a binary PPM image" << std::endl;
+	return ok;
+}
+
+bool compareFrames(const std::string &dir, const std::string &referenceDir, int frames, ImageAgreement &result)
+{
+	result = ImageAgreement();
+	result.minPsnr = 99.0;
+	double absErrorSum = 0.0, channels = 0.0;
+	std::vector<unsigned char> image, reference;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "/frame_%04d.ppm", frame);
+		int width, height, referenceWidth, referenceHeight;
+		if (!readPPM(dir + name, width, height, image) || !readPPM(referenceDir + name, referenceWidth, referenceHeight, reference))
+			return false;
+		if (width != referenceWidth || height != referenceHeight)
+		{
+			std::cout << "Frame " << frame << " is " << width << "x" << height << " but the reference is "
+					  << referenceWidth << "x" << referenceHeight << std::endl;
+			return false;
+		}
+
+		double squaredError = 0.0;
+		size_t mismatches = 0;
+		for (size_t pixel = 0; pixel < image.size(); pixel += 3)
+		{
+			bool mismatch = false;
+			for (int c = 0; c < 3; c++)
+			{
+				int difference = std::abs((int)image[pixel + c] - (int)reference[pixel + c]);
+				squaredError += (double)difference * difference;
+				absErrorSum += difference;
+				mismatch = mismatch || difference > MISMATCH_THRESHOLD;
+			}
+			mismatches += mismatch;
+		}
+		channels += (double)image.size();
+		double mse = squaredError / image.size();
+		if (mse > 0.0)
+			result.minPsnr = std::min(result.minPsnr, 10.0 * std::log10(255.0 * 255.0 / mse));
+		result.maxMismatchPercent = std::max(result.maxMismatchPercent, mismatches * 300.0 / image.size());
+		result.frames++;
+	}
+	result.meanAbsError = channels > 0.0 ? absErrorSum / channels : 0.0;
+	return true;
+}
@@ -0,0 +1,21 @@
+#ifndef FRAME_COMPARE_H
+#define FRAME_COMPARE_H
+
+#include <string>
+
+// 逐张比较两个目录下同名的帧图像（frame_0000.ppm ...），检查不同渲染器/引擎的画面是否一致。
+// 各引擎的消隐规则相同，画面应当几乎逐像素一致；差异集中在阴影贴图的精度（例如光线投射用精确阴影）和少量边缘像素上
+struct ImageAgreement
+{
+	int frames = 0;					// 比较过的帧数
+	double minPsnr = 0.0;			// 所有帧中最低的PSNR（dB），完全相同时记为99
+	double meanAbsError = 0.0;		// 所有帧、所有通道的平均绝对误差（0..255）
+	double maxMismatchPercent = 0.0;	// 所有帧中最多的不一致像素比例：任一通道差超过MISMATCH_THRESHOLD
+};
+
+const int MISMATCH_THRESHOLD = 16;
+
+// 比较dir与referenceDir中的前frames帧，缺帧或尺寸不同时打印原因并返回false
+bool compareFrames(const std::string &dir, const std::string &referenceDir, int frames, ImageAgreement &result);
+
+#endif
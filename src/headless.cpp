@@ -0,0 +1,152 @@
+#include <glad/glad.h>
+#include "headless.h"
+#include <iostream>
+#include <vector>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLContext eglContext = EGL_NO_CONTEXT;
+
+bool createHeadlessContext(int major, int minor)
+{
+	// 优先使用Mesa的surfaceless平台：不需要X11/Wayland，也不需要DRM设备
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+		eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (eglDisplay == EGL_NO_DISPLAY)
+		eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint eglMajor, eglMinor;
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &eglMajor, &eglMinor))
+	{
+		std::cout << "Failed to initialize EGL display" << std::endl;
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		std::cout << "EGL does not support desktop OpenGL" << std::endl;
+		return false;
+	}
+
+	// 不创建任何surface，所以config只是为了满足驱动；没有可用config时退回configless上下文
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE};
+	EGLConfig config = NULL;
+	EGLint numConfigs = 0;
+	eglChooseConfig(eglDisplay, configAttribs, &config, 1, &numConfigs);
+
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, major,
+		EGL_CONTEXT_MINOR_VERSION, minor,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE};
+	eglContext = eglCreateContext(eglDisplay, numConfigs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttribs);
+	if (eglContext == EGL_NO_CONTEXT)
+	{
+		std::cout << "Failed to create EGL context (0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+		return false;
+	}
+	if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext))
+	{
+		std::cout << "Failed to make EGL context current" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void destroyHeadlessContext()
+{
+	if (eglDisplay == EGL_NO_DISPLAY)
+		return;
+	eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (eglContext != EGL_NO_CONTEXT)
+		eglDestroyContext(eglDisplay, eglContext);
+	eglTerminate(eglDisplay);
+	eglContext = EGL_NO_CONTEXT;
+	eglDisplay = EGL_NO_DISPLAY;
+}
+
+void *headlessGetProcAddress(const char *name)
+{
+	return (void *)eglGetProcAddress(name);
+}
+
+#else
+
+// Windows下没有EGL，无窗口模式不可用
+bool createHeadlessContext(int, int)
+{
+	std::cout << "Headless rendering requires EGL and is not available on this platform" << std::endl;
+	return false;
+}
+
+void destroyHeadlessContext()
+{
+}
+
+void *headlessGetProcAddress(const char *)
+{
+	return NULL;
+}
+
+#endif
+
+bool createOffscreenTarget(OffscreenTarget &target, int width, int height)
+{
+	target.width = width;
+	target.height = height;
+	glGenFramebuffers(1, &target.fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+
+	glGenRenderbuffers(1, &target.colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.colorBuffer);
+
+	glGenRenderbuffers(1, &target.depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target.depthBuffer);
+
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	if (!complete)
+		std::cout << "ERROR::FRAMEBUFFER::OFFSCREEN_TARGET_INCOMPLETE" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return complete;
+}
+
+void destroyOffscreenTarget(OffscreenTarget &target)
+{
+	glDeleteRenderbuffers(1, &target.colorBuffer);
+	glDeleteRenderbuffers(1, &target.depthBuffer);
+	glDeleteFramebuffers(1, &target.fbo);
+	target = OffscreenTarget();
+}
+
+bool writeFramePPM(const OffscreenTarget &target, const char *path)
+{
+	std::vector<unsigned char> pixels((size_t)target.width * target.height * 3);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, target.fbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, target.width, target.height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+	FILE *file = fopen(path, "wb");
+	if (!file)
+	{
+		std::cout << "Failed to open " << path << " for writing" << std::endl;
+		return false;
+	}
+	fprintf(file, "P6\n%d %d\n255\n", target.width, target.height);
+	size_t rowBytes = (size_t)target.width * 3;
+	for (int y = target.height - 1; y >= 0; y--)
+		fwrite(pixels.data() + y * rowBytes, 1, rowBytes, file);
+	fclose(file);
+	return true;
+}
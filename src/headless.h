@@ -0,0 +1,30 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+// 无窗口（离屏）渲染后端
+// 渲染农场节点上没有显示器，也不一定有GPU，因此不能用glfwCreateWindow。
+// 这里用EGL的surfaceless平台创建OpenGL核心上下文（Mesa llvmpipe也可以），
+// 场景渲染进一个FBO，再用glReadPixels把每一帧读回并写成图像。
+
+// 创建并激活一个没有默认帧缓冲的OpenGL上下文，失败返回false
+bool createHeadlessContext(int major, int minor);
+void destroyHeadlessContext();
+// 供glad加载函数指针使用
+void *headlessGetProcAddress(const char *name);
+
+// 离屏渲染目标：颜色 + 深度模板renderbuffer
+struct OffscreenTarget
+{
+	unsigned int fbo = 0;
+	unsigned int colorBuffer = 0;
+	unsigned int depthBuffer = 0;
+	int width = 0;
+	int height = 0;
+};
+
+bool createOffscreenTarget(OffscreenTarget &target, int width, int height);
+void destroyOffscreenTarget(OffscreenTarget &target);
+// 读回target的颜色缓冲并写成二进制PPM（P6）；OpenGL的原点在左下角，写出时上下翻转
+bool writeFramePPM(const OffscreenTarget &target, const char *path);
+
+#endif
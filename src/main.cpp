@@ -2,19 +2,51 @@
 #include <GLFW/glfw3.h>
 #include <iostream>
 #include <math.h>
+#include <chrono>
+#include <filesystem>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
+#include "options.h"
+#include "headless.h"
+#include "frame_compare.h"
+#include "overdraw.h"
+#include "profiler.h"
+#include "shader_program.h"
+#include "normal_matrix.h"
+#include "shadow_cache.h"
+#include "caster_culling.h"
+#include "scene.h"
+#include "scene_gpu.h"
+#include "bsp_draw.h"
+#include "file_watcher.h"
+#include "camera_path.h"
+#include "benchmark.h"
+#include "uniform_blocks.h"
+#include "meshes.h"
+#include "view_setup.h"
+#include "soft_renderer.h"
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void processInput(GLFWwindow *window);
 
-const unsigned int SCR_WIDTH = 800; 
-const unsigned int SCR_HEIGHT = 600;
 
-// 光源在世界坐标的位置（平移向量）
+// 需要单独计时的渲染pass
+enum RenderPass
+{
+	PASS_SHADOW,		// 深度贴图pass，渲染到depthMapFBO
+	PASS_LIT,			// 正方体+地板的光照pass
+	PASS_LIGHT_CUBE,	// 光源立方体
+	PASS_COUNT
+};
+
+// 光源在世界坐标的位置（平移向量），取自场景的第一个光源
 glm::vec3 lightPos(0.5f, 1.0f, 2.0f);
 
 // 这是一个顶点着色器的配置，是一个C语言风格的着色器语言
@@ -22,24 +54,27 @@ const char *vertexShaderSource = "#version 330 core\n"	//这个地方是3.3版
 								 "layout (location = 0) in vec3 aPos;\n"
 								 "layout (location = 1) in vec2 aTexCoord;\n"
 								 "layout (location = 2) in vec3 aNormalVec;\n"
+								 "layout (location = 3) in mat4 aInstanceModel;\n"	// 实例化绘制时每个正方体的model矩阵，占用3~6号location
+								 "layout (location = 7) in mat3 aInstanceNormal;\n"	// 对应的法线矩阵，CPU上预先算好，占用7~9号location
 								 "out vec2 TexCoord;\n"		// 传给片段着色器纹理坐标
 								 "out vec3 FragPosition;\n"		// 计算并传给片段着色器，该片段所在的世界坐标
 								 "out vec3 NormalVec;\n"	// 传给片段着色器法线方向
-								 "out vec4 FragPosLightSpace;\n"	// 将世界坐标系下的坐标转化到光源视角下
+								 FRAME_DATA_GLSL	// projection、view在每帧共用的uniform块里
 								 "uniform mat4 model;\n"
-								 "uniform mat4 view;\n"
-								 "uniform mat4 projection;\n"
-								 "uniform mat4 lightSpaceMatrix;\n"
+								 "uniform mat3 normalMatrix;\n"	// model的法线矩阵，CPU上每个物体算一次
+								 "uniform bool instanced;\n"	// true时model取自实例属性，否则取自uniform（地板、逐个绘制的正方体）
 								 "void main()\n"
 								 "{\n"
-								 " gl_Position = projection * view * model * vec4(aPos.x, aPos.y, aPos.z, 1.0f);\n"	//顶点着色器首先要传出去的必须是位置属性
+								 " mat4 modelMatrix = instanced ? aInstanceModel : model;\n"
+								 " gl_Position = projection * view * modelMatrix * vec4(aPos.x, aPos.y, aPos.z, 1.0f);\n"	//顶点着色器首先要传出去的必须是位置属性
 									//这里我们还要注意的是，这个地方还没有乘上如model-view-projection矩阵。
 									//如果有需要，需要乘这个矩阵。 另外，我们将vec3再加上1，是为了形成四元表示
 								 " TexCoord = vec2(aTexCoord.x, aTexCoord.y);\n"	// 为了有纹理图案
-								 " FragPosition = vec3(model * vec4(aPos, 1.0f));\n"	// 有了顶点坐标，那么根据该顶点的四元坐标进行Model变换即可得到世界坐标系下的片段坐标
-								 " NormalVec = vec3(transpose(inverse(model)) * vec4(aNormalVec, 1.0f));\n"	// 传递给片段着色器予以处理漫反射光照
-								 // 因为仅包含平移和旋转，这种条件下可以根据法线矩阵定理使用model的逆的转置并取其前3*3子矩阵进行操作
-								 " FragPosLightSpace = lightSpaceMatrix * vec4(FragPosition, 1.0f);\n"
+								 " FragPosition = vec3(modelMatrix * vec4(aPos, 1.0f));\n"	// 有了顶点坐标，那么根据该顶点的四元坐标进行Model变换即可得到世界坐标系下的片段坐标
+								 " NormalVec = (instanced ? aInstanceNormal : normalMatrix) * aNormalVec;\n"	// 传递给片段着色器予以处理漫反射光照
+								 // 法线矩阵是model左上3*3子矩阵的逆的转置，对一个物体的所有顶点都相同，所以不在这里逐顶点求逆。
+								 // 法线是方向而不是位置，只能乘3*3矩阵，不能像vec4(n, 1.0)那样带上平移
+								 // 光源视角下的坐标要先知道片段落在哪个级联，所以放到片段着色器里算
 								 "}\0";
 
 // 片段着色器用来指定我们最后成色是什么颜色的着色器。
@@ -48,54 +83,49 @@ const char *fragmentShaderSource = "#version 330 core\n"
 								   "in vec2 TexCoord;\n"	// 传入由顶点着色器传出的纹理坐标
 								   "in vec3 FragPosition;\n"
 								   "in vec3 NormalVec;\n"	// 传入由顶点着色器得到的各个顶点的法向量
-								   "in vec4 FragPosLightSpace;\n"	// 光源视角下的片段坐标
-									"uniform vec3 objectColor;\n"
-									"uniform vec3 lightColor;\n "	
+									FRAME_DATA_GLSL		// 视角位置、光源（0号光源投射阴影）、各级联的光源矩阵
+									MATERIAL_DATA_GLSL	// objectColor
 									"uniform sampler2D ourTexture;\n"	// 二维纹理采样器	0号采样器
-									"uniform sampler2D shadowMap;\n"	// 阴影映射	1号采样器
-									"uniform vec3 lightPosition;\n"	// 光源的坐标
-									"uniform vec3 viewPosition;\n"	// 视角的世界坐标位置
+									"uniform sampler2DArrayShadow shadowMap;\n"	// 阴影映射，每个级联一层	1号采样器：深度比较由采样器完成，返回照亮的比例
+									// 阴影过滤（--shadow-filter），链接后设置一次
+									"uniform int shadowTaps;\n"		// 每个片段的取样次数，1为单次比较
+									"uniform float shadowFootprint;\n"	// 过滤覆盖的半径（texel），为0时不加深度偏移
+									"uniform float shadowRadius;\n"		// 泊松圆盘的半径（texel）
+									// 单位圆内的泊松圆盘，按最佳候选法逐点加入，前4、8、16个点各自也分布均匀，N次取样直接用前N个
+									"const vec2 POISSON_DISK[32] = vec2[](\n"
+									"	vec2(-0.9168, 0.2767), vec2(0.8994, -0.3781), vec2(0.3662, 0.9184), vec2(-0.3779, -0.8737),\n"
+									"	vec2(-0.0128, 0.0202), vec2(0.8751, 0.3587), vec2(0.3573, -0.8815), vec2(-0.3990, 0.8406),\n"
+									"	vec2(-0.8849, -0.3797), vec2(0.3546, 0.3901), vec2(-0.3522, -0.3608), vec2(0.3352, -0.3665),\n"
+									"	vec2(-0.3952, 0.3083), vec2(0.6028, -0.0036), vec2(0.0411, 0.6526), vec2(-0.0149, -0.6390),\n"
+									"	vec2(-0.6192, -0.0410), vec2(-0.7513, 0.6348), vec2(0.9749, -0.0023), vec2(0.6799, 0.6848),\n"
+									"	vec2(0.6226, -0.5968), vec2(-0.5977, -0.5991), vec2(-0.0873, 0.9947), vec2(-0.0099, -0.9944),\n"
+									"	vec2(-0.9721, -0.0636), vec2(-0.0052, -0.3141), vec2(-0.0637, 0.3608), vec2(-0.2483, 0.5888),\n"
+									"	vec2(0.3025, 0.0600), vec2(0.6214, -0.2958), vec2(-0.2677, -0.0938), vec2(-0.6247, -0.3148));\n"
 
 
 									// main函数
 								   "void main()\n"
 								   "{\n"
-								    //  环境光光照ambient
+									//  环境光光照ambient
 									//  定义环境光强度为0.1，较小的值以模拟环境的微光
 								   " float ambientStrength = 0.2;\n"
-									" vec3 ambient = ambientStrength * lightColor;\n"
-
-									//  漫反射光照diffuse：取决于法向+光向
-									//  首先计算片段到光源的方向 与 片段表面的法向量的夹角
 									" vec3 normal_dir = normalize(NormalVec);\n"	// 对法线方向进行标准化
-									" vec3 light_dir = normalize(lightPosition - FragPosition);\n"	// 从片元到发光点的向量标准化
-										// 用单位向量点积来表示漫反射强弱，范围为[-1,1]
-										// 如果点积结果为负，表示光线本应该照不到片段表面，应该舍弃
-									" float diffStrength = max(dot(normal_dir, light_dir), 0.0f);\n"
-									" vec3 diffuse = diffStrength * lightColor;\n"
-
-
+									//  计算片段到的视角方向
+									" vec3 view_dir = normalize(viewPosition.xyz - FragPosition);\n"
 									//  镜面反射高光specular: 取决于法向+光向+视角方向，视角与反射光线角度越小则光强度越大
 									//  首先给定镜面反射常量
 									" float specularStrengthConst = 1.0f;\n"
 									" int Shininess = 128;\n"	// 高光反光度；越大，则散射少，高光点形状小。
-									//  计算片段到的视角方向
-									" vec3 view_dir = normalize(viewPosition - FragPosition);\n"
-									//  计算反射光线的方向,reflect第一个参数：从光源指向片段的向量，利用光线方向取负号。
-									//  第二个参数是法线方向
-									" vec3 reflect_dir = reflect(-light_dir, normal_dir);\n"
-									" vec3 halfway_dir = normalize(light_dir + view_dir);\n"
 
-									//  普通冯氏光照
-									// " float specularStrength = specularStrengthConst * pow(max(dot(view_dir, reflect_dir), 0.0f), Shininess);\n"
-
-									//  blinn-phong光照
-									" float specularStrength = specularStrengthConst * pow(max(dot(view_dir, halfway_dir), 0.0f), Shininess);\n"
-
-									" vec3 specular = specularStrength * lightColor;\n"	// 镜面高光
-
-									//  计算阴影
+									//  计算阴影（只有0号光源有阴影贴图）
 									"float shadow = 0.0f;\n"  
+									// 按片段在相机视线方向上的深度选级联：落在哪一段就用哪一段的阴影贴图，近处的级联texel更小
+									"float viewDepth = -(view * vec4(FragPosition, 1.0f)).z;\n"
+									"int cascade = 0;\n"
+									"while (cascade < cascadeCount - 1 && viewDepth > cascadeSplits[cascade])\n"
+									"	cascade++;\n"
+									// 将世界坐标系下的坐标转化到这个级联的光源视角下
+									"vec4 FragPosLightSpace = cascadeMatrices[cascade] * vec4(FragPosition, 1.0f);\n"
 
 									// 我们想要标准化深度到0-1之间，这样能够与深度贴图的深度匹配
 									// 因为传入片段着色器的这个光空间的片段位置并未进行透视除法（平时OpenGL程序内部是可以自动进行的）
@@ -104,37 +134,104 @@ const char *fragmentShaderSource = "#version 330 core\n"
 									"vec3 coords = FragPosLightSpace.xyz / FragPosLightSpace.w;\n"
 										// 再将coords线性映射到0,1之间
 										"coords = coords * 0.5 + 0.5;\n"    
-										// 取得跟当前片段相同的xy对应的最近点的深度(使用[0,1]范围下的fragPosLight当坐标)
-										"float closestDepth = texture(shadowMap, coords.xy).r;\n"
 										// 得到当前片段在光空间（光源的视角下的深度值）
 										"float depth = coords.z;\n"
-										// 比较最近点和当前片段的深度
-
-										"if(depth > closestDepth)\n"	// 不是最近点，则返回shadow=1
+										// 光源视锥体以外没有阴影信息，算作照亮（否则纹理的GL_REPEAT会把阴影重复铺到远处）
+										"bool outside = depth > 1.0 || coords.x < 0.0 || coords.x > 1.0 || coords.y < 0.0 || coords.y > 1.0;\n"
+										// 深度偏移（与view_setup.cpp的shadowBias相同）：表面与光线越斜，过滤范围内自己的深度变化越大，
+										// 不减去这部分，表面会把自己算成遮挡者，出现阴影痤疮
+										"float bias = 0.0f;\n"
+										"if (shadowFootprint > 0.0)\n"
 										"{\n"
-										"	shadow = 1.0f;\n"
+										"	float cosTheta = clamp(dot(normal_dir, shadowDirection.xyz), 0.0, 1.0);\n"
+										"	float slope = min(sqrt(1.0 - cosTheta * cosTheta) / max(cosTheta, 0.001), " GLSL_LITERAL(SHADOW_MAX_SLOPE_VALUE) ");\n"
+										"	bias = cascadeDepthPerTexel[cascade] * (" GLSL_LITERAL(SHADOW_BIAS_TEXELS_VALUE) " + shadowFootprint * slope);\n"
 										"}\n"
-										"else\n"
+										// 比较采样器：参考深度不超过贴图里的深度时为1（照亮）。GL_LINEAR时硬件比较相邻2x2个texel再双线性混合
+										"float reference = depth - bias;\n"
+										"if (!outside)\n"
 										"{\n"
-										"	shadow = 0.0f;\n"
+										"	float lit = 0.0f;\n"
+										"	if (shadowTaps == 1)\n"
+										"		lit = texture(shadowMap, vec4(coords.xy, cascade, reference));\n"
+										"	else\n"
+										"	{\n"
+										// 圆盘按像素旋转（交错梯度噪声），相邻像素取不同的点，规则的条带变成细碎的噪点
+										"		float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));\n"
+										"		mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));\n"
+										"		vec2 scale = shadowRadius / vec2(textureSize(shadowMap, 0).xy);\n"
+										"		for (int i = 0; i < shadowTaps; i++)\n"
+										"			lit += texture(shadowMap, vec4(coords.xy + rotation * POISSON_DISK[i] * scale, cascade, reference));\n"
+										"		lit /= float(shadowTaps);\n"
+										"	}\n"
+										"	shadow = 1.0f - lit;\n"
 										"}\n"
 
-
-									// 将三个光源的光相加得到总光源    1-shadow表示若shadow越大，则光照影响越小
-									" vec3 result = (ambient + (1.0f - shadow) * (diffuse + specular));\n"
+									// 逐个光源累加 环境光 + 漫反射 + 镜面高光
+									" vec3 result = vec3(0.0f);\n"
+									" for (int i = 0; i < lightCount; i++)\n"
+									" {\n"
+									"  vec3 ambient = ambientStrength * lightColors[i].rgb;\n"
+									//  漫反射光照diffuse：取决于法向+光向
+									//  首先计算片段到光源的方向 与 片段表面的法向量的夹角
+									"  vec3 light_dir = normalize(lightPositions[i].xyz - FragPosition);\n"	// 从片元到发光点的向量标准化
+										// 用单位向量点积来表示漫反射强弱，范围为[-1,1]
+										// 如果点积结果为负，表示光线本应该照不到片段表面，应该舍弃
+									"  float diffStrength = max(dot(normal_dir, light_dir), 0.0f);\n"
+									"  vec3 diffuse = diffStrength * lightColors[i].rgb;\n"
+									//  普通冯氏光照：reflect(-light_dir, normal_dir)与视角方向的夹角
+									//  blinn-phong光照：半程向量与法线的夹角
+									"  vec3 halfway_dir = normalize(light_dir + view_dir);\n"
+									"  float specularStrength = specularStrengthConst * pow(max(dot(view_dir, halfway_dir), 0.0f), Shininess);\n"
+									"  vec3 specular = specularStrength * lightColors[i].rgb;\n"	// 镜面高光
+									// 1-shadow表示若shadow越大，则光照影响越小
+									"  float lit = i == 0 ? 1.0f - shadow : 1.0f;\n"
+									"  result += ambient + lit * (diffuse + specular);\n"
+									" }\n"
 									// 计算总光照下的纹理显示
-									" FragColor = vec4(result, 1.0f) * texture(ourTexture, TexCoord) * vec4(objectColor, 1.0f);\n"	// 使用GLSL内建的texture函数来采样纹理的颜色，它第一个参数是纹理采样器，第二个参数是对应的纹理坐标。
+									" FragColor = vec4(result, 1.0f) * texture(ourTexture, TexCoord) * vec4(objectColor.rgb, 1.0f);\n"	// 使用GLSL内建的texture函数来采样纹理的颜色，它第一个参数是纹理采样器，第二个参数是对应的纹理坐标。
 								   "}\n\0";
 
 
 // 深度贴图着色器：将顶点渲染到以光源为camera视角的着色器
-const char *depthVertexShaderSource = "#version 330 core\n"
-										"layout (location = 0) in vec3 position;\n"
-										"uniform mat4 lightSpaceMatrix;\n"
+// 每个级联是深度纹理数组的一层。所有物体都按级联数实例化绘制，gl_InstanceID % cascadeCount就是级联号，
+// 图元由gl_Layer送到对应的层，一次提交画完所有级联。
+// 源码前面由程序补上#version和#extension：驱动支持在顶点着色器里写gl_Layer时直接写，
+// 否则定义GEOMETRY_LAYER，由下面的直通几何着色器写gl_Layer
+const char *depthVertexShaderSource = "layout (location = 0) in vec3 position;\n"
+										"layout (location = 3) in mat4 aInstanceModel;\n"
+										FRAME_DATA_GLSL	// cascadeMatrices、cascadeCount
 										"uniform mat4 model;\n"
+										"uniform bool instanced;\n"
+										"#ifdef GEOMETRY_LAYER\n"
+										"flat out int vertexCascade;\n"
+										"#endif\n"
+										"void main()\n"
+										"{\n"
+										"int cascade = gl_InstanceID % cascadeCount;\n"
+										"mat4 modelMatrix = instanced ? aInstanceModel : model;\n"
+										"gl_Position = cascadeMatrices[cascade] * modelMatrix * vec4(position, 1.0f);\n"
+										"#ifdef GEOMETRY_LAYER\n"
+										"vertexCascade = cascade;\n"
+										"#else\n"
+										"gl_Layer = cascade;\n"
+										"#endif\n"
+										"}\n\0";
+
+// 不支持在顶点着色器里写gl_Layer时的退路：原样输出三角形，只补上层号
+const char *depthGeometryShaderSource = "#version 330 core\n"
+										"layout (triangles) in;\n"
+										"layout (triangle_strip, max_vertices = 3) out;\n"
+										"flat in int vertexCascade[];\n"
 										"void main()\n"
 										"{\n"
-										"gl_Position = lightSpaceMatrix * model * vec4(position, 1.0f);\n"
+										"for (int i = 0; i < 3; i++)\n"
+										"{\n"
+										"	gl_Layer = vertexCascade[0];\n"
+										"	gl_Position = gl_in[i].gl_Position;\n"
+										"	EmitVertex();\n"
+										"}\n"
+										"EndPrimitive();\n"
 										"}\n\0";
 
 const char *depthFragmentShaderSource = "#version 330 core\n"
@@ -151,9 +248,8 @@ const char *depthFragmentShaderSource = "#version 330 core\n"
 //	光源的顶点着色器
 const char *lightVertexShaderSource = "#version 330 core\n"
 									"layout (location = 0) in vec3 aPos;\n"
+									FRAME_DATA_GLSL	// projection、view
 									"uniform mat4 model;\n"
-									"uniform mat4 view;\n"
-									"uniform mat4 projection;\n"
 									"void main()\n"
 									"{\n"
 									"	gl_Position = projection * view * model * vec4(aPos, 1.0);\n"
@@ -168,209 +264,188 @@ const char *lightFragmentShaderSource = "#version 330 core\n"
 								"}\n\0";
 
 
-int main()
+// 各着色器在渲染循环里用到的uniform位置，链接后由ShaderProgram的反射表一次性解析。
+// 相机、光源和材质颜色在uniform块里（见uniform_blocks.h），这里只剩每次绘制都不同的uniform
+struct SceneUniforms
 {
-	// glfw: initialize and configure
-	// 可以定义opengl中的参数
-	// ------------------------------
-	
-	// 首先初始化
-	glfwInit();
-	// 主版本号
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	// 次版本号
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	// 设置：我们使用的是核心的模式，意味着我们只能使用opengl功能的一个子集
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-// #ifdef __APPLE__
-// 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-// #endif
-
-	// glfw window creation
-	// --------------------
-	// 这里需要输入参数，窗口的宽和高
-	// 返回的这个是OpenGLWindow窗口对象，这个窗口对象存放了所有和窗口相关的数据，而且会被GLFW的其他函数频繁地用到
-	GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "纹理+坐标变换+blin-phong光照+阴影效果", NULL, NULL);
-
-	if (window==NULL)
-	{
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
-		return -1;
-	}
-	// 创建完窗口之后，就可以通知glfw把我们的上下文设置为当前线程的主上下文
-	glfwMakeContextCurrent(window); 
-	// 回调函数的作用：每次我们可能都会改变我们的窗口大小，那么对应的视口需要调整
-	// 每当我们窗口被改变的时候就会调用这个函数，然后视口就会作出相应变化
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-
-	// glad: load all OpenGL function pointers
-	// glad是用来管理OpenGL的函数指针的，所以在调用任何OpenGL的函数之前，我们需要初始化glad
-	// 因为openGL知识一个标准/规范，具体的实现是有驱动开发商针对特定显卡实现的。
-	// 由于Opengl驱动版本过多，他大多数的函数位置都无法在编译的时候确定下来，需要在运行时查询。所以任函数位置查询
-	// 任务就落在了开发者身上
-	// 开发者需要在运行时获取函数地址并将其保存在一个函数指针中供以后使用
-	//  ---------------------------------------
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-	{
-		std::cout << "Failed to initialize GLAD" << std::endl; 
-		return -1;
-	}
-
-
-	//--------------开启z-buffer深度测试-----------------
-	glEnable(GL_DEPTH_TEST);
-
+	GLint model, normalMatrix, instanced;
+};
 
+struct DepthUniforms
+{
+	GLint model, instanced;
+};
 
-// ----------------------着色器的定义--------------------------------
-	// build and compile our shader program
-	// ------------------------------------
+struct LightCubeUniforms
+{
+	GLint model;
+};
 
+// 只有位置（location 0）的VAO，positionVBO带回新建的紧凑位置缓冲
+static GLuint createDepthVAO(const GLfloat *vertices, int count, GLuint &positionVBO)
+{
+	std::vector<GLfloat> positions = meshPositions(vertices, count);
+	GLuint depthVAO;
+	glGenVertexArrays(1, &depthVAO);
+	glGenBuffers(1, &positionVBO);
+	glBindVertexArray(depthVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(GLfloat), positions.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void *)0);
+	glEnableVertexAttribArray(0);
+	return depthVAO;
+}
 
-	// 物体的vertex shader
-	// 首先创建一个顶点着色器对象
-	unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER); 
-	// 把开头写的源码附加给这个着色器对象
-	glShaderSource(vertexShader, 1, &vertexShaderSource, NULL); 
-	// 直接编译这个着色器对象（因为之前只是C语言的代码）
-	glCompileShader(vertexShader);
-	// check for shader compile errors 
-	// 查看编译是否成功的一段代码
-	int success;
-	char infoLog[512];
-	glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success); 
-	if (!success)
+// 当前上下文是否支持名为name的扩展
+static bool hasExtension(const char *name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
 	{
-		glGetShaderInfoLog(vertexShader, 512, NULL, infoLog); 
-		std::cout << "1ERROR::SHADER::VERTEX::COMPILATION_FAILED\n"
-				  << infoLog << std::endl;
+		if (strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+			return true;
 	}
+	return false;
+}
 
 
+int main(int argc, char **argv)
+{
+	RenderOptions options;
+	if (!parseOptions(argc, argv, options))
+		return -1;
+	// CPU渲染器不需要GL上下文
+	if (options.renderer != "gl")
+		return runSoftwareRenderer(options);
 
-	// 物体的fragment shader
-	unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER); 
-	glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL); 
-	glCompileShader(fragmentShader);
-	// check for shader compile errors
-	glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-	if (!success)
+	GLFWwindow *window = NULL;
+	if (options.headless)
 	{
-		glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog); 
-		std::cout << "1ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n"
-				  << infoLog << std::endl;
+		// 无窗口模式：EGL离屏上下文，不需要显示器
+		// ------------------------------
+		if (!createHeadlessContext(3, 3))
+			return -1;
+		if (!gladLoadGLLoader((GLADloadproc)headlessGetProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			destroyHeadlessContext();
+			return -1;
+		}
 	}
-
-
-	// 我们需要获得完整的着色器程序，则需要将顶点着色器与片源着色器链接起来
-	// 因为着色器成色对象是多个着色器合并之后最后链接再完成的版本。
-	// 物体的link shaders
-	unsigned int shaderProgram = glCreateProgram();
-	glAttachShader(shaderProgram, vertexShader);
-	glAttachShader(shaderProgram, fragmentShader);
-	glLinkProgram(shaderProgram);
-	// check for linking errors
-	glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-	if (!success)
+	else
 	{
-		glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-		std::cout << "1ERROR::SHADER::PROGRAM::LINKING_FAILED\n"
-				  << infoLog << std::endl;
+		// glfw: initialize and configure
+		// 可以定义opengl中的参数
+		// ------------------------------
+	
+		// 首先初始化
+		glfwInit();
+		// 主版本号
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		// 次版本号
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		// 设置：我们使用的是核心的模式，意味着我们只能使用opengl功能的一个子集
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+	// #ifdef __APPLE__
+	// 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	// #endif
+
+		// glfw window creation
+		// --------------------
+		// 这里需要输入参数，窗口的宽和高
+		// 返回的这个是OpenGLWindow窗口对象，这个窗口对象存放了所有和窗口相关的数据，而且会被GLFW的其他函数频繁地用到
+		window = glfwCreateWindow(options.width, options.height, "纹理+坐标变换+blin-phong光照+阴影效果", NULL, NULL);
+
+		if (window==NULL)
+		{
+			std::cout << "Failed to create GLFW window" << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+		// 创建完窗口之后，就可以通知glfw把我们的上下文设置为当前线程的主上下文
+		glfwMakeContextCurrent(window); 
+		// 基准测试时关掉垂直同步，否则帧时间被锁在刷新率上
+		if (!options.benchmarkPath.empty())
+			glfwSwapInterval(0);
+		// 回调函数的作用：每次我们可能都会改变我们的窗口大小，那么对应的视口需要调整
+		// 每当我们窗口被改变的时候就会调用这个函数，然后视口就会作出相应变化
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+
+		// glad: load all OpenGL function pointers
+		// glad是用来管理OpenGL的函数指针的，所以在调用任何OpenGL的函数之前，我们需要初始化glad
+		// 因为openGL知识一个标准/规范，具体的实现是有驱动开发商针对特定显卡实现的。
+		// 由于Opengl驱动版本过多，他大多数的函数位置都无法在编译的时候确定下来，需要在运行时查询。所以任函数位置查询
+		// 任务就落在了开发者身上
+		// 开发者需要在运行时获取函数地址并将其保存在一个函数指针中供以后使用
+		//  ---------------------------------------
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl; 
+			return -1;
+		}
 	}
-	glDeleteShader(vertexShader);
-	glDeleteShader(fragmentShader);
 
 
+	//--------------开启z-buffer深度测试-----------------
+	glEnable(GL_DEPTH_TEST);
 
-	
-	// 深度缓冲顶点着色器
-	unsigned int depthVertexShader = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(depthVertexShader, 1, &depthVertexShaderSource, NULL);
-	glCompileShader(depthVertexShader);
-	glGetShaderiv(depthVertexShader, GL_COMPILE_STATUS, &success); 
-	if (!success)
-	{
-		glGetShaderInfoLog(depthVertexShader, 512, NULL, infoLog); 
-		std::cout << "2ERROR::SHADER::VERTEX::COMPILATION_FAILED\n"
-				  << infoLog << std::endl;
-	}
 
 
+// ----------------------着色器的定义--------------------------------
+	// build and compile our shader program
+	// ------------------------------------
 
-	// 深度缓冲片段着色器
-	unsigned int depthFragmentShader = glCreateShader(GL_FRAGMENT_SHADER); 
-	glShaderSource(depthFragmentShader, 1, &depthFragmentShaderSource, NULL); 
-	glCompileShader(depthFragmentShader);
-	// check for shader compile errors
-	glGetShaderiv(depthFragmentShader, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(depthFragmentShader, 512, NULL, infoLog); 
-		std::cout << "2ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n"
-				  << infoLog << std::endl;
-	}
 
-	// 深度缓冲着色器link
-	unsigned int depthShaderProgram = glCreateProgram();
-	glAttachShader(depthShaderProgram, depthVertexShader);
-	glAttachShader(depthShaderProgram, depthFragmentShader);
-	glLinkProgram(depthShaderProgram);
-	// check for linking errors
-	glGetProgramiv(depthShaderProgram, GL_LINK_STATUS, &success);
-	if (!success)
+	// 深度着色器写gl_Layer的方式：3.3核心模式的顶点着色器不能写gl_Layer，要靠扩展，没有时用几何着色器
+	std::string depthVertexSource = "#version 330 core\n";
+	const char *depthGeometrySource = NULL;
+	if (hasExtension("GL_ARB_shader_viewport_layer_array"))
+		depthVertexSource += "#extension GL_ARB_shader_viewport_layer_array : require\n";
+	else if (hasExtension("GL_AMD_vertex_shader_layer"))
+		depthVertexSource += "#extension GL_AMD_vertex_shader_layer : require\n";
+	else
 	{
-		glGetProgramInfoLog(depthShaderProgram, 512, NULL, infoLog);
-		std::cout << "3ERROR::SHADER::PROGRAM::LINKING_FAILED\n"
-				  << infoLog << std::endl;
+		depthVertexSource += "#define GEOMETRY_LAYER\n";
+		depthGeometrySource = depthGeometryShaderSource;
 	}
-	glDeleteShader(depthVertexShader);
-	glDeleteShader(depthFragmentShader);
-
+	depthVertexSource += depthVertexShaderSource;
 
-	// 光源的vertex shader
-	unsigned int lightVertexShader = glCreateShader(GL_VERTEX_SHADER); 
-	glShaderSource(lightVertexShader, 1, &lightVertexShaderSource, NULL); 
-	glCompileShader(lightVertexShader);
-	glGetShaderiv(lightVertexShader, GL_COMPILE_STATUS, &success); 
-	if (!success)
+	// 物体、深度贴图、光源三个着色器程序；链接时反射出全部活动uniform
+	ShaderProgram shaderProgram, depthShaderProgram, lightShaderProgram;
+	if (!shaderProgram.build("scene", vertexShaderSource, fragmentShaderSource) ||
+		!depthShaderProgram.build("depth", depthVertexSource.c_str(), depthFragmentShaderSource, depthGeometrySource) ||
+		!lightShaderProgram.build("light", lightVertexShaderSource, lightFragmentShaderSource))
 	{
-		glGetShaderInfoLog(lightVertexShader, 512, NULL, infoLog); 
-		std::cout << "3ERROR::SHADER::VERTEX::COMPILATION_FAILED\n"
-				  << infoLog << std::endl;
+		return -1;
 	}
+	// 采样器：0号纹理单元是物体纹理，1号是阴影贴图
+	shaderProgram.setSampler("ourTexture", 0);
+	shaderProgram.setSampler("shadowMap", 1);
+	// 阴影过滤的参数在整个运行期间不变
+	shaderProgram.use();
+	glUniform1i(shaderProgram.uniform("shadowTaps"), shadowFilterTaps(options.shadowFilter));
+	glUniform1f(shaderProgram.uniform("shadowFootprint"), shadowFilterFootprint(options.shadowFilter));
+	glUniform1f(shaderProgram.uniform("shadowRadius"), SHADOW_POISSON_RADIUS);
+	// 三个程序共用同一个每帧uniform块，物体着色器另有材质块
+	shaderProgram.bindUniformBlock("FrameData", FRAME_UNIFORM_BINDING, sizeof(FrameData));
+	shaderProgram.bindUniformBlock("MaterialData", MATERIAL_UNIFORM_BINDING, sizeof(MaterialData));
+	depthShaderProgram.bindUniformBlock("FrameData", FRAME_UNIFORM_BINDING, sizeof(FrameData));
+	lightShaderProgram.bindUniformBlock("FrameData", FRAME_UNIFORM_BINDING, sizeof(FrameData));
 
+	// 渲染循环里用到的uniform位置一次性解析好，循环中不再按名字查询
+	SceneUniforms sceneUniforms;
+	sceneUniforms.model = shaderProgram.uniform("model");
+	sceneUniforms.normalMatrix = shaderProgram.uniform("normalMatrix");
+	sceneUniforms.instanced = shaderProgram.uniform("instanced");
 
+	DepthUniforms depthUniforms;
+	depthUniforms.model = depthShaderProgram.uniform("model");
+	depthUniforms.instanced = depthShaderProgram.uniform("instanced");
 
-	// 光源的fragment shader
-	unsigned int lightFragmentShader = glCreateShader(GL_FRAGMENT_SHADER); 
-	glShaderSource(lightFragmentShader, 1, &lightFragmentShaderSource, NULL); 
-	glCompileShader(lightFragmentShader);
-	// check for shader compile errors
-	glGetShaderiv(lightFragmentShader, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(lightFragmentShader, 512, NULL, infoLog); 
-		std::cout << "3ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n"
-				  << infoLog << std::endl;
-	}
-
-	// 光源的link Shader
-	unsigned int lightShaderProgram = glCreateProgram();
-	glAttachShader(lightShaderProgram, lightVertexShader);
-	glAttachShader(lightShaderProgram, lightFragmentShader);
-	glLinkProgram(lightShaderProgram);
-	// check for linking errors
-	glGetProgramiv(lightShaderProgram, GL_LINK_STATUS, &success);
-	if (!success)
-	{
-		glGetProgramInfoLog(lightShaderProgram, 512, NULL, infoLog);
-		std::cout << "3ERROR::SHADER::PROGRAM::LINKING_FAILED\n"
-				  << infoLog << std::endl;
-	}
-	glDeleteShader(lightVertexShader);
-	glDeleteShader(lightFragmentShader);
+	LightCubeUniforms lightCubeUniforms;
+	lightCubeUniforms.model = lightShaderProgram.uniform("model");
 
 
 
@@ -385,71 +460,7 @@ int main()
 	// 	0.0f, 0.5f, 0.0f, 0.0f, 0.0f, 1.0f	  // top
 
 	// };
-	// 一个立方体
-	GLfloat vertices[] = {
-	// 后面
-	// -----位置-------   --纹理坐标-- ---手工指定的法向------
-    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,  0.0f,  0.0f, -1.0f,
-     0.5f, -0.5f, -0.5f,  1.0f, 0.0f,  0.0f,  0.0f, -1.0f,
-     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,  0.0f,  0.0f, -1.0f,
-     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,  0.0f,  0.0f, -1.0f,
-    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f, 0.0f,  0.0f, -1.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,  0.0f,  0.0f, -1.0f,
-
-	// 前面
-    -0.5f, -0.5f, 0.5f,  0.0f, 0.0f,  0.0f,  0.0f, 1.0f,
-     0.5f, -0.5f, 0.5f,  1.0f, 0.0f,  0.0f,  0.0f, 1.0f,
-     0.5f,  0.5f, 0.5f,  1.0f, 1.0f,  0.0f,  0.0f, 1.0f,
-     0.5f,  0.5f, 0.5f,  1.0f, 1.0f,  0.0f,  0.0f, 1.0f,
-    -0.5f,  0.5f, 0.5f,  0.0f, 1.0f,  0.0f,  0.0f, 1.0f,
-    -0.5f, -0.5f, 0.5f,  0.0f, 0.0f,  0.0f,  0.0f, 1.0f,
-
-	// 左面
-    -0.5f,  0.5f, 0.5f,  1.0f, 0.0f,   -1.0f,  0.0f,  0.0f,
-    -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,  -1.0f,  0.0f,  0.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,  -1.0f,  0.0f,  0.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,  -1.0f,  0.0f,  0.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,  -1.0f,  0.0f,  0.0f,
-    -0.5f,  0.5f, 0.5f,  1.0f, 0.0f,   -1.0f,  0.0f,  0.0f,
-
-	// 右面
-     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,  1.0f,  0.0f,  0.0f,
-     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,  1.0f,  0.0f,  0.0f,
-     0.5f, -0.5f, -0.5f,  0.0f, 1.0f,  1.0f,  0.0f,  0.0f,
-     0.5f, -0.5f, -0.5f,  0.0f, 1.0f,  1.0f,  0.0f,  0.0f,
-     0.5f, -0.5f,  0.5f,  0.0f, 0.0f,  1.0f,  0.0f,  0.0f,
-     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,  1.0f,  0.0f,  0.0f,
-
-	// 下面
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,  0.0f, -1.0f,  0.0f,
-     0.5f, -0.5f, -0.5f,  1.0f, 1.0f,  0.0f, -1.0f,  0.0f,
-     0.5f, -0.5f,  0.5f,  1.0f, 0.0f,  0.0f, -1.0f,  0.0f,
-     0.5f, -0.5f,  0.5f,  1.0f, 0.0f,  0.0f, -1.0f,  0.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,  0.0f, -1.0f,  0.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,  0.0f, -1.0f,  0.0f,
-
-	// 上面
-    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,  0.0f,  1.0f,  0.0f,
-     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,  0.0f,  1.0f,  0.0f,
-     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,  0.0f,  1.0f,  0.0f,
-     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,  0.0f,  1.0f,  0.0f,
-    -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,  0.0f,  1.0f,  0.0f,
-    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,  0.0f,  1.0f,  0.0f
-	};
-
-	glm::vec3 cubePositions[] = {
-		glm::vec3( 0.0f,  0.0f,  0.0f), 
-		glm::vec3( 2.0f,  5.0f, -15.0f), 
-		glm::vec3(-1.5f, -2.2f, -2.5f),  
-		glm::vec3(-3.8f, -2.0f, -12.3f),  
-		glm::vec3( 2.4f, -0.4f, -3.5f),  
-		glm::vec3(-1.7f,  3.0f, -7.5f),  
-		glm::vec3( 1.3f, -2.0f, -2.5f),  
-		glm::vec3( 1.5f,  2.0f, -2.5f), 
-		glm::vec3( 1.5f,  0.2f, -1.5f), 
-		glm::vec3(-1.3f,  1.0f, -1.5f)
-	};
-
+	// 正方体和地板的顶点数据在meshes.cpp里，CPU渲染器也使用同一份数据
 
 	unsigned int VBO, VAO;	// VAO作用：本身不存储顶点数据，顶点数据是存在VBO中的，其实对很多VBO的引用
 	// VAO相当于是对很多个VBO的引用，把一些VBO组合在一起作为一个对象统一管理。
@@ -476,7 +487,7 @@ int main()
 	// 第二个参数是传入的字节数量， 第三个参数是原数据内容数组的指针
 	// 第四个参数是缓冲区对象的使用方式，这是一个性能提示，帮助OpenGL在正确的位置去分配内存的。
 	// 当我们的数据几乎不会改变的时候，就对它进行GL_STATIC_DRAW的存储
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(CUBE_VERTICES), CUBE_VERTICES, GL_STATIC_DRAW);
 
 	// position attribute位置属性
 	// 链接顶点属性：第一个参数：0是顶点着色器的layout定义的location=0；第二个参数：3是顶点属性的大小，因为vector是3，所以大小是3
@@ -497,6 +508,35 @@ int main()
 	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void *)(5*sizeof(float)));
 	glEnableVertexAttribArray(2);
 
+	// ------------------------场景---------------------------------
+	// 物体、材质和光源从场景文件读取，读不到时使用内置场景；压力测试时程序生成场景
+	Scene scene;
+	if (options.generateCubes > 0)
+	{
+		scene = generateStressScene(options.generateCubes, options.generateLights, options.seed);
+	}
+	else if (!loadScene(options.scenePath, scene))
+	{
+		std::cout << "Using the built-in scene" << std::endl;
+		scene = defaultScene();
+	}
+	if (options.instances > 0)
+		resizeCubes(scene, options.instances);
+	lightPos = scene.lights[0].position;
+
+	// 正方体的model矩阵和法线矩阵放在实例缓冲里（location 3~9），按材质分组，每组一次glDrawArraysInstanced
+	SceneGpu sceneGpu;
+	sceneGpu.init(scene, VAO);
+	// --draw-order bsp：lit pass按BSP树从前到后提交
+	BspDrawList bspDraw;
+	if (options.bspOrder)
+		bspDraw.build(scene);
+
+	// 场景文件被修改后热重载，只更新改动的部分
+	FileWatcher sceneWatcher;
+	if (options.watchScene && options.generateCubes == 0)
+		sceneWatcher.watch(options.scenePath);
+
 	
 	// ------------------------构建光源VAO---------------------------------
 	unsigned int lightVAO;
@@ -510,46 +550,6 @@ int main()
 
 
 
-	// --------------------正方体纹理------------------------------------------
-	// 产生纹理对象(也是通过ID引用的！)
-	unsigned int texture;
-	glGenTextures(1, &texture);	//  参数一：需要生成纹理的数量；参数二：指定生成的纹理保存在哪里
-	// 绑定纹理对象
-	glBindTexture(GL_TEXTURE_2D, texture);	//让之后任何的纹理指令都可以配置当前绑定的纹理
-	
-	// 为当前绑定的纹理对象设置环绕、过滤方式
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);   
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);	// TODO:最后一个参数可能需要改成GL_LINEAR_MIPMAP_LINEAR以实现多级渐远纹理
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	// 纹理图片导入
-	int width, height, nrChannels;
-	unsigned char *data = stbi_load("merry_christmas_mr_Lawrence.jpg", &width, &height, &nrChannels, 0);
-	// stbi_set_flip_vertically_on_load(true);
-	// 生成纹理
-	if (data)
-	{// 如果load成功了texture
-		// 现在纹理已经绑定了，我们可以使用前面载入的图片数据生成一个纹理了。纹理可以通过glTexImage2D来生成：
-		// para1:指定纹理目标，设置为2D意味着会生成与当前绑定的文理对象在同一个目标上的纹理
-		// para2:为纹理指定多级渐远纹理的级别。可以单独手动设置多个级别。0为基本级别
-		// para3:告诉OpenGL我们希望把纹理处理为什么格式。
-		// para4、5:设置最终的纹理宽度和高度。由于之前加载图像的时候就保存了它们，故使用对应的变量
-		// para6:总是设为0；para7、8:定义了源图的格式和数据类型，我们使用RGB值加载这个图像，并把它们存储为char(byte)数组，我们将会传入对应的值
-		// 最后一个参数是真正的图像数据。
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);  
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		// 下面这个函数可以在生成纹理后调用，作用是为当前绑定的纹理自动生成所有需要的多级渐远纹理
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else
-	{
-		std::cout << "Failed to load texture" << std::endl;
-	}
-	// 生成了纹理和相应的多级渐远纹理后，释放图像的内存
-	stbi_image_free(data);
-
-
 	// -----------------------变换-----------------------------
 	// 1.模型变换矩阵
 	glm::mat4 model;
@@ -561,82 +561,39 @@ int main()
 	// view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
 
 	// 3.投影矩阵
-	glm::mat4 projection;
-	projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);// 第一个参数通常设置为45.0f，以达到真实效果；第二个参数为屏幕的宽高比；第三、四个参数表示近远平面的z距离。
+	glm::mat4 projection = cameraProjection(options.width, options.height);
 
 
 
 
 // -------------------------------------------地板----------------------------------------
-	GLfloat floorVertices[] = {
-        //---Positions-----     //---Normals-----   //-Texture Coords-
-         25.0f, -3.5f,  25.0f,	 0.0f, 1.0f, 0.0f,	25.0f, 0.0f,
-        -25.0f, -3.5f, -25.0f,	 0.0f, 1.0f, 0.0f, 	0.0f, 25.0f,
-        -25.0f, -3.5f, 25.0f,	 0.0f, 1.0f, 0.0f, 	0.0f, 0.0f,
-
-         25.0f, -3.5f,  25.0f,	 0.0f, 1.0f, 0.0f, 	25.0f, 0.0f,
-         25.0f, -3.5f, -25.0f,	 0.0f, 1.0f, 0.0f, 	25.0f, 25.0f,
-        -25.0f, -3.5f, -25.0f,	 0.0f, 1.0f, 0.0f, 	0.0f, 25.0f
-    };
     // 建立平面 VAO
     GLuint floorVAO, floorVBO;
     glGenVertexArrays(1, &floorVAO);
     glGenBuffers(1, &floorVBO);
     glBindVertexArray(floorVAO);
     glBindBuffer(GL_ARRAY_BUFFER, floorVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(floorVertices), &floorVertices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(FLOOR_VERTICES), FLOOR_VERTICES, GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
+    // 地板数据的排布是 位置、法线、纹理坐标，与着色器的location对应：1号是纹理坐标，2号是法线
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
     glBindVertexArray(0);
 
-	//-------------------------------产生地板纹理------------------------------
-	unsigned int texture_floor;
-	glGenTextures(1, &texture_floor);	//  参数一：需要生成纹理的数量；参数二：指定生成的纹理保存在哪里
-	// 绑定纹理对象
-	glBindTexture(GL_TEXTURE_2D, texture_floor);	//让之后任何的纹理指令都可以配置当前绑定的纹理
-
-	// float borderColor_1[] = { 1.0f, 1.0f, 0.0f, 1.0f };
-	// glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor_1);
-
-	
-	// 为当前绑定的纹理对象设置环绕、过滤方式
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);   
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);	// TODO:最后一个参数可能需要改成GL_LINEAR_MIPMAP_LINEAR以实现多级渐远纹理
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	// 纹理图片导入
-	int width_1, height_1, nrChannels_1;
-	// unsigned char *data_1 = stbi_load("merry_christmas_mr_Lawrence.jpg", &width_1, &height_1, &nrChannels_1, 0);
-	unsigned char *data_1 = stbi_load("floor.jpg", &width_1, &height_1, &nrChannels_1, 0);
-	// stbi_set_flip_vertically_on_load(true);
-	// 生成纹理
-	if (data_1)
-	{// 如果load成功了texture
-		// 现在纹理已经绑定了，我们可以使用前面载入的图片数据生成一个纹理了。纹理可以通过glTexImage2D来生成：
-		// para1:指定纹理目标，设置为2D意味着会生成与当前绑定的文理对象在同一个目标上的纹理
-		// para2:为纹理指定多级渐远纹理的级别。可以单独手动设置多个级别。0为基本级别
-		// para3:告诉OpenGL我们希望把纹理处理为什么格式。
-		// para4、5:设置最终的纹理宽度和高度。由于之前加载图像的时候就保存了它们，故使用对应的变量
-		// para6:总是设为0；para7、8:定义了源图的格式和数据类型，我们使用RGB值加载这个图像，并把它们存储为char(byte)数组，我们将会传入对应的值
-		// 最后一个参数是真正的图像数据。
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);  
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width_1, height_1, 0, GL_RGB, GL_UNSIGNED_BYTE, data_1);
-		// 下面这个函数可以在生成纹理后调用，作用是为当前绑定的纹理自动生成所有需要的多级渐远纹理
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else
-	{
-		std::cout << "Failed to load texture" << std::endl;
-	}
-	// 生成了纹理和相应的多级渐远纹理后，释放图像的内存
-	stbi_image_free(data_1);
 
+// ------------------------------------只写深度的VAO----------------------------------------------
+	// 深度pass（以及以后的深度预pass）只用得到位置，交错排布的顶点每个32字节只用其中12字节。
+	// 每个网格另存一份只有位置的紧凑缓冲，挂在自己的VAO上，深度pass的顶点拉取量少了60%
+	GLuint cubePositionVBO, floorPositionVBO;
+	GLuint cubeDepthVAO = createDepthVAO(CUBE_VERTICES, CUBE_VERTEX_COUNT, cubePositionVBO);
+	GLuint floorDepthVAO = createDepthVAO(FLOOR_VERTICES, FLOOR_VERTEX_COUNT, floorPositionVBO);
+	// 正方体还要实例化的model矩阵；每个正方体画级联数个实例，同一个正方体的各个级联取到同一个矩阵
+	sceneGpu.attachDepthVAO(cubeDepthVAO, options.cascades);
+	glBindVertexArray(0);
 
 
 // ------------------------------------深度映射FBO----------------------------------------------
@@ -644,46 +601,172 @@ int main()
 	GLuint depthMapFBO;
 	glGenFramebuffers(1, &depthMapFBO);
 	// 创建一个2D纹理，提供给帧缓冲的深度缓冲使用
-	const GLuint SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
-	GLuint depthMap;	// 2D纹理对象，深度映射
+	// 分辨率由--shadow-size指定，不能超过驱动支持的最大纹理尺寸
+	GLint maxTextureSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+	if (options.shadowSize > maxTextureSize)
+	{
+		std::cout << "Shadow size " << options.shadowSize << " exceeds GL_MAX_TEXTURE_SIZE, using " << maxTextureSize << std::endl;
+		options.shadowSize = maxTextureSize;
+	}
+	const GLuint SHADOW_WIDTH = options.shadowSize, SHADOW_HEIGHT = options.shadowSize;
+	// 级联阴影贴图：每个级联一层，--cascades 1时只有一层，就是原来的单张阴影贴图
+	const int CASCADES = options.cascades;
+	GLuint depthMap;	// 2D纹理数组对象，深度映射
 	glGenTextures(1, &depthMap);
-	glBindTexture(GL_TEXTURE_2D, depthMap);	// 绑定纹理对象
+	glBindTexture(GL_TEXTURE_2D_ARRAY, depthMap);	// 绑定纹理对象
 
 	// ***核心：因为只关心深度值，所以纹理格式要设定为GL_DEPTH_COMPONENT
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, // 1.目标为2D贴图；2.纹理格式要设定为GL_DEPTH_COMPONENT；3&4.阴影纹理图像本身的宽高：表示深度贴图的分辨率
-	// 5.纹理格式要设定为GL_DEPTH_COMPONENT， 6.数据类型为float
-				SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);	// 近邻过滤
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	// 将上面生成的深度纹理 作为 帧缓冲的深度缓冲
+	// overdraw诊断模式要在深度pass里用模板计数，改用带模板的GL_DEPTH24_STENCIL8，采样时仍然只取到深度
+	bool overdrawMode = !options.overdrawDir.empty();
+	if (overdrawMode)
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH24_STENCIL8, SHADOW_WIDTH, SHADOW_HEIGHT, CASCADES, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+	else
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT, // 1.目标为2D贴图数组；2.纹理格式要设定为GL_DEPTH_COMPONENT；3&4.阴影纹理图像本身的宽高：表示深度贴图的分辨率；5.层数
+		// 6.纹理格式要设定为GL_DEPTH_COMPONENT， 7.数据类型为float
+					SHADOW_WIDTH, SHADOW_HEIGHT, CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	// 深度比较模式：采样器拿参考深度与贴图里的深度比较，返回照亮的比例（sampler2DArrayShadow）。
+	// 线性过滤时硬件比较相邻的2x2个texel再双线性混合，一次取样就是一次2x2的PCF；hard过滤保持原来的近邻采样
+	GLint shadowFilterMode = options.shadowFilter == SHADOW_FILTER_HARD ? GL_NEAREST : GL_LINEAR;
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, shadowFilterMode);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, shadowFilterMode);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT); 
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	// 将上面生成的深度纹理 作为 帧缓冲的深度缓冲；不指定层时整个数组是一个分层附件，清除会清掉所有层
 	glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);	// 绑定帧缓冲对象到指定位置
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);	
+	glFramebufferTexture(GL_FRAMEBUFFER, overdrawMode ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, depthMap, 0);	
 	glDrawBuffer(GL_NONE);	// 读缓冲：显式地告诉OpenGL不去渲染颜色数据
 	glReadBuffer(GL_NONE);	// 绘制缓冲：不去绘制颜色
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 
+// ------------------------------------场景帧缓冲----------------------------------------------
+	// 有窗口时直接画到默认帧缓冲0；无窗口时没有默认帧缓冲，画到离屏FBO再读回
+	OffscreenTarget offscreen;
+	GLuint sceneFBO = 0;
+	if (options.headless)
+	{
+		if (!createOffscreenTarget(offscreen, options.width, options.height))
+		{
+			destroyHeadlessContext();
+			return -1;
+		}
+		sceneFBO = offscreen.fbo;
+		if (options.writeFrames)
+			std::filesystem::create_directories(options.outputDir);
+	}
+
+
+
 
+// ------------------------------------逐pass计时----------------------------------------------
+	// 基准测试需要保存每一帧的计时用于统计
+	bool benchmark = !options.benchmarkPath.empty();
+	FrameProfiler profiler;
+	if (!options.tracePath.empty() || benchmark)
+		profiler.init({"shadow depth pass", "lit pass", "light cube pass"}, options.tracePath, benchmark);
 
+	// overdraw诊断：三个pass各自的深度复杂度，下标与RenderPass相同
+	OverdrawCounter overdraw;
+	if (overdrawMode && !overdraw.open(options.overdrawDir, {"shadow depth pass", "lit pass", "light cube pass"}))
+		return -1;
+
+	// 录制好的相机路径，没有时相机绕场景中心旋转
+	CameraPath cameraPath;
+	if (!options.cameraPath.empty() && !cameraPath.load(options.cameraPath))
+		return -1;
 
 
+// ------------------------------------每帧uniform缓冲----------------------------------------------
+	unsigned int frameUBO;
+	glGenBuffers(1, &frameUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+
+
+// ------------------------------------阴影缓存----------------------------------------------
+	ShadowCache shadowCache;
+	shadowCache.setEnabled(options.shadowCache);
+	// 投射阴影的几何体（正方体实例、地板）每次改动都要递增这个版本号，让缓存的深度贴图失效
+	unsigned int shadowCasterVersion = 0;
+	glm::mat4 cascadeMatrices[MAX_CASCADES];
+	glm::vec3 lightSpaceLightPos;
+	unsigned int lightSpaceCasterVersion = 0;
+	bool lightSpaceValid = false;
+	// 光源视角的正交范围按投射者的包围盒拟合（--light-fit），投射者改动时重新计算
+	Bounds casters = casterBounds(scene);
+	// 各级联在相机视线方向上的远端距离，只取决于参数，算一次
+	float cascadeSplits[MAX_CASCADES];
+	cascadeSplitDistances(CASCADES, options.cascadeSplit, options.cascadeLambda, options.shadowDistance, cascadeSplits);
+	float shadowTexelSize[MAX_CASCADES] = {};
+	double shadowTexelSum[MAX_CASCADES] = {};	// 测量帧的texel大小之和
+
+	// 投射者裁剪（--no-caster-culling关闭）：正方体（按实例顺序）和地板（按objectDraws顺序）的世界空间包围盒，投射者改动时重新计算
+	CasterCuller casterCuller;
+	std::vector<Bounds> cubeBounds, floorBounds;
+	unsigned int boundsVersion = 0;
+	bool boundsValid = false;
+	std::vector<GLsizei> shadowCubes;	// 本帧深度pass要画的正方体（实例下标）
+	std::vector<size_t> shadowFloors;	// 本帧深度pass要画的地板（objectDraws下标）
+	// 投射者缓冲里现在是哪个集合
+	unsigned long long uploadedCasterSet = 0;
+	unsigned int uploadedCasterVersion = 0;
+	bool casterInstancesValid = false;
+	double castersDrawnSum = 0.0, castersCulledSum = 0.0;	// 测量帧之和
 
 
 // -----------------------------------------------------渲染循环--------------------------------------------------------
 	// -----------
-	while (!glfwWindowShouldClose(window))
+	// 无窗口和基准测试模式按固定的60帧/秒推进时间，保证每次运行渲染出相同的画面，
+	// 并且只跑固定的帧数：基准测试先跑warmupFrames个预热帧（时间线上位于0时刻之前），再跑frames个测量帧
+	const double TIMELINE_FPS = 60.0;
+	bool fixedTimeline = options.headless || benchmark;
+	int warmupFrames = benchmark ? options.warmupFrames : 0;
+	int frame = 0;
+	auto renderStart = std::chrono::steady_clock::now();
+	while (fixedTimeline ? frame < warmupFrames + options.frames : !glfwWindowShouldClose(window))
 	{
-
+		int timelineFrame = frame - warmupFrames;
+		double currentTime = fixedTimeline ? timelineFrame / TIMELINE_FPS : glfwGetTime();
 
 		// input
 		// -----
-		processInput(window);
+		if (window)
+			processInput(window);
+
+		// 场景文件改动：解析新场景，与当前场景比较后只上传变化的实例、重新加载变化的纹理
+		if (sceneWatcher.poll())
+		{
+			Scene reloaded;
+			if (loadScene(options.scenePath, reloaded))
+			{
+				if (options.instances > 0)
+					resizeCubes(reloaded, options.instances);
+				SceneDiff diff = diffScenes(scene, reloaded);
+				SceneGpu::UpdateStats stats = sceneGpu.apply(scene, reloaded, diff);
+				if (diff.layoutChanged || !diff.movedObjects.empty())
+				{
+					shadowCasterVersion++;
+					casters = casterBounds(reloaded);
+					if (options.bspOrder)
+						bspDraw.build(reloaded);
+				}
+				scene = std::move(reloaded);
+				lightPos = scene.lights[0].position;
+				std::cout << "Reloaded " << options.scenePath << ": "
+						  << (stats.rebuilt ? "instances rebuilt" : std::to_string(stats.updatedInstances) + " instances updated")
+						  << ", " << stats.reloadedTextures << " textures loaded"
+						  << (diff.lightsChanged ? ", lights changed" : "") << std::endl;
+			}
+		}
+		profiler.beginFrame();
 
 		// render
 		// ------
+		glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
 		// 首先改变背景的颜色，清除掉这三个颜色
 		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 		// 清除颜色、深度信息
@@ -691,196 +774,429 @@ int main()
 
 
 		
+		// ------------------------相机----------------------------
+		// view矩阵/相机绕场景中心旋转 + viewPosition（片段着色器）
+		glm::mat4 view = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
+		glm::vec3 viewPosition, viewTarget;
+		cameraPose(currentTime, cameraPath, viewPosition, viewTarget);
+		// lookAt函数的参数：1.视角世界位置；2.视角目标位置；3.世界坐标系的上方向
+		view = glm::lookAt(viewPosition, viewTarget, glm::vec3(0.0f, 1.0f, 0.0f));
+
+
 		// ------------------------首先绘制深度纹理贴图----------------------------
 
 
 
-		// 计算世界空间->光源视角的裁剪空间的变换矩阵：先view再proj
-		// 1.首先，使用正向投影，所以正交投影矩阵
-		GLfloat near_floor = 1.0f, far_floor = 17.0f;
-			// 光源的投影矩阵
-		glm::mat4 lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, near_floor, far_floor);
-		// glm::mat4 lightProjection = glm::perspective(glm::radians(90.0f), (float)SHADOW_WIDTH / (float)SHADOW_HEIGHT, 1.0f, 25.0f);
-			// 利用lookAt函数生成view矩阵
-		glm::mat4 lightView = glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-			// 从世界坐标转换到光源向外投影裁剪的复合变换矩阵
-		glm::mat4 lightSpaceMatrix = lightProjection * lightView;
-
-
-		// 注意：下面的内容与光源立方体本身的渲染无关
-
-		// 首先，启用光源-深度着色器，以光源作为“相机”得到的裁剪空间对物体进行渲染
-		// 目标是得到阴影贴图
-		glUseProgram(depthShaderProgram);
-		// 第一步，启用对场景的第一个着色程序即 深度着色器
-		GLint lightSpaceMatrixLocation = glGetUniformLocation(depthShaderProgram, "lightSpaceMatrix");
-		// 第二步，将前面已经计算得到的光源变换矩阵，传入深度着色器
-		glUniformMatrix4fv(lightSpaceMatrixLocation, 1, GL_FALSE,  glm::value_ptr(lightSpaceMatrix));
-		// 第三步，设置屏幕控制空间显示的大小（裁剪空间）
-		// 因为阴影贴图经常和我们原来渲染的场景（通常是窗口分辨率）有着不同的分辨率，我们需要改变视口（viewport）的参数以适应阴影贴图的尺寸。
-		glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-		// 第四步，绑定深度缓冲对象到指定位置
-		glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-		// 第五步，清除之前的深度信息
-		glClear(GL_DEPTH_BUFFER_BIT);
-		// something
-
-		// 第六步，渲染立方体+地板
-		glBindVertexArray(VAO); 
-		// 渲染10个正方体
-		for(unsigned int i = 0; i < 10; i++)
+		// 计算世界空间->光源视角的裁剪空间的变换矩阵：先view再proj，每个级联拟合相机视锥体的一段
+		// 拟合到相机视锥体时每帧都要算，其他情况只有光源移动了或投射者变了才需要重新计算
+		if (options.lightFit == LIGHT_FIT_CAMERA || !lightSpaceValid || lightSpaceLightPos != lightPos ||
+			lightSpaceCasterVersion != shadowCasterVersion)
 		{
-			// 各个正方体先创建model矩阵
-			glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);	// 平移
-			float angle = 20.0f * i;
-			model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));	// 旋转
-			int modelLoc = glGetUniformLocation(shaderProgram, "model");
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-			// 画一个正方体
-			glDrawArrays(GL_TRIANGLES, 0, 36);
+			for (int cascade = 0; cascade < CASCADES; cascade++)
+				cascadeMatrices[cascade] = fittedLightSpaceMatrix(lightPos, options.lightFit, casters, view, (float)options.width / options.height,
+																  cascade == 0 ? CAMERA_NEAR : cascadeSplits[cascade - 1], cascadeSplits[cascade],
+																  SHADOW_WIDTH, shadowTexelSize[cascade]);
+			lightSpaceLightPos = lightPos;
+			lightSpaceCasterVersion = shadowCasterVersion;
+			lightSpaceValid = true;
 		}
-		// 画地板
-		model = glm::mat4(1.0f);	// 画地板的时候也要注意，这个地方需要把模型变换矩阵给保持不变
-		// view和projection都需要保持不变，因为这是在camera的视角下的！
-		int modelLoc_floor = glGetUniformLocation(shaderProgram, "model");
-		glUniformMatrix4fv(modelLoc_floor, 1, GL_FALSE, glm::value_ptr(model));
-		glBindVertexArray(floorVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
+		for (int cascade = 0; timelineFrame >= 0 && cascade < CASCADES; cascade++)
+			shadowTexelSum[cascade] += shadowTexelSize[cascade];
 
-		// 第七步，清空Framebuffer
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+		// ------------------------阴影投射者裁剪----------------------------
+		// 每个物体的包围盒对光源视锥体（拟合到相机时再加上朝光源拉伸的相机视锥体）测试，留下的才提交给深度pass。
+		// 留下的集合记成一个哈希（FNV-1a），集合变了阴影缓存也要失效
+		if (!boundsValid || boundsVersion != shadowCasterVersion)
+		{
+			cubeBounds.clear();
+			for (const glm::mat4 &cubeModel : sceneGpu.models())
+				cubeBounds.push_back(transformedBounds(meshBounds(MESH_CUBE), cubeModel));
+			floorBounds.clear();
+			for (const SceneGpu::ObjectDraw &draw : sceneGpu.objectDraws())
+				floorBounds.push_back(transformedBounds(meshBounds(MESH_FLOOR), draw.model));
+			boundsVersion = shadowCasterVersion;
+			boundsValid = true;
+		}
+		if (options.casterCulling)
+			casterCuller.setup(lightPos, cascadeMatrices, CASCADES, options.lightFit == LIGHT_FIT_CAMERA ? &view : NULL,
+							   (float)options.width / options.height);
+		unsigned long long casterSet = 14695981039346656037ull;
+		shadowCubes.clear();
+		for (GLsizei i = 0; i < sceneGpu.cubeCount(); i++)
+		{
+			if (options.casterCulling && !casterCuller.mayCastShadow(cubeBounds[i]))
+				continue;
+			shadowCubes.push_back(i);
+			casterSet = (casterSet ^ (unsigned long long)i) * 1099511628211ull;
+		}
+		shadowFloors.clear();
+		for (size_t i = 0; i < floorBounds.size(); i++)
+		{
+			if (options.casterCulling && !casterCuller.mayCastShadow(floorBounds[i]))
+				continue;
+			shadowFloors.push_back(i);
+			casterSet = (casterSet ^ (0x100000000ull + i)) * 1099511628211ull;
+		}
+		double castersDrawn = (double)(shadowCubes.size() + shadowFloors.size());
+		double castersCulled = (double)(cubeBounds.size() + floorBounds.size()) - castersDrawn;
+		profiler.counter("shadow casters", {{"drawn", castersDrawn}, {"culled", castersCulled}});
+		if (timelineFrame >= 0)
+		{
+			castersDrawnSum += castersDrawn;
+			castersCulledSum += castersCulled;
+		}
 
 
+		// ------------------------每帧uniform块----------------------------
+		// 相机、各级联的光源空间矩阵和所有光源一次写进uniform缓冲，三个着色器程序都从同一个绑定点读取
+		FrameData frameData;
+		frameData.projection = projection;
+		frameData.view = view;
+		for (int cascade = 0; cascade < CASCADES; cascade++)
+		{
+			frameData.cascadeMatrices[cascade] = cascadeMatrices[cascade];
+			frameData.cascadeSplits[cascade] = cascadeSplits[cascade];
+			frameData.cascadeDepthPerTexel[cascade] = shadowDepthPerTexel(cascadeMatrices[cascade], SHADOW_WIDTH);
+		}
+		frameData.cascadeCount = CASCADES;
+		frameData.shadowDirection = glm::vec4(shadowDirection(cascadeMatrices[0]), 0.0f);
+		frameData.viewPosition = glm::vec4(viewPosition, 1.0f);
+		frameData.lightCount = std::min((int)scene.lights.size(), MAX_LIGHTS);
+		for (int i = 0; i < frameData.lightCount; i++)
+		{
+			frameData.lightPositions[i] = glm::vec4(scene.lights[i].position, 1.0f);
+			frameData.lightColors[i] = glm::vec4(scene.lights[i].color, 1.0f);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &frameData);
+		glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, frameUBO);
+
+
+		// 光源、投射阴影的物体和分辨率都没变时，depthMap里上一帧的结果仍然有效，跳过整个深度pass
+		if (shadowCache.needsUpdate(cascadeMatrices, CASCADES, shadowCasterVersion, casterSet, SHADOW_WIDTH, SHADOW_HEIGHT))
+		{
+			ProfileScope shadowScope(profiler, PASS_SHADOW);
+			// 注意：下面的内容与光源立方体本身的渲染无关
+
+			// 首先，启用光源-深度着色器，以光源作为“相机”得到的裁剪空间对物体进行渲染
+			// 目标是得到阴影贴图
+			depthShaderProgram.use();
+			// 第一步，启用对场景的第一个着色程序即 深度着色器
+			// 第二步，光源变换矩阵已经在每帧uniform块里了
+			// 第三步，设置屏幕控制空间显示的大小（裁剪空间）
+			// 因为阴影贴图经常和我们原来渲染的场景（通常是窗口分辨率）有着不同的分辨率，我们需要改变视口（viewport）的参数以适应阴影贴图的尺寸。
+			glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+			// 第四步，绑定深度缓冲对象到指定位置
+			glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+			// 第五步，清除之前的深度信息
+			glClear(GL_DEPTH_BUFFER_BIT);
+			if (overdrawMode)
+				overdraw.beginPass();
+
+			// 第六步，渲染立方体+地板。每个物体画CASCADES个实例，每个实例进一个级联；用只有位置的深度VAO
+			glBindVertexArray(cubeDepthVAO); 
+			if (options.instancing)
+			{
+				// 深度pass不区分材质，一次绘制调用画出所有留下的正方体的所有级联
+				glUniform1i(depthUniforms.instanced, 1);
+				// 有正方体被剔除时，留下的那些的model矩阵另外写进投射者缓冲，集合或投射者变了才重写
+				if (shadowCubes.size() < (size_t)sceneGpu.cubeCount())
+				{
+					if (!casterInstancesValid || uploadedCasterSet != casterSet || uploadedCasterVersion != shadowCasterVersion)
+					{
+						sceneGpu.uploadCasterInstances(shadowCubes);
+						uploadedCasterSet = casterSet;
+						uploadedCasterVersion = shadowCasterVersion;
+						casterInstancesValid = true;
+					}
+					sceneGpu.bindCasterInstances();
+				}
+				else
+					sceneGpu.bindInstanceRange(0);
+				glDrawArraysInstanced(GL_TRIANGLES, 0, 36, (GLsizei)shadowCubes.size() * CASCADES);
+			}
+			else
+			{
+				// 逐个正方体上传model矩阵再绘制
+				glUniform1i(depthUniforms.instanced, 0);
+				for (GLsizei i : shadowCubes)
+				{
+					glUniformMatrix4fv(depthUniforms.model, 1, GL_FALSE, glm::value_ptr(sceneGpu.models()[i]));
+					// 画一个正方体
+					glDrawArraysInstanced(GL_TRIANGLES, 0, 36, CASCADES);
+				}
+			}
+			// 画地板
+			glUniform1i(depthUniforms.instanced, 0);
+			glBindVertexArray(floorDepthVAO);
+			for (size_t i : shadowFloors)
+			{
+				glUniformMatrix4fv(depthUniforms.model, 1, GL_FALSE, glm::value_ptr(sceneGpu.objectDraws()[i].model));
+				glDrawArraysInstanced(GL_TRIANGLES, 0, 6, CASCADES);
+			}
+
+			if (overdrawMode)
+				overdraw.endLayeredPass(PASS_SHADOW, timelineFrame, depthMap, SHADOW_WIDTH, CASCADES);
+			// 第七步，切回场景的帧缓冲
+			glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+		}
 
-		// 重设窗口
-        glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// 其次，启用物体本身的着色器，使用产生的深度贴图进行渲染
-		// 第一步，启用原本物体使用的着色器
-		glUseProgram(shaderProgram);
 
 
-		// 片段着色器objectColor颜色随时间变化：
-		GLfloat timeValue = glfwGetTime();
-		GLfloat greenValue = (sin(timeValue) / 2) + 0.5;
-		GLfloat redValue = (cos(timeValue) / 2) + 0.5;
-		GLfloat blueValue = (tan(timeValue));
+		{
+			ProfileScope litScope(profiler, PASS_LIT);
+			// 重设窗口
+			glViewport(0, 0, options.width, options.height);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			if (overdrawMode)
+				overdraw.beginPass();
+
+			// 其次，启用物体本身的着色器，使用产生的深度贴图进行渲染
+			// 第一步，启用原本物体使用的着色器
+			shaderProgram.use();
+
+
+			// 片段着色器objectColor颜色随时间变化：
+			GLfloat timeValue = currentTime;
+			GLfloat greenValue = (sin(timeValue) / 2) + 0.5;
+			GLfloat redValue = (cos(timeValue) / 2) + 0.5;
+			GLfloat blueValue = (tan(timeValue));
 		
-		// 第二步，设置相机投影矩阵（见下方已写代码）、view矩阵为相机的矩阵
-		// 第三步，给顶点着色器传入projection view
-			// 1.projection矩阵
-		int projectionLoc = glGetUniformLocation(shaderProgram, "projection"); 
-		glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
-			// 2.view矩阵/相机根据输入交互进行调整位置 + viewPosition（片段着色器）
-		glm::mat4 view = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-        float radius = 8.0f;
-        float camX = static_cast<float>(sin(glfwGetTime()) * radius);
-        float camZ = static_cast<float>(cos(glfwGetTime()) * radius);
-		// float camX = static_cast<float>(10.0f);
-		// float camZ = static_cast<float>(1.0f);
-		glm::vec3 viewPosition = glm::vec3(camX, 0.0f, camZ);
-		// lookAt函数的参数：1.视角世界位置；2.视角目标位置；3.世界坐标系的上方向
-        view = glm::lookAt(viewPosition, glm::vec3(0.0f, 0.5f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		int viewLoc = glGetUniformLocation(shaderProgram, "view");
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// 第四步，给片段着色器传入viewPos lightPos 
-
-		int viewPositionLoc = glGetUniformLocation(shaderProgram, "viewPosition");
-		glUniform3fv(viewPositionLoc, 1, glm::value_ptr(viewPosition));
-			// 3.灯光的颜色（片段着色器）
-		GLint lightColorLocation = glGetUniformLocation(shaderProgram, "lightColor");
-		glUniform3f(lightColorLocation, 1.0f, 1.0f, 1.0f);	// 白色光源
-			// 4.给所有正方体和地板传入光源的位置
-		int lightPositionLoc = glGetUniformLocation(shaderProgram, "lightPosition");
-		glUniform3fv(lightPositionLoc, 1, glm::value_ptr(lightPos));
-
-		// 第五步，给顶点着色器传入lightSpaceMatrix
-		GLint lightSpaceMatrixLocation_ = glGetUniformLocation(shaderProgram, "lightSpaceMatrix");
-		glUniformMatrix4fv(lightSpaceMatrixLocation_, 1, GL_FALSE,  glm::value_ptr(lightSpaceMatrix));
-		// 第六步，激活、绑定绘制纹理的模块
-		// 第七步，渲染物体
-
-		// ----------渲染正方体-----------
-		// 正方体的颜色objectColor
-		GLint vertexColorLoaction = glGetUniformLocation(shaderProgram, "objectColor");//获取着色器中uniform变量ourColor的位置
-		// glUniform3f(vertexColorLoaction, redValue, greenValue, blueValue);//设置这个objectColor uniform的值为变化色
-		glUniform3f(vertexColorLoaction, 1.0f, 1.0f, 1.0f);
-
-		// 绑定纹理，自动把纹理赋给片段着色器的采样器
-		glActiveTexture(GL_TEXTURE0); // 在绑定纹理之前先激活纹理单元
-		glBindTexture(GL_TEXTURE_2D, texture);
-		glActiveTexture(GL_TEXTURE1); // 在绑定纹理之前先激活纹理单元
-		glBindTexture(GL_TEXTURE_2D, depthMap);
-		// 渲染三角形，渲染之前，要再次绑定这个节点数组
-		glBindVertexArray(VAO); 
-		// 渲染10个正方体
-		for(unsigned int i = 0; i < 10; i++)
+			// 第二~五步：projection、view、viewPosition、光源和lightSpaceMatrix都在每帧uniform块里，不用再逐个传入
+			// 第六步，激活、绑定绘制纹理的模块
+			// 第七步，渲染物体
+
+			// ----------渲染正方体-----------
+			// 阴影贴图固定在1号纹理单元
+			glActiveTexture(GL_TEXTURE1); // 在绑定纹理之前先激活纹理单元
+			glBindTexture(GL_TEXTURE_2D_ARRAY, depthMap);
+			glActiveTexture(GL_TEXTURE0);
+			if (options.bspOrder)
+			{
+				// 所有片都已在世界空间：model和法线矩阵取单位矩阵，逐材质按BSP从前到后的顺序画
+				glUniform1i(sceneUniforms.instanced, 0);
+				glUniformMatrix4fv(sceneUniforms.model, 1, GL_FALSE, glm::value_ptr(glm::mat4(1.0f)));
+				glUniformMatrix3fv(sceneUniforms.normalMatrix, 1, GL_FALSE, glm::value_ptr(glm::mat3(1.0f)));
+				bspDraw.draw(viewPosition, sceneGpu);
+			}
+			else
+			{
+				// 渲染三角形，渲染之前，要再次绑定这个节点数组
+				glBindVertexArray(VAO); 
+				// 每个材质一组：绑定该材质的纹理和颜色，再画出组内的全部正方体
+				for (const SceneGpu::CubeGroup &group : sceneGpu.groups())
+				{
+					sceneGpu.bindMaterial(group.material);
+					glBindTexture(GL_TEXTURE_2D, sceneGpu.texture(group.material));
+					if (options.instancing)
+					{
+						glUniform1i(sceneUniforms.instanced, 1);
+						sceneGpu.bindInstanceRange(group.first);
+						glDrawArraysInstanced(GL_TRIANGLES, 0, 36, group.count);
+						glUniform1i(sceneUniforms.instanced, 0);
+					}
+					else
+					{
+						for(GLsizei i = group.first; i < group.first + group.count; i++)
+						{
+							glUniformMatrix4fv(sceneUniforms.model, 1, GL_FALSE, glm::value_ptr(sceneGpu.models()[i]));
+							glUniformMatrix3fv(sceneUniforms.normalMatrix, 1, GL_FALSE, glm::value_ptr(sceneGpu.normals()[i]));
+							// 画一个正方体
+							glDrawArrays(GL_TRIANGLES, 0, 36);
+						}
+					}
+				}
+				// -------渲染地板-------
+				// 画地板，直接使用画正常正方体的shader
+				glBindVertexArray(floorVAO);
+				for (const SceneGpu::ObjectDraw &draw : sceneGpu.objectDraws())
+				{
+					sceneGpu.bindMaterial(draw.material);
+					glBindTexture(GL_TEXTURE_2D, sceneGpu.texture(draw.material));
+					glUniformMatrix4fv(sceneUniforms.model, 1, GL_FALSE, glm::value_ptr(draw.model));
+					glUniformMatrix3fv(sceneUniforms.normalMatrix, 1, GL_FALSE, glm::value_ptr(draw.normal));
+					glDrawArrays(GL_TRIANGLES, 0, 6);
+				}
+			}
+			if (overdrawMode)
+				overdraw.endPass(PASS_LIT, timelineFrame, options.width, options.height);
+		}
+
+
+		{
+			ProfileScope lightCubeScope(profiler, PASS_LIGHT_CUBE);
+			// --------------------------画光源--------------------------------------------------
+			// 激活光源的着色器程序
+			lightShaderProgram.use();
+			if (overdrawMode)
+				overdraw.beginPass();
+			// camera的projection、view矩阵在每帧uniform块里
+			// 绑定并绘制点，每个光源一个小立方体
+			glBindVertexArray(lightVAO);
+			for (const SceneLight &light : scene.lights)
+			{
+				// 重新变换光源位置，传入model矩阵到顶点着色器
+				glm::mat4 model = glm::mat4(1.0f);
+				model = glm::translate(model, light.position);	// 移到光源在世界坐标系中的位置
+				model = glm::scale(model, glm::vec3(0.2f)); // 缩小这个光源，使得更真实
+				glUniformMatrix4fv(lightCubeUniforms.model, 1, GL_FALSE, glm::value_ptr(model));
+				glDrawArrays(GL_TRIANGLES, 0, 36);
+			}
+			if (overdrawMode)
+				overdraw.endPass(PASS_LIGHT_CUBE, timelineFrame, options.width, options.height);
+		}
+
+
+		if (window)
+		{
+			// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+			// -------------------------------------------------------------------------------
+			glfwSwapBuffers(window); 
+			glfwPollEvents();
+		}
+		else if (options.writeFrames && timelineFrame >= 0)
 		{
-			// 各个正方体先创建model矩阵
-			glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);	// 平移
-			float angle = 20.0f * i;
-			model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));	// 旋转
-			int modelLoc = glGetUniformLocation(shaderProgram, "model");
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-			// 画一个正方体
-			glDrawArrays(GL_TRIANGLES, 0, 36);
+			// 无窗口：把这一帧读回并写出（预热帧不写）
+			char framePath[64];
+			snprintf(framePath, sizeof(framePath), "/frame_%04d.ppm", timelineFrame);
+			writeFramePPM(offscreen, (options.outputDir + framePath).c_str());
 		}
-		// -------渲染地板-------
-		// 画地板，直接使用画正常正方体的shader
-		vertexColorLoaction = glGetUniformLocation(shaderProgram, "objectColor");//获取着色器中uniform变量ourColor的位置
-		// glUniform3f(vertexColorLoaction, redValue, greenValue, blueValue);//设置这个objectColor uniform的值为变化色
-		// 地板自己的光亮度
-		glUniform3f(vertexColorLoaction, 1.0f, 1.0f, 1.0f);	//	
-		// 绑定地板纹理
-		glActiveTexture(GL_TEXTURE0); // 在绑定纹理之前先激活纹理单元
-		glBindTexture(GL_TEXTURE_2D, texture_floor);
-		glActiveTexture(GL_TEXTURE1); // 在绑定纹理之前先激活纹理单元
-		glBindTexture(GL_TEXTURE_2D, depthMap);
-		model = glm::mat4(1.0f);	// 画地板的时候也要注意，这个地方需要把模型变换矩阵给保持不变
-		// view和projection都需要保持不变，因为这是在camera的视角下的！
-		int modelLoc_floor_ = glGetUniformLocation(shaderProgram, "model");
-		glUniformMatrix4fv(modelLoc_floor_, 1, GL_FALSE, glm::value_ptr(model));
-		glBindVertexArray(floorVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-
-
-		// --------------------------画光源--------------------------------------------------
-		// 激活光源的着色器程序
-		glUseProgram(lightShaderProgram);
-		// 传入camera的projection矩阵到顶点着色器
-		int projectionLoc_ = glGetUniformLocation(lightShaderProgram, "projection"); 
-		glUniformMatrix4fv(projectionLoc_, 1, GL_FALSE, glm::value_ptr(projection));
-		// 传入camera的view矩阵到顶点着色器
-		int viewLoc_ = glGetUniformLocation(lightShaderProgram, "view");
-		glUniformMatrix4fv(viewLoc_, 1, GL_FALSE, glm::value_ptr(view));
-		// 重新变换光源位置，传入model矩阵到顶点着色器
-		glm::mat4 model = glm::mat4(1.0f);
-		model = glm::translate(model, lightPos);	// 移到预先定义好的光源在世界坐标系中的位置
-        model = glm::scale(model, glm::vec3(0.2f)); // 缩小这个光源，使得更真实
-		int modelLoc_ = glGetUniformLocation(lightShaderProgram, "model");
-		glUniformMatrix4fv(modelLoc_, 1, GL_FALSE, glm::value_ptr(model));
-		// 绑定并绘制点
-		glBindVertexArray(lightVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-
-		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-		// -------------------------------------------------------------------------------
-		glfwSwapBuffers(window); 
-		glfwPollEvents();
+		// 基准测试时等这一帧真正画完再结束计时，帧时间才不受驱动里排队帧数的影响
+		if (benchmark)
+			glFinish();
+		profiler.endFrame();
+		frame++;
+	}
+
+	if (options.headless)
+	{
+		// 等GPU（或llvmpipe）真正画完再停表
+		glFinish();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+		std::cout << "Rendered " << frame << " frames in " << seconds << " s ("
+				  << seconds * 1000.0 / frame << " ms/frame)" << std::endl;
+	}
+	std::cout << "Shadow passes: " << shadowCache.executedPasses() << " executed, "
+			  << shadowCache.skippedPasses() << " skipped" << std::endl;
+	int measuredFrames = std::max(frame - warmupFrames, 1);
+	std::cout << "Shadow casters per frame: " << castersDrawnSum / measuredFrames << " drawn, "
+			  << castersCulledSum / measuredFrames << " culled" << std::endl;
+	
+	// 场景里每个像素平均跑了几次片段着色器（lit pass和光源立方体pass），减去1就是深度预pass或从前到后排序最多能省下的
+	double shadedFragmentsPerPixel = 0.0;
+	if (overdrawMode)
+	{
+		const OverdrawCounter::PassStats &lit = overdraw.stats(PASS_LIT), &lightCube = overdraw.stats(PASS_LIGHT_CUBE);
+		shadedFragmentsPerPixel = lit.perPixel() + lightCube.perPixel();
+		std::cout << "Overdraw: " << shadedFragmentsPerPixel << " shaded fragments per pixel";
+		for (int pass = 0; pass < PASS_COUNT; pass++)
+			std::cout << ", " << overdraw.passName(pass) << " " << overdraw.stats(pass).perCoveredPixel() << " per covered pixel";
+		std::cout << " -> " << options.overdrawDir << std::endl;
+	}
+
+	// 与参考帧（例如CPU z-buffer渲染的同一时间线）逐张比较
+	ImageAgreement agreement;
+	bool compared = !options.referenceDir.empty() && compareFrames(options.outputDir, options.referenceDir, options.frames, agreement);
+	if (compared)
+		std::cout << "Agreement with " << options.referenceDir << ": min PSNR " << agreement.minPsnr << " dB, mean abs error "
+				  << agreement.meanAbsError << ", at most " << agreement.maxMismatchPercent << "% pixels off" << std::endl;
+
+	profiler.shutdown();
+	if (benchmark)
+	{
+		BenchmarkInfo info;
+		info.scenePath = options.scenePath;
+		info.cameraPath = options.cameraPath;
+		info.renderer = (const char *)glGetString(GL_RENDERER);
+		info.cubes = sceneGpu.cubeCount();
+		info.lights = (int)scene.lights.size();
+		info.shadowSize = SHADOW_WIDTH;
+		info.width = options.width;
+		info.height = options.height;
+		info.warmupFrames = warmupFrames;
+		info.measuredFrames = frame - warmupFrames;
+		info.timelineFps = TIMELINE_FPS;
+		info.instancing = options.instancing;
+		info.shadowCache = options.shadowCache;
+		info.shadowFilter = shadowFilterName(options.shadowFilter);
+		// 离屏目标的深度缓冲是GL_DEPTH24_STENCIL8，每像素4字节
+		info.visibilityBytes = 4.0 * options.width * options.height;
+		info.counters.push_back({"shadow_passes_executed", (double)shadowCache.executedPasses()});
+		info.counters.push_back({"shadow_passes_skipped", (double)shadowCache.skippedPasses()});
+		info.counters.push_back({"shadow_casters_drawn", castersDrawnSum / measuredFrames});
+		info.counters.push_back({"shadow_casters_culled", castersCulledSum / measuredFrames});
+		// 一个阴影贴图texel对应的世界空间边长，拟合得越紧越小；级联阴影时是最近的级联，每个级联另有一列
+		info.counters.push_back({"shadow_cascades", (double)CASCADES});
+		info.counters.push_back({"shadow_texel_size", shadowTexelSum[0] / std::max(frame - warmupFrames, 1)});
+		for (int cascade = 0; CASCADES > 1 && cascade < CASCADES; cascade++)
+		{
+			std::string prefix = "shadow_cascade" + std::to_string(cascade);
+			info.counters.push_back({prefix + "_far", (double)cascadeSplits[cascade]});
+			info.counters.push_back({prefix + "_texel_size", shadowTexelSum[cascade] / std::max(frame - warmupFrames, 1)});
+		}
+		// 阴影过滤的代价：每个片段的取样次数和实际读到的texel数，时间看lit pass的GPU计时
+		info.counters.push_back({"shadow_filter_taps", (double)shadowFilterTaps(options.shadowFilter)});
+		info.counters.push_back({"shadow_filter_texels", (double)shadowFilterTexels(options.shadowFilter)});
+		// 与CPU渲染器的triangles计数口径相同：正方体12个、地板2个三角形，每个光源一个小正方体
+		int triangles = (sceneGpu.cubeCount() + (int)scene.lights.size()) * 12;
+		for (const SceneObject &object : scene.objects)
+			triangles += object.mesh == MESH_FLOOR ? 2 : 0;
+		info.counters.push_back({"triangles", (double)triangles});
+		if (overdrawMode)
+		{
+			info.counters.push_back({"shaded_fragments_per_pixel", shadedFragmentsPerPixel});
+			// 与CPU渲染器的逐像素工作量放在同一列里比较
+			info.counters.push_back({"visibility_work_per_pixel", shadedFragmentsPerPixel});
+			for (int pass = 0; pass < PASS_COUNT; pass++)
+			{
+				const OverdrawCounter::PassStats &stats = overdraw.stats(pass);
+				info.counters.push_back({overdraw.passName(pass) + "_fragments_per_pixel", stats.perPixel()});
+				info.counters.push_back({overdraw.passName(pass) + "_depth_complexity", stats.perCoveredPixel()});
+			}
+		}
+		if (compared)
+		{
+			info.counters.push_back({"image_psnr_db", agreement.minPsnr});
+			info.counters.push_back({"image_mean_abs_error", agreement.meanAbsError});
+			info.counters.push_back({"image_mismatch_percent", agreement.maxMismatchPercent});
+		}
+		if (options.bspOrder)
+		{
+			info.counters.push_back({"bsp_nodes", (double)bspDraw.tree().nodes().size()});
+			info.counters.push_back({"bsp_fragments", (double)bspDraw.tree().fragments().size()});
+			info.counters.push_back({"bsp_splits", (double)bspDraw.tree().splitCount()});
+			info.counters.push_back({"bsp_draw_calls_per_frame", (double)bspDraw.drawCalls()});
+		}
+		writeBenchmarkReport(options.benchmarkPath, info, profiler);
+		if (!options.benchmarkCsvPath.empty())
+			appendBenchmarkCsv(options.benchmarkCsvPath, info, profiler);
+		if (!options.compareCsvPath.empty())
+			appendComparisonCsv(options.compareCsvPath, info, profiler);
 	}
 	
 	// optional: de-allocate all resources once they've outlived their purpose:
 	//   ------------------------------------------------------------------------
 	glDeleteVertexArrays(1, &VAO); 
 	glDeleteBuffers(1, &VBO); 
-	glDeleteProgram(shaderProgram);
+	glDeleteVertexArrays(1, &cubeDepthVAO);
+	glDeleteVertexArrays(1, &floorDepthVAO);
+	glDeleteBuffers(1, &cubePositionVBO);
+	glDeleteBuffers(1, &floorPositionVBO);
+	glDeleteBuffers(1, &frameUBO);
+	sceneGpu.destroy();
+	bspDraw.destroy();
+	shaderProgram.destroy();
+	depthShaderProgram.destroy();
+	lightShaderProgram.destroy();
+
+	if (options.headless)
+	{
+		destroyOffscreenTarget(offscreen);
+		destroyHeadlessContext();
+		return 0;
+	}
 
 	// glfw: terminate, clearing all previously allocated GLFW resources.
 	//   ------------------------------------------------------------------
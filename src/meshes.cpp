@@ -0,0 +1,75 @@
+#include "meshes.h"
+#include <cstddef>
+
+// 一个立方体
+const GLfloat CUBE_VERTICES[CUBE_VERTEX_COUNT * 8] = {
+// 后面
+// -----位置-------   --纹理坐标-- ---手工指定的法向------
+-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,  0.0f,  0.0f, -1.0f,
+ 0.5f, -0.5f, -0.5f,  1.0f, 0.0f,  0.0f,  0.0f, -1.0f,
+ 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,  0.0f,  0.0f, -1.0f,
+ 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,  0.0f,  0.0f, -1.0f,
+-0.5f,  0.5f, -0.5f,  0.0f, 1.0f, 0.0f,  0.0f, -1.0f,
+-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,  0.0f,  0.0f, -1.0f,
+
+// 前面
+-0.5f, -0.5f, 0.5f,  0.0f, 0.0f,  0.0f,  0.0f, 1.0f,
+ 0.5f, -0.5f, 0.5f,  1.0f, 0.0f,  0.0f,  0.0f, 1.0f,
+ 0.5f,  0.5f, 0.5f,  1.0f, 1.0f,  0.0f,  0.0f, 1.0f,
+ 0.5f,  0.5f, 0.5f,  1.0f, 1.0f,  0.0f,  0.0f, 1.0f,
+-0.5f,  0.5f, 0.5f,  0.0f, 1.0f,  0.0f,  0.0f, 1.0f,
+-0.5f, -0.5f, 0.5f,  0.0f, 0.0f,  0.0f,  0.0f, 1.0f,
+
+// 左面
+-0.5f,  0.5f, 0.5f,  1.0f, 0.0f,   -1.0f,  0.0f,  0.0f,
+-0.5f,  0.5f, -0.5f,  1.0f, 1.0f,  -1.0f,  0.0f,  0.0f,
+-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,  -1.0f,  0.0f,  0.0f,
+-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,  -1.0f,  0.0f,  0.0f,
+-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,  -1.0f,  0.0f,  0.0f,
+-0.5f,  0.5f, 0.5f,  1.0f, 0.0f,   -1.0f,  0.0f,  0.0f,
+
+// 右面
+ 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,  1.0f,  0.0f,  0.0f,
+ 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,  1.0f,  0.0f,  0.0f,
+ 0.5f, -0.5f, -0.5f,  0.0f, 1.0f,  1.0f,  0.0f,  0.0f,
+ 0.5f, -0.5f, -0.5f,  0.0f, 1.0f,  1.0f,  0.0f,  0.0f,
+ 0.5f, -0.5f,  0.5f,  0.0f, 0.0f,  1.0f,  0.0f,  0.0f,
+ 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,  1.0f,  0.0f,  0.0f,
+
+// 下面
+-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,  0.0f, -1.0f,  0.0f,
+ 0.5f, -0.5f, -0.5f,  1.0f, 1.0f,  0.0f, -1.0f,  0.0f,
+ 0.5f, -0.5f,  0.5f,  1.0f, 0.0f,  0.0f, -1.0f,  0.0f,
+ 0.5f, -0.5f,  0.5f,  1.0f, 0.0f,  0.0f, -1.0f,  0.0f,
+-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,  0.0f, -1.0f,  0.0f,
+-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,  0.0f, -1.0f,  0.0f,
+
+// 上面
+-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,  0.0f,  1.0f,  0.0f,
+ 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,  0.0f,  1.0f,  0.0f,
+ 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,  0.0f,  1.0f,  0.0f,
+ 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,  0.0f,  1.0f,  0.0f,
+-0.5f,  0.5f,  0.5f,  0.0f, 0.0f,  0.0f,  1.0f,  0.0f,
+-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,  0.0f,  1.0f,  0.0f
+};
+
+// 地板：50x50的平面，纹理重复25次
+const GLfloat FLOOR_VERTICES[FLOOR_VERTEX_COUNT * 8] = {
+    //---Positions-----     //---Normals-----   //-Texture Coords-
+     25.0f, -3.5f,  25.0f,	 0.0f, 1.0f, 0.0f,	25.0f, 0.0f,
+    -25.0f, -3.5f, -25.0f,	 0.0f, 1.0f, 0.0f, 	0.0f, 25.0f,
+    -25.0f, -3.5f, 25.0f,	 0.0f, 1.0f, 0.0f, 	0.0f, 0.0f,
+
+     25.0f, -3.5f,  25.0f,	 0.0f, 1.0f, 0.0f, 	25.0f, 0.0f,
+     25.0f, -3.5f, -25.0f,	 0.0f, 1.0f, 0.0f, 	25.0f, 25.0f,
+    -25.0f, -3.5f, -25.0f,	 0.0f, 1.0f, 0.0f, 	0.0f, 25.0f
+};
+
+std::vector<GLfloat> meshPositions(const GLfloat *vertices, int count)
+{
+	std::vector<GLfloat> positions((size_t)count * 3);
+	for (int i = 0; i < count; i++)
+		for (int axis = 0; axis < 3; axis++)
+			positions[(size_t)i * 3 + axis] = vertices[i * 8 + axis];
+	return positions;
+}
@@ -0,0 +1,20 @@
+#ifndef MESHES_H
+#define MESHES_H
+
+#include <glad/glad.h>
+#include <vector>
+
+// 场景里用到的两个网格，GL渲染和CPU渲染共用同一份顶点数据。
+// 注意两者每个顶点8个float的排布不同：
+//   正方体：位置(3) 纹理坐标(2) 法线(3)
+//   地板：  位置(3) 法线(3) 纹理坐标(2)
+const int CUBE_VERTEX_COUNT = 36;
+const int FLOOR_VERTEX_COUNT = 6;
+
+extern const GLfloat CUBE_VERTICES[CUBE_VERTEX_COUNT * 8];
+extern const GLfloat FLOOR_VERTICES[FLOOR_VERTEX_COUNT * 8];
+
+// 只取出每个顶点的位置（两种排布的前3个float都是位置），紧凑排列，给只写深度的pass用
+std::vector<GLfloat> meshPositions(const GLfloat *vertices, int count);
+
+#endif
@@ -0,0 +1,74 @@
+#include "normal_matrix.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define NORMAL_MATRIX_SSE 1
+#endif
+
+// 设上3x3的三列为a、b、c，则 inverse(A) 的三行依次为 b×c、c×a、a×b 再除以 det = a·(b×c)，
+// 所以 transpose(inverse(A)) 的三列正是 (b×c, c×a, a×b) / det
+glm::mat3 normalMatrix(const glm::mat4 &model)
+{
+	glm::vec3 a(model[0]), b(model[1]), c(model[2]);
+	glm::vec3 bc = glm::cross(b, c), ca = glm::cross(c, a), ab = glm::cross(a, b);
+	float invDet = 1.0f / glm::dot(a, bc);
+	return glm::mat3(bc * invDet, ca * invDet, ab * invDet);
+}
+
+#ifdef NORMAL_MATRIX_SSE
+// 把4个矩阵同一位置的元素装进一个寄存器
+static inline __m128 gather(const glm::mat4 *m, int column, int row)
+{
+	return _mm_set_ps(m[3][column][row], m[2][column][row], m[1][column][row], m[0][column][row]);
+}
+
+static inline void cross4(__m128 ux, __m128 uy, __m128 uz, __m128 vx, __m128 vy, __m128 vz,
+						  __m128 &rx, __m128 &ry, __m128 &rz)
+{
+	rx = _mm_sub_ps(_mm_mul_ps(uy, vz), _mm_mul_ps(uz, vy));
+	ry = _mm_sub_ps(_mm_mul_ps(uz, vx), _mm_mul_ps(ux, vz));
+	rz = _mm_sub_ps(_mm_mul_ps(ux, vy), _mm_mul_ps(uy, vx));
+}
+#endif
+
+void computeNormalMatrices(const glm::mat4 *models, glm::mat3 *normals, size_t count)
+{
+	size_t i = 0;
+#ifdef NORMAL_MATRIX_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		const glm::mat4 *m = models + i;
+		__m128 ax = gather(m, 0, 0), ay = gather(m, 0, 1), az = gather(m, 0, 2);
+		__m128 bx = gather(m, 1, 0), by = gather(m, 1, 1), bz = gather(m, 1, 2);
+		__m128 cx = gather(m, 2, 0), cy = gather(m, 2, 1), cz = gather(m, 2, 2);
+
+		__m128 bcx, bcy, bcz, cax, cay, caz, abx, aby, abz;
+		cross4(bx, by, bz, cx, cy, cz, bcx, bcy, bcz);
+		cross4(cx, cy, cz, ax, ay, az, cax, cay, caz);
+		cross4(ax, ay, az, bx, by, bz, abx, aby, abz);
+
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bcx), _mm_mul_ps(ay, bcy)), _mm_mul_ps(az, bcz));
+		__m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+		// 结果按元素存成9个4路数组，再分散写回4个mat3
+		alignas(16) float out[9][4];
+		_mm_store_ps(out[0], _mm_mul_ps(bcx, invDet));
+		_mm_store_ps(out[1], _mm_mul_ps(bcy, invDet));
+		_mm_store_ps(out[2], _mm_mul_ps(bcz, invDet));
+		_mm_store_ps(out[3], _mm_mul_ps(cax, invDet));
+		_mm_store_ps(out[4], _mm_mul_ps(cay, invDet));
+		_mm_store_ps(out[5], _mm_mul_ps(caz, invDet));
+		_mm_store_ps(out[6], _mm_mul_ps(abx, invDet));
+		_mm_store_ps(out[7], _mm_mul_ps(aby, invDet));
+		_mm_store_ps(out[8], _mm_mul_ps(abz, invDet));
+		for (int lane = 0; lane < 4; lane++)
+		{
+			glm::mat3 &n = normals[i + lane];
+			for (int element = 0; element < 9; element++)
+				n[element / 3][element % 3] = out[element][lane];
+		}
+	}
+#endif
+	for (; i < count; i++)
+		normals[i] = normalMatrix(models[i]);
+}
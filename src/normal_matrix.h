@@ -0,0 +1,14 @@
+#ifndef NORMAL_MATRIX_H
+#define NORMAL_MATRIX_H
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+// 法线矩阵 = model左上3x3子矩阵的逆的转置。
+// 它对同一个物体的所有顶点都相同，所以在CPU上每个物体算一次，而不是在顶点着色器里每个顶点求一次4x4逆矩阵。
+glm::mat3 normalMatrix(const glm::mat4 &model);
+
+// 批量计算：x86上用SSE一次处理4个矩阵（SoA排布），其余平台或剩余不足4个时逐个计算
+void computeNormalMatrices(const glm::mat4 *models, glm::mat3 *normals, size_t count);
+
+#endif
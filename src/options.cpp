@@ -0,0 +1,338 @@
+#include "options.h"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+void printUsage(const char *program)
+{
+	std::cout << "usage: " << program << " [options]\n"
+			  << "  --headless        use an offscreen EGL context instead of a GLFW window\n"
+			  << "  --frames N        number of frames to render in headless or benchmark mode (default 60)\n"
+			  << "  --resolution WxH  frame size (default 800x600), e.g. 3840x2160 or 7680x4320\n"
+			  << "  --out DIR         directory for the rendered frames (default frames)\n"
+			  << "  --no-write        render headless frames without writing them out\n"
+			  << "  --svg             write frames as resolution-independent SVG (weiler renderer only)\n"
+			  << "  --scene FILE      scene description to load and hot reload (default scenes/default.scene)\n"
+			  << "  --no-watch        do not reload the scene file when it changes\n"
+			  << "  --generate N      replace the scene with N cubes on a jittered grid (stress test)\n"
+			  << "  --lights M        number of lights in the generated scene (default 1, at most 16)\n"
+			  << "  --seed S          random seed of the generated scene (default 1)\n"
+			  << "  --shadow-size N   shadow map resolution (default 1024)\n"
+			  << "  --light-fit MODE  shadow frustum: camera (default, casters within the view frustum), scene (all casters) or fixed\n"
+			  << "  --shadow-distance D how far from the camera --light-fit camera keeps shadows (default 20)\n"
+			  << "  --cascades N      cascaded shadow maps: split the shadow distance into N maps, 1 to 4 (default 1, gl only)\n"
+			  << "  --cascade-split S cascade split scheme: uniform, log or practical (default, blend of both)\n"
+			  << "  --cascade-lambda L weight of the log split in the practical scheme, 0 to 1 (default 0.75)\n"
+			  << "  --shadow-filter F shadow map filtering: hard (nearest texel, no bias), hardware (default, 2x2 compare in the sampler)\n"
+			  << "                    or poisson4, poisson8, poisson16, poisson32 (rotated Poisson disk of hardware compares, gl only)\n"
+			  << "  --instances N     override the number of cubes (extra ones are laid out on a grid)\n"
+			  << "  --draw-mode MODE  instanced (one draw call per pass) or loop (one draw call per cube)\n"
+			  << "  --draw-order ORDER material (default) or bsp (lit pass submitted front to back from a BSP tree)\n"
+			  << "  --no-shadow-cache re-render the shadow map every frame\n"
+			  << "  --no-caster-culling draw every object into the shadow map, even those whose shadow cannot be seen\n"
+			  << "  --trace FILE      write per-pass CPU/GPU timings as a Chrome about:tracing JSON\n"
+			  << "  --benchmark FILE  render a fixed timeline (warm-up + measured frames) and write a JSON report\n"
+			  << "  --warmup N        warm-up frames excluded from the benchmark statistics (default 30)\n"
+			  << "  --benchmark-csv FILE append the benchmark summary as one CSV row\n"
+			  << "  --reference DIR   compare the written frames with the frames in DIR and report the agreement\n"
+			  << "  --compare-csv FILE append one row of the engine comparison table (time, memory, work, agreement)\n"
+			  << "  --overdraw DIR    count shaded fragments per pixel in each GL pass (stencil), write histograms and heatmaps to DIR\n"
+			  << "  --camera-path FILE follow a recorded camera path instead of orbiting the scene\n"
+			  << "  --renderer NAME   gl (default) or a CPU renderer: zbuffer, scanline, interval, warnock, bsp, depthsort, weiler, raycast (no window)\n"
+			  << "  --threads N       worker threads of the CPU renderers (default: all hardware threads)\n"
+			  << "  --check-shadow-map also render the shadow map and count pixels where it disagrees with the shadow rays (raycast only)\n"
+			  << "  --help            show this message" << std::endl;
+}
+
+bool parseOptions(int argc, char **argv, RenderOptions &options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		// 需要带一个值的参数
+		bool hasValue = i + 1 < argc;
+		if (strcmp(arg, "--headless") == 0)
+		{
+			options.headless = true;
+		}
+		else if (strcmp(arg, "--frames") == 0 && hasValue)
+		{
+			options.frames = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--resolution") == 0 && hasValue)
+		{
+			if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2)
+			{
+				std::cout << "--resolution expects WIDTHxHEIGHT, got " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--out") == 0 && hasValue)
+		{
+			options.outputDir = argv[++i];
+		}
+		else if (strcmp(arg, "--no-write") == 0)
+		{
+			options.writeFrames = false;
+		}
+		else if (strcmp(arg, "--svg") == 0)
+		{
+			options.svgFrames = true;
+		}
+		else if (strcmp(arg, "--scene") == 0 && hasValue)
+		{
+			options.scenePath = argv[++i];
+		}
+		else if (strcmp(arg, "--no-watch") == 0)
+		{
+			options.watchScene = false;
+		}
+		else if (strcmp(arg, "--generate") == 0 && hasValue)
+		{
+			options.generateCubes = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--lights") == 0 && hasValue)
+		{
+			options.generateLights = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--seed") == 0 && hasValue)
+		{
+			options.seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(arg, "--shadow-size") == 0 && hasValue)
+		{
+			options.shadowSize = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--light-fit") == 0 && hasValue)
+		{
+			const char *mode = argv[++i];
+			if (strcmp(mode, "camera") == 0)
+				options.lightFit = LIGHT_FIT_CAMERA;
+			else if (strcmp(mode, "scene") == 0)
+				options.lightFit = LIGHT_FIT_SCENE;
+			else if (strcmp(mode, "fixed") == 0)
+				options.lightFit = LIGHT_FIT_FIXED;
+			else
+			{
+				std::cout << "--light-fit expects camera, scene or fixed, got " << mode << std::endl;
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--shadow-distance") == 0 && hasValue)
+		{
+			options.shadowDistance = (float)atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--cascades") == 0 && hasValue)
+		{
+			options.cascades = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--cascade-split") == 0 && hasValue)
+		{
+			const char *scheme = argv[++i];
+			if (strcmp(scheme, "uniform") == 0)
+				options.cascadeSplit = CASCADE_SPLIT_UNIFORM;
+			else if (strcmp(scheme, "log") == 0)
+				options.cascadeSplit = CASCADE_SPLIT_LOG;
+			else if (strcmp(scheme, "practical") == 0)
+				options.cascadeSplit = CASCADE_SPLIT_PRACTICAL;
+			else
+			{
+				std::cout << "--cascade-split expects uniform, log or practical, got " << scheme << std::endl;
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--cascade-lambda") == 0 && hasValue)
+		{
+			options.cascadeLambda = (float)atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--shadow-filter") == 0 && hasValue)
+		{
+			const char *filter = argv[++i];
+			bool found = false;
+			for (int f = SHADOW_FILTER_HARD; f <= SHADOW_FILTER_POISSON32 && !found; f++)
+			{
+				if (strcmp(filter, shadowFilterName((ShadowFilter)f)) == 0)
+				{
+					options.shadowFilter = (ShadowFilter)f;
+					found = true;
+				}
+			}
+			if (!found)
+			{
+				std::cout << "--shadow-filter expects hard, hardware, poisson4, poisson8, poisson16 or poisson32, got " << filter << std::endl;
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--instances") == 0 && hasValue)
+		{
+			options.instances = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--draw-mode") == 0 && hasValue)
+		{
+			const char *mode = argv[++i];
+			if (strcmp(mode, "instanced") == 0)
+				options.instancing = true;
+			else if (strcmp(mode, "loop") == 0)
+				options.instancing = false;
+			else
+			{
+				std::cout << "Unknown draw mode: " << mode << std::endl;
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--draw-order") == 0 && hasValue)
+		{
+			const char *order = argv[++i];
+			if (strcmp(order, "material") == 0)
+				options.bspOrder = false;
+			else if (strcmp(order, "bsp") == 0)
+				options.bspOrder = true;
+			else
+			{
+				std::cout << "Unknown draw order: " << order << std::endl;
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--no-shadow-cache") == 0)
+		{
+			options.shadowCache = false;
+		}
+		else if (strcmp(arg, "--no-caster-culling") == 0)
+		{
+			options.casterCulling = false;
+		}
+		else if (strcmp(arg, "--trace") == 0 && hasValue)
+		{
+			options.tracePath = argv[++i];
+		}
+		else if (strcmp(arg, "--benchmark") == 0 && hasValue)
+		{
+			options.benchmarkPath = argv[++i];
+		}
+		else if (strcmp(arg, "--warmup") == 0 && hasValue)
+		{
+			options.warmupFrames = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--benchmark-csv") == 0 && hasValue)
+		{
+			options.benchmarkCsvPath = argv[++i];
+		}
+		else if (strcmp(arg, "--reference") == 0 && hasValue)
+		{
+			options.referenceDir = argv[++i];
+		}
+		else if (strcmp(arg, "--compare-csv") == 0 && hasValue)
+		{
+			options.compareCsvPath = argv[++i];
+		}
+		else if (strcmp(arg, "--overdraw") == 0 && hasValue)
+		{
+			options.overdrawDir = argv[++i];
+		}
+		else if (strcmp(arg, "--camera-path") == 0 && hasValue)
+		{
+			options.cameraPath = argv[++i];
+		}
+		else if (strcmp(arg, "--renderer") == 0 && hasValue)
+		{
+			options.renderer = argv[++i];
+		}
+		else if (strcmp(arg, "--check-shadow-map") == 0)
+		{
+			options.checkShadowMap = true;
+		}
+		else if (strcmp(arg, "--threads") == 0 && hasValue)
+		{
+			options.threads = atoi(argv[++i]);
+		}
+		else
+		{
+			if (strcmp(arg, "--help") != 0)
+				std::cout << "Unknown or incomplete option: " << arg << std::endl;
+			printUsage(argv[0]);
+			return false;
+		}
+	}
+	if (options.frames <= 0)
+	{
+		std::cout << "--frames must be positive" << std::endl;
+		return false;
+	}
+	if (options.width <= 0 || options.height <= 0)
+	{
+		std::cout << "--resolution must be positive" << std::endl;
+		return false;
+	}
+	if (options.warmupFrames < 0)
+	{
+		std::cout << "--warmup must not be negative" << std::endl;
+		return false;
+	}
+	if (options.generateCubes < 0 || options.generateLights < 1 || options.generateLights > 16)
+	{
+		std::cout << "--generate must not be negative and --lights must be between 1 and 16" << std::endl;
+		return false;
+	}
+	if (options.shadowSize <= 0)
+	{
+		std::cout << "--shadow-size must be positive" << std::endl;
+		return false;
+	}
+	if (options.shadowDistance <= 0.0f)
+	{
+		std::cout << "--shadow-distance must be positive" << std::endl;
+		return false;
+	}
+	if (options.cascades < 1 || options.cascades > 4 || options.cascadeLambda < 0.0f || options.cascadeLambda > 1.0f)
+	{
+		std::cout << "--cascades must be between 1 and 4 and --cascade-lambda between 0 and 1" << std::endl;
+		return false;
+	}
+	// 级联沿相机视线切分，只有拟合到相机视锥体才有意义；CPU渲染器只有一张阴影贴图
+	if (options.cascades > 1 && (options.lightFit != LIGHT_FIT_CAMERA || options.renderer != "gl"))
+	{
+		std::cout << "--cascades needs the gl renderer and --light-fit camera" << std::endl;
+		return false;
+	}
+	// CPU渲染器只模仿单次取样的两种过滤，泊松圆盘只在GL的片段着色器里
+	if (options.shadowFilter >= SHADOW_FILTER_POISSON4 && options.renderer != "gl")
+	{
+		std::cout << "--shadow-filter " << shadowFilterName(options.shadowFilter) << " needs the gl renderer" << std::endl;
+		return false;
+	}
+	if ((!options.benchmarkCsvPath.empty() || !options.compareCsvPath.empty()) && options.benchmarkPath.empty())
+	{
+		std::cout << "--benchmark-csv and --compare-csv need --benchmark" << std::endl;
+		return false;
+	}
+	// 比较的是写出的PPM帧；GL只有无窗口模式才写帧
+	if (!options.referenceDir.empty() &&
+		(!options.writeFrames || options.svgFrames || (options.renderer == "gl" && !options.headless)))
+	{
+		std::cout << "--reference compares written PPM frames: it needs --headless or a CPU renderer, and no --no-write or --svg" << std::endl;
+		return false;
+	}
+	if (options.instances < 0)
+	{
+		std::cout << "--instances must not be negative" << std::endl;
+		return false;
+	}
+	if (options.svgFrames && options.renderer == "gl")
+	{
+		std::cout << "--svg needs a CPU renderer with vector output (--renderer weiler)" << std::endl;
+		return false;
+	}
+	// 计数用离屏目标的模板缓冲；窗口的默认帧缓冲不一定有模板位，帧数也不固定
+	if (!options.overdrawDir.empty() && (options.renderer != "gl" || !options.headless))
+	{
+		std::cout << "--overdraw needs the gl renderer with --headless" << std::endl;
+		return false;
+	}
+	if (options.threads < 0)
+	{
+		std::cout << "--threads must not be negative" << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,51 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <string>
+#include "view_setup.h"
+
+// 命令行参数：控制渲染后端、帧数与输出位置
+struct RenderOptions
+{
+	bool headless = false;			// 无窗口模式：EGL离屏上下文 + FBO，适合没有显示器/GPU的渲染节点
+	int frames = 60;				// 无窗口模式下渲染的帧数
+	int width = 800;				// 画面分辨率（窗口或离屏目标的大小）
+	int height = 600;
+	std::string outputDir = "frames";	// 帧图像（PPM）输出目录
+	bool writeFrames = true;		// --no-write 时只渲染不写盘，用于纯粹测量渲染耗时
+	bool svgFrames = false;			// 帧写成SVG矢量图而不是PPM（只有weiler渲染器支持）
+	std::string scenePath = "scenes/default.scene";	// 场景文件，运行时修改会被热重载
+	bool watchScene = true;			// 监视场景文件的改动
+	int generateCubes = 0;			// 大于0时不读场景文件，生成这么多正方体的压力测试场景
+	int generateLights = 1;			// 压力测试场景的光源数量
+	unsigned int seed = 1;			// 压力测试场景的随机种子
+	int shadowSize = 1024;			// 深度贴图的分辨率（宽高相同）
+	LightFit lightFit = LIGHT_FIT_CAMERA;	// 光源视角的正交范围：固定、拟合投射者，或再与相机视锥体求交
+	float shadowDistance = 20.0f;	// 拟合到相机时只考虑视锥体前这么远的一段，更远处没有阴影
+	int cascades = 1;				// 级联阴影贴图的级联数（深度纹理数组的层数），1为单张阴影贴图
+	CascadeSplit cascadeSplit = CASCADE_SPLIT_PRACTICAL;	// 级联沿视线方向怎么切分
+	float cascadeLambda = 0.75f;	// practical切分里等比切分的权重
+	ShadowFilter shadowFilter = SHADOW_FILTER_HARDWARE;	// 阴影贴图的过滤方式
+	int instances = 0;				// 正方体数量，0表示按场景文件；多于场景中的正方体时多出的排成网格
+	bool instancing = true;			// true：每个pass一次glDrawArraysInstanced；false：逐个正方体glDrawArrays
+	bool bspOrder = false;			// true：lit pass按BSP树从前到后的顺序提交，而不是按材质分组
+	bool shadowCache = true;		// 光源与投射者不变时复用上一帧的深度贴图
+	bool casterCulling = true;		// 深度pass之前剔除投不出看得见的阴影的物体
+	std::string tracePath;			// 逐pass计时的Chrome trace输出文件，为空则不计时
+	std::string benchmarkPath;		// 基准测试报告（JSON），不为空时按固定时间线跑 warmupFrames + frames 帧
+	int warmupFrames = 30;			// 基准测试的预热帧数，不计入统计
+	std::string cameraPath;			// 录制好的相机路径文件，为空则相机绕场景中心旋转
+	std::string benchmarkCsvPath;	// 基准测试结果追加为CSV的一行，用于make bench扫描参数
+	std::string referenceDir;		// 参考帧目录：渲染完后逐张比较输出的帧，报告画面一致性
+	std::string compareCsvPath;		// 引擎对比表（固定列的CSV），用于make bench-compare
+	std::string overdrawDir;		// overdraw诊断：每个pass的深度复杂度直方图和热力图写到这个目录，为空则关闭
+	std::string renderer = "gl";	// gl：OpenGL；其余为CPU渲染器（见soft_renderer.h），不创建GL上下文
+	int threads = 0;				// CPU渲染器的线程数，0表示使用全部硬件线程
+	bool checkShadowMap = false;	// 诊断：raycast也生成阴影贴图，统计与阴影光线结论不同的像素
+};
+
+// 解析命令行；遇到未知参数或 --help 时打印用法并返回false
+bool parseOptions(int argc, char **argv, RenderOptions &options);
+void printUsage(const char *program);
+
+#endif
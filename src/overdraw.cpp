@@ -0,0 +1,139 @@
+#include "overdraw.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+// std::min按引用取参数，要有定义
+const int OverdrawCounter::HEATMAP_MAX;
+
+OverdrawCounter::~OverdrawCounter()
+{
+	if (file)
+		fclose(file);
+}
+
+bool OverdrawCounter::open(const std::string &dir, const std::vector<std::string> &passNames)
+{
+	std::error_code error;
+	std::filesystem::create_directories(dir, error);
+	std::string path = dir + "/overdraw.csv";
+	file = fopen(path.c_str(), "w");
+	if (!file)
+	{
+		std::cout << "Failed to open overdraw histogram " << path << std::endl;
+		return false;
+	}
+	directory = dir;
+	names = passNames;
+	for (std::string &name : names)
+		std::replace(name.begin(), name.end(), ' ', '_');
+	totals.assign(names.size(), PassStats());
+
+	fprintf(file, "frame,pass,width,height,covered_pixels,fragments,fragments_per_pixel,fragments_per_covered_pixel");
+	for (int bin = 0; bin < HISTOGRAM_BINS; bin++)
+		fprintf(file, bin + 1 < HISTOGRAM_BINS ? ",h%d" : ",h%d_plus", bin);
+	fprintf(file, "\n");
+	return true;
+}
+
+void OverdrawCounter::beginPass()
+{
+	glStencilMask(0xFF);
+	glClearStencil(0);
+	glClear(GL_STENCIL_BUFFER_BIT);
+	glEnable(GL_STENCIL_TEST);
+	glStencilFunc(GL_ALWAYS, 0, 0xFF);
+	// 模板失败、深度失败时不变，深度通过（片段会被着色）时加一
+	glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+}
+
+void OverdrawCounter::endPass(int pass, int frame, int width, int height)
+{
+	glDisable(GL_STENCIL_TEST);
+	if (frame < 0)
+		return;
+	counts.resize((size_t)width * height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE, counts.data());
+	record(pass, frame, width, height);
+}
+
+void OverdrawCounter::endLayeredPass(int pass, int frame, unsigned int texture, int size, int layers)
+{
+	glDisable(GL_STENCIL_TEST);
+	if (frame < 0)
+		return;
+	// 分层的附件只能读到第0层，每层单独挂到一个读帧缓冲上读回（这个帧缓冲随上下文一起释放）
+	if (readFBO == 0)
+		glGenFramebuffers(1, &readFBO);
+	GLint previous = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+	counts.resize((size_t)size * size * layers);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	for (int layer = 0; layer < layers; layer++)
+	{
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, texture, 0, layer);
+		glReadPixels(0, 0, size, size, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE, counts.data() + (size_t)size * size * layer);
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, previous);
+	record(pass, frame, size, size * layers);
+}
+
+void OverdrawCounter::record(int pass, int frame, int width, int height)
+{
+	double histogram[HISTOGRAM_BINS] = {};
+	double fragments = 0.0;
+	for (unsigned char count : counts)
+	{
+		histogram[std::min((int)count, HISTOGRAM_BINS - 1)]++;
+		fragments += count;
+	}
+	double pixels = (double)counts.size(), covered = pixels - histogram[0];
+	PassStats &total = totals[pass];
+	total.frames++;
+	total.pixels += pixels;
+	total.coveredPixels += covered;
+	total.fragments += fragments;
+
+	fprintf(file, "%d,%s,%d,%d,%.0f,%.0f,%.4f,%.4f", frame, names[pass].c_str(), width, height, covered, fragments,
+			fragments / pixels, covered > 0 ? fragments / covered : 0.0);
+	for (int bin = 0; bin < HISTOGRAM_BINS; bin++)
+		fprintf(file, ",%.0f", histogram[bin]);
+	fprintf(file, "\n");
+
+	char name[64];
+	snprintf(name, sizeof(name), "_%04d.ppm", frame);
+	writeHeatmap(directory + "/" + names[pass] + name, width, height);
+}
+
+// 热力图：0次为黑色，1次为蓝色，之后依次经过青、绿、黄、红，HEATMAP_MAX次及以上为白色
+bool OverdrawCounter::writeHeatmap(const std::string &path, int width, int height) const
+{
+	static const float RAMP[7][3] = {{0, 0, 0}, {0, 0, 255}, {0, 255, 255}, {0, 255, 0}, {255, 255, 0}, {255, 0, 0}, {255, 255, 255}};
+	FILE *image = fopen(path.c_str(), "wb");
+	if (!image)
+	{
+		std::cout << "Failed to open " << path << " for writing" << std::endl;
+		return false;
+	}
+	fprintf(image, "P6\n%d %d\n255\n", width, height);
+	std::vector<unsigned char> row((size_t)width * 3);
+	// OpenGL的原点在左下角，写出时上下翻转
+	for (int y = height - 1; y >= 0; y--)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			int count = std::min((int)counts[(size_t)y * width + x], HEATMAP_MAX);
+			float t = count == 0 ? 0.0f : 1.0f + 5.0f * (count - 1) / (HEATMAP_MAX - 1);
+			int stop = std::min((int)t, 5);
+			float f = t - stop;
+			for (int c = 0; c < 3; c++)
+				row[x * 3 + c] = (unsigned char)(RAMP[stop][c] + (RAMP[stop + 1][c] - RAMP[stop][c]) * f + 0.5f);
+		}
+		fwrite(row.data(), 1, row.size(), image);
+	}
+	fclose(image);
+	return true;
+}
@@ -0,0 +1,65 @@
+#ifndef OVERDRAW_H
+#define OVERDRAW_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// overdraw诊断模式（--overdraw DIR）：测量每个pass里每个像素被着色了几次。
+// pass开始时清零模板缓冲，模板测试总是通过，深度测试通过时模板值加一（GL_INCR），
+// pass结束后读回模板缓冲，就得到这个pass的深度复杂度：提前深度测试之后真正跑了片段着色器的片段数。
+// 没有深度预pass时，lit pass里被后画的片段盖掉的那部分着色全是浪费，这个数减去1就是能省下的比例。
+// 模板只有8位，GL_INCR在255处饱和。读回会让流水线停下来，所以这个模式下的计时不能当作性能数据。
+// 每个测量帧的每个pass写一行直方图到 DIR/overdraw.csv，再写一张热力图 DIR/<pass>_NNNN.ppm
+class OverdrawCounter
+{
+public:
+	static const int HISTOGRAM_BINS = 17;	// 0..15次各一格，最后一格是16次及以上
+	static const int HEATMAP_MAX = 8;		// 热力图颜色在这么多次处到顶（白色）
+
+	// 测量帧的累计
+	struct PassStats
+	{
+		double frames = 0;			// 执行过这个pass的测量帧（阴影pass命中缓存时不算）
+		double pixels = 0;			// 目标的像素数之和
+		double coveredPixels = 0;	// 至少被着色一次的像素数之和
+		double fragments = 0;		// 着色的片段数之和
+
+		double perPixel() const { return pixels > 0 ? fragments / pixels : 0.0; }
+		double perCoveredPixel() const { return coveredPixels > 0 ? fragments / coveredPixels : 0.0; }
+	};
+
+	OverdrawCounter() = default;
+	~OverdrawCounter();
+	OverdrawCounter(const OverdrawCounter &) = delete;
+	OverdrawCounter &operator=(const OverdrawCounter &) = delete;
+
+	// passNames用于CSV和热力图的文件名，失败时打印原因并返回false
+	bool open(const std::string &dir, const std::vector<std::string> &passNames);
+	bool enabled() const { return file != NULL; }
+
+	// 在pass的目标帧缓冲绑定之后调用：清零模板并打开计数
+	void beginPass();
+	// 在目标帧缓冲仍然绑定时调用：读回width x height的模板值，关掉计数；frame >= 0（测量帧）时统计并输出
+	void endPass(int pass, int frame, int width, int height);
+	// 同上，目标是分层的深度模板纹理数组（级联阴影贴图）：逐层读回，各层在热力图里从下往上排成一列
+	void endLayeredPass(int pass, int frame, unsigned int texture, int size, int layers);
+
+	const PassStats &stats(int pass) const { return totals[pass]; }
+	int passCount() const { return (int)names.size(); }
+	const std::string &passName(int pass) const { return names[pass]; }
+
+private:
+	// 统计counts里读回的width x height个计数，写一行直方图和一张热力图
+	void record(int pass, int frame, int width, int height);
+	bool writeHeatmap(const std::string &path, int width, int height) const;
+
+	std::string directory;
+	std::vector<std::string> names;		// 空格换成下划线
+	std::vector<PassStats> totals;
+	std::vector<unsigned char> counts;
+	FILE *file = NULL;
+	unsigned int readFBO = 0;
+};
+
+#endif
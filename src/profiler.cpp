@@ -0,0 +1,215 @@
+#include <glad/glad.h>
+#include "profiler.h"
+#include <iostream>
+
+// trace里的线程编号：CPU提交一条轨道，GPU执行一条轨道
+static const int TRACE_TID_CPU = 1;
+static const int TRACE_TID_GPU = 2;
+
+FrameProfiler::~FrameProfiler()
+{
+	shutdown();
+}
+
+bool FrameProfiler::init(const std::vector<std::string> &passNames, const std::string &tracePath, bool keepHistory,
+						 bool gpuTiming)
+{
+	names = passNames;
+	this->keepHistory = keepHistory;
+	this->gpuTiming = gpuTiming;
+	frames.clear();
+	lastFrameEndUs = -1.0;
+	results.assign(names.size(), PassTiming());
+	for (int slot = 0; slot < SLOTS; slot++)
+	{
+		queries[slot].resize(gpuTiming ? names.size() : 0);
+		if (gpuTiming)
+			glGenQueries((GLsizei)names.size(), queries[slot].data());
+		records[slot].assign(names.size(), PassRecord());
+		slotFrame[slot] = -1;
+	}
+	epoch = std::chrono::steady_clock::now();
+	frameIndex = -1;
+
+	if (!tracePath.empty())
+	{
+		trace = fopen(tracePath.c_str(), "w");
+		if (!trace)
+		{
+			std::cout << "Failed to open trace file " << tracePath << std::endl;
+			return false;
+		}
+		// JSON数组格式：about:tracing允许缺少结尾的']'，程序中途被杀掉时文件依然可以加载
+		fprintf(trace, "[\n");
+		fprintf(trace, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"CPU submit\"}}", TRACE_TID_CPU);
+		if (gpuTiming)
+			fprintf(trace, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"GPU\"}}", TRACE_TID_GPU);
+		firstEvent = false;
+	}
+	initialized = true;
+	return true;
+}
+
+void FrameProfiler::shutdown()
+{
+	if (!initialized)
+		return;
+	// 退出时不在乎阻塞，把最后两帧的结果也取回来
+	if (gpuTiming)
+	{
+		glFinish();
+		if (frameIndex >= 0)
+		{
+			resolveSlot((int)((frameIndex + 1) % SLOTS));
+			resolveSlot((int)(frameIndex % SLOTS));
+		}
+		for (int slot = 0; slot < SLOTS; slot++)
+		{
+			glDeleteQueries((GLsizei)queries[slot].size(), queries[slot].data());
+			queries[slot].clear();
+		}
+	}
+	if (trace)
+	{
+		fprintf(trace, "\n]\n");
+		fclose(trace);
+		trace = NULL;
+	}
+	initialized = false;
+}
+
+double FrameProfiler::nowUs() const
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void FrameProfiler::beginFrame()
+{
+	if (!initialized)
+		return;
+	frameIndex++;
+	// 本帧要重用的槽里存的是两帧之前的查询，先取回
+	resolveSlot((int)(frameIndex % SLOTS));
+	slotFrame[frameIndex % SLOTS] = frameIndex;
+	for (PassRecord &record : records[frameIndex % SLOTS])
+		record.issued = false;
+	if (keepHistory)
+	{
+		FrameRecord record;
+		record.passes.assign(names.size(), PassTiming());
+		record.issued.assign(names.size(), false);
+		frames.push_back(record);
+	}
+	frameBeginUs = nowUs();
+}
+
+void FrameProfiler::endFrame()
+{
+	if (!initialized)
+		return;
+	double endUs = nowUs();
+	if (keepHistory)
+	{
+		FrameRecord &record = frames[frameIndex];
+		record.cpuMs = (endUs - frameBeginUs) / 1000.0;
+		record.frameMs = (endUs - (lastFrameEndUs < 0.0 ? frameBeginUs : lastFrameEndUs)) / 1000.0;
+	}
+	lastFrameEndUs = endUs;
+	writeEvent("frame", "cpu", TRACE_TID_CPU, frameBeginUs, endUs - frameBeginUs, frameIndex);
+	if (trace)
+		fflush(trace);
+}
+
+void FrameProfiler::beginPass(int pass)
+{
+	if (!initialized)
+		return;
+	int slot = (int)(frameIndex % SLOTS);
+	records[slot][pass].cpuBeginUs = nowUs();
+	if (gpuTiming)
+		glBeginQuery(GL_TIME_ELAPSED, queries[slot][pass]);
+}
+
+void FrameProfiler::endPass(int pass)
+{
+	if (!initialized)
+		return;
+	int slot = (int)(frameIndex % SLOTS);
+	if (gpuTiming)
+		glEndQuery(GL_TIME_ELAPSED);
+	PassRecord &record = records[slot][pass];
+	record.cpuEndUs = nowUs();
+	record.issued = true;
+	results[pass].cpuMs = (record.cpuEndUs - record.cpuBeginUs) / 1000.0;
+	if (keepHistory)
+	{
+		frames[frameIndex].passes[pass].cpuMs = results[pass].cpuMs;
+		frames[frameIndex].issued[pass] = true;
+	}
+	writeEvent(names[pass].c_str(), "cpu", TRACE_TID_CPU, record.cpuBeginUs, record.cpuEndUs - record.cpuBeginUs, frameIndex);
+}
+
+void FrameProfiler::counter(const char *name, std::initializer_list<std::pair<const char *, double>> values)
+{
+	if (!trace)
+		return;
+	fprintf(trace, "%s{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{", firstEvent ? "" : ",\n", name, nowUs());
+	const char *separator = "";
+	for (const std::pair<const char *, double> &value : values)
+	{
+		fprintf(trace, "%s\"%s\":%g", separator, value.first, value.second);
+		separator = ",";
+	}
+	fprintf(trace, "}}");
+	firstEvent = false;
+}
+
+void FrameProfiler::resolveSlot(int slot)
+{
+	if (slotFrame[slot] < 0 || !gpuTiming)
+		return;
+	// GPU轨道上的事件从该帧第一个pass的CPU开始时刻起依次排列，
+	// TIME_ELAPSED只给出持续时间，没有绝对时间戳
+	double gpuCursorUs = -1.0;
+	FrameRecord *frameRecord = keepHistory ? &frames[slotFrame[slot]] : NULL;
+	if (frameRecord)
+		frameRecord->gpuValid = true;
+	for (size_t pass = 0; pass < names.size(); pass++)
+	{
+		const PassRecord &record = records[slot][pass];
+		if (!record.issued)
+			continue;
+		GLint available = 0;
+		glGetQueryObjectiv(queries[slot][pass], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			// 绝不阻塞：拿不到就丢弃这一帧这个pass的数据
+			if (frameRecord)
+				frameRecord->gpuValid = false;
+			continue;
+		}
+		GLuint64 elapsedNs = 0;
+		glGetQueryObjectui64v(queries[slot][pass], GL_QUERY_RESULT, &elapsedNs);
+		double durUs = elapsedNs / 1000.0;
+		results[pass].gpuMs = durUs / 1000.0;
+		if (frameRecord)
+		{
+			frameRecord->passes[pass].gpuMs = results[pass].gpuMs;
+			frameRecord->gpuMs += results[pass].gpuMs;
+		}
+		if (gpuCursorUs < record.cpuBeginUs)
+			gpuCursorUs = record.cpuBeginUs;
+		writeEvent(names[pass].c_str(), "gpu", TRACE_TID_GPU, gpuCursorUs, durUs, slotFrame[slot]);
+		gpuCursorUs += durUs;
+	}
+	slotFrame[slot] = -1;
+}
+
+void FrameProfiler::writeEvent(const char *name, const char *category, int tid, double tsUs, double durUs, long long frame)
+{
+	if (!trace)
+		return;
+	fprintf(trace, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%lld}}",
+			firstEvent ? "" : ",\n", name, category, tid, tsUs, durUs, frame);
+	firstEvent = false;
+}
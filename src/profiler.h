@@ -0,0 +1,114 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <cstdio>
+#include <initializer_list>
+#include <string>
+#include <utility>
+#include <vector>
+
+// 逐pass的CPU/GPU计时
+// GPU：每个pass一个GL_TIME_ELAPSED查询，查询对象按帧双缓冲——第N帧写入N%2号槽，
+// 到第N+2帧重用这个槽之前才去取结果，此时GPU早已完成，取结果不会让流水线停下来等待。
+// 如果结果仍未就绪就丢弃这一帧的数据而不是阻塞。
+// CPU：用steady_clock记录每个pass提交命令所花的时间。
+// 结果以Chrome about:tracing的JSON数组格式逐帧写入文件；需要统计时也可以把每一帧的数据保存下来。
+class FrameProfiler
+{
+public:
+	struct PassTiming
+	{
+		double cpuMs = 0.0;
+		double gpuMs = 0.0;
+	};
+
+	// keepHistory时保存的每帧数据
+	struct FrameRecord
+	{
+		double frameMs = 0.0;		// 与上一帧endFrame的间隔，即实际的帧时间
+		double cpuMs = 0.0;			// beginFrame到endFrame之间CPU所花的时间
+		double gpuMs = 0.0;			// 本帧所有pass的GPU时间之和
+		bool gpuValid = false;		// 所有提交了的pass的GPU结果都取回了
+		std::vector<PassTiming> passes;
+		std::vector<bool> issued;	// 被跳过的pass（例如命中阴影缓存）为false
+	};
+
+	FrameProfiler() = default;
+	~FrameProfiler();
+	FrameProfiler(const FrameProfiler &) = delete;
+	FrameProfiler &operator=(const FrameProfiler &) = delete;
+
+	// 需要在OpenGL上下文创建之后调用；tracePath为空则不写trace文件。
+	// gpuTiming为false时不碰GL，只记CPU时间（CPU渲染器没有GL上下文）
+	bool init(const std::vector<std::string> &passNames, const std::string &tracePath, bool keepHistory = false,
+			  bool gpuTiming = true);
+	void shutdown();
+	bool enabled() const { return initialized; }
+
+	void beginFrame();
+	void endFrame();
+	void beginPass(int pass);
+	void endPass(int pass);
+	// 本帧的计数（例如深度pass提交和剔除的物体数），在trace里是一条随帧变化的计数轨道
+	void counter(const char *name, std::initializer_list<std::pair<const char *, double>> values);
+
+	// 最近一次取回的结果（GPU结果比当前帧晚两帧）
+	const PassTiming &lastResult(int pass) const { return results[pass]; }
+	int passCount() const { return (int)names.size(); }
+	const std::string &passName(int pass) const { return names[pass]; }
+	// 下标即帧号；最后两帧的GPU结果要在shutdown之后才完整
+	const std::vector<FrameRecord> &history() const { return frames; }
+
+private:
+	static const int SLOTS = 2;
+
+	struct PassRecord
+	{
+		double cpuBeginUs = 0.0;
+		double cpuEndUs = 0.0;
+		bool issued = false;
+	};
+
+	double nowUs() const;
+	void resolveSlot(int slot);
+	void writeEvent(const char *name, const char *category, int tid, double tsUs, double durUs, long long frameIndex);
+
+	bool initialized = false;
+	bool gpuTiming = true;
+	std::vector<std::string> names;
+	std::vector<unsigned int> queries[SLOTS];
+	std::vector<PassRecord> records[SLOTS];
+	long long slotFrame[SLOTS] = {-1, -1};
+	std::vector<PassTiming> results;
+	long long frameIndex = -1;
+	double frameBeginUs = 0.0;
+	double lastFrameEndUs = -1.0;
+	bool keepHistory = false;
+	std::vector<FrameRecord> frames;
+	std::chrono::steady_clock::time_point epoch;
+	FILE *trace = NULL;
+	bool firstEvent = true;
+};
+
+// 作用域计时：构造时beginPass，析构时endPass
+class ProfileScope
+{
+public:
+	ProfileScope(FrameProfiler &profiler, int pass) : profiler(profiler), pass(pass)
+	{
+		profiler.beginPass(pass);
+	}
+	~ProfileScope()
+	{
+		profiler.endPass(pass);
+	}
+	ProfileScope(const ProfileScope &) = delete;
+	ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+	FrameProfiler &profiler;
+	int pass;
+};
+
+#endif
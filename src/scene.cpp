@@ -0,0 +1,381 @@
+#include "scene.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+glm::mat4 SceneObject::model() const
+{
+	glm::mat4 m = glm::mat4(1.0f);
+	m = glm::translate(m, position);	// 平移
+	if (angle != 0.0f)
+		m = glm::rotate(m, glm::radians(angle), axis);	// 旋转
+	if (scale != glm::vec3(1.0f))
+		m = glm::scale(m, scale);
+	return m;
+}
+
+bool SceneObject::sameTransform(const SceneObject &other) const
+{
+	return position == other.position && angle == other.angle && axis == other.axis && scale == other.scale;
+}
+
+int Scene::findMaterial(const std::string &name) const
+{
+	for (size_t i = 0; i < materials.size(); i++)
+		if (materials[i].name == name)
+			return (int)i;
+	return -1;
+}
+
+// 读取n个浮点数，失败返回false
+static bool readFloats(std::istringstream &in, float *values, int n)
+{
+	for (int i = 0; i < n; i++)
+		if (!(in >> values[i]))
+			return false;
+	return true;
+}
+
+static bool readVec3(std::istringstream &in, glm::vec3 &v)
+{
+	float values[3];
+	if (!readFloats(in, values, 3))
+		return false;
+	v = glm::vec3(values[0], values[1], values[2]);
+	return true;
+}
+
+// scale后面可以是1个数（等比缩放）或3个数
+static bool readScale(std::istringstream &in, glm::vec3 &scale)
+{
+	float s;
+	if (!(in >> s))
+		return false;
+	std::streampos mark = in.tellg();
+	float values[2];
+	if (readFloats(in, values, 2))
+	{
+		scale = glm::vec3(s, values[0], values[1]);
+		return true;
+	}
+	in.clear();
+	in.seekg(mark);
+	scale = glm::vec3(s);
+	return true;
+}
+
+static bool parseObject(std::istringstream &in, SceneObject &object)
+{
+	std::string key;
+	while (in >> key)
+	{
+		bool ok = true;
+		if (key == "position")
+			ok = readVec3(in, object.position);
+		else if (key == "rotate")
+			ok = (bool)(in >> object.angle) && readVec3(in, object.axis);
+		else if (key == "scale")
+			ok = readScale(in, object.scale);
+		else if (key == "material")
+			ok = (bool)(in >> object.material);
+		else
+			ok = false;
+		if (!ok)
+			return false;
+	}
+	return !object.material.empty();
+}
+
+bool loadScene(const std::string &path, Scene &scene)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cout << "Failed to open scene file " << path << std::endl;
+		return false;
+	}
+
+	Scene loaded;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+		std::istringstream in(line);
+		std::string kind, name;
+		if (!(in >> kind))
+			continue;	// 空行
+		bool ok = (bool)(in >> name);
+		if (ok && kind == "light")
+		{
+			SceneLight light;
+			light.name = name;
+			std::string key;
+			while (ok && in >> key)
+			{
+				if (key == "position")
+					ok = readVec3(in, light.position);
+				else if (key == "color")
+					ok = readVec3(in, light.color);
+				else
+					ok = false;
+			}
+			loaded.lights.push_back(light);
+		}
+		else if (ok && kind == "material")
+		{
+			Material material;
+			material.name = name;
+			std::string key;
+			while (ok && in >> key)
+			{
+				if (key == "texture")
+					ok = (bool)(in >> material.texturePath);
+				else if (key == "color")
+					ok = readVec3(in, material.color);
+				else
+					ok = false;
+			}
+			ok = ok && !material.texturePath.empty();
+			loaded.materials.push_back(material);
+		}
+		else if (ok && (kind == "cube" || kind == "floor"))
+		{
+			SceneObject object;
+			object.name = name;
+			object.mesh = kind == "cube" ? MESH_CUBE : MESH_FLOOR;
+			ok = parseObject(in, object);
+			loaded.objects.push_back(object);
+		}
+		else
+		{
+			ok = false;
+		}
+		if (!ok)
+		{
+			std::cout << "ERROR::SCENE::PARSE " << path << ":" << lineNumber << ": " << line << std::endl;
+			return false;
+		}
+	}
+
+	// 材质在物体之后定义也可以，所以最后统一检查引用
+	for (const SceneObject &object : loaded.objects)
+	{
+		if (loaded.findMaterial(object.material) < 0)
+		{
+			std::cout << "ERROR::SCENE::UNKNOWN_MATERIAL " << path << ": " << object.name << " uses " << object.material << std::endl;
+			return false;
+		}
+	}
+	if (loaded.lights.empty())
+	{
+		std::cout << "ERROR::SCENE::NO_LIGHT " << path << std::endl;
+		return false;
+	}
+	scene = loaded;
+	return true;
+}
+
+Scene defaultScene()
+{
+	Scene scene;
+	Material box;
+	box.name = "box";
+	box.texturePath = "merry_christmas_mr_Lawrence.jpg";
+	Material floorMaterial;
+	floorMaterial.name = "floor";
+	floorMaterial.texturePath = "floor.jpg";
+	scene.materials = {box, floorMaterial};
+
+	const glm::vec3 cubePositions[] = {
+		glm::vec3( 0.0f,  0.0f,  0.0f),
+		glm::vec3( 2.0f,  5.0f, -15.0f),
+		glm::vec3(-1.5f, -2.2f, -2.5f),
+		glm::vec3(-3.8f, -2.0f, -12.3f),
+		glm::vec3( 2.4f, -0.4f, -3.5f),
+		glm::vec3(-1.7f,  3.0f, -7.5f),
+		glm::vec3( 1.3f, -2.0f, -2.5f),
+		glm::vec3( 1.5f,  2.0f, -2.5f),
+		glm::vec3( 1.5f,  0.2f, -1.5f),
+		glm::vec3(-1.3f,  1.0f, -1.5f)
+	};
+	for (int i = 0; i < 10; i++)
+	{
+		SceneObject cube;
+		cube.name = "cube" + std::to_string(i);
+		cube.position = cubePositions[i];
+		cube.angle = 20.0f * i;
+		cube.axis = glm::vec3(1.0f, 0.3f, 0.5f);
+		cube.material = "box";
+		scene.objects.push_back(cube);
+	}
+	SceneObject floorObject;
+	floorObject.name = "floor";
+	floorObject.mesh = MESH_FLOOR;
+	floorObject.material = "floor";
+	scene.objects.push_back(floorObject);
+
+	SceneLight light;
+	light.name = "main";
+	light.position = glm::vec3(0.5f, 1.0f, 2.0f);
+	scene.lights.push_back(light);
+	return scene;
+}
+
+Scene generateStressScene(int cubes, int lights, unsigned int seed)
+{
+	Scene scene = defaultScene();
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	// 正方体：以原点为中心、边长side的三维网格，每个正方体在自己的格子里随机偏移、随机旋转
+	std::vector<SceneObject> objects;
+	int side = cubes > 0 ? (int)std::ceil(std::cbrt((double)cubes)) : 1;
+	const float spacing = 2.5f, jitter = 0.6f;
+	for (int k = 0; k < cubes; k++)
+	{
+		int x = k % side, y = (k / side) % side, z = k / (side * side);
+		SceneObject cube;
+		cube.name = "stress" + std::to_string(k);
+		cube.position = glm::vec3((x - side * 0.5f) * spacing, y * spacing - 2.0f, (side * 0.5f - z) * spacing) +
+						(glm::vec3(unit(random), unit(random), unit(random)) - 0.5f) * (2.0f * jitter);
+		cube.angle = 360.0f * unit(random);
+		cube.axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + 0.1f);
+		cube.material = "box";
+		objects.push_back(cube);
+	}
+	for (const SceneObject &object : scene.objects)
+		if (object.mesh != MESH_CUBE)
+			objects.push_back(object);
+	scene.objects.swap(objects);
+
+	// 光源：0号保留内置场景的位置（它投射阴影），其余均匀排在场景上方的一圈；
+	// 总亮度按光源数量均分，光源再多画面也不会过曝
+	const glm::vec3 palette[] = {
+		glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.0f, 0.6f, 0.4f), glm::vec3(0.4f, 0.7f, 1.0f),
+		glm::vec3(0.6f, 1.0f, 0.5f), glm::vec3(1.0f, 0.9f, 0.4f), glm::vec3(0.9f, 0.5f, 1.0f)
+	};
+	glm::vec3 first = scene.lights[0].position;
+	scene.lights.clear();
+	for (int i = 0; i < lights; i++)
+	{
+		SceneLight light;
+		light.name = "light" + std::to_string(i);
+		float angle = 6.2831853f * i / lights;
+		light.position = i == 0 ? first : glm::vec3(8.0f * std::cos(angle), 4.0f, 8.0f * std::sin(angle));
+		light.color = palette[i % 6] / (float)lights;
+		scene.lights.push_back(light);
+	}
+	return scene;
+}
+
+void resizeCubes(Scene &scene, int count)
+{
+	std::vector<SceneObject> objects;
+	std::string material = scene.materials.empty() ? std::string() : scene.materials[0].name;
+	int cubes = 0;
+	for (const SceneObject &object : scene.objects)
+	{
+		if (object.mesh == MESH_CUBE)
+		{
+			if (cubes == 0)
+				material = object.material;
+			if (cubes >= count)
+				continue;
+			cubes++;
+		}
+		objects.push_back(object);
+	}
+
+	// 多出来的正方体排成一个三维网格放在场景后方，沿用 20*i 度的旋转规则
+	int extra = count - cubes;
+	int side = extra > 0 ? (int)std::ceil(std::cbrt((double)extra)) : 1;
+	const float spacing = 2.5f;
+	for (int k = 0; k < extra; k++)
+	{
+		int x = k % side, y = (k / side) % side, z = k / (side * side);
+		SceneObject cube;
+		cube.name = "grid" + std::to_string(k);
+		cube.position = glm::vec3((x - side * 0.5f) * spacing, y * spacing - 2.0f, -20.0f - z * spacing);
+		cube.angle = 20.0f * (cubes + k);
+		cube.axis = glm::vec3(1.0f, 0.3f, 0.5f);
+		cube.material = material;
+		objects.push_back(cube);
+	}
+	scene.objects.swap(objects);
+}
+
+SceneDiff diffScenes(const Scene &oldScene, const Scene &newScene)
+{
+	SceneDiff diff;
+
+	// 光源很少，有变化就整体更新
+	if (oldScene.lights.size() != newScene.lights.size())
+		diff.lightsChanged = true;
+	else
+		for (size_t i = 0; i < newScene.lights.size(); i++)
+		{
+			const SceneLight &a = oldScene.lights[i], &b = newScene.lights[i];
+			if (a.name != b.name || a.position != b.position || a.color != b.color)
+				diff.lightsChanged = true;
+		}
+
+	// 材质按名字匹配
+	for (size_t i = 0; i < newScene.materials.size(); i++)
+	{
+		int old = oldScene.findMaterial(newScene.materials[i].name);
+		if (old != (int)i)
+			diff.materialsChanged = true;
+		if (old < 0)
+			continue;
+		if (oldScene.materials[old].texturePath != newScene.materials[i].texturePath ||
+			oldScene.materials[old].color != newScene.materials[i].color)
+			diff.changedMaterials.push_back((int)i);
+	}
+	for (const Material &material : oldScene.materials)
+		if (newScene.findMaterial(material.name) < 0)
+			diff.materialsChanged = true;
+	// 实例按材质分组排布，材质增删后分组也要重排
+	if (diff.materialsChanged)
+		diff.layoutChanged = true;
+
+	// 物体按名字匹配，在文件里插入、删除或挪动一行不影响其他物体。两边的名字一一对应、网格和材质都相同时
+	// 只可能是变换改了；有物体增删、换网格或材质，或者名字重复对不上时重新排布
+	if (oldScene.objects.size() != newScene.objects.size())
+		diff.layoutChanged = true;
+	std::unordered_map<std::string, int> oldIndex;
+	for (size_t i = 0; i < oldScene.objects.size() && !diff.layoutChanged; i++)
+		if (!oldIndex.emplace(oldScene.objects[i].name, (int)i).second)
+			diff.layoutChanged = true;
+	for (size_t i = 0; i < newScene.objects.size() && !diff.layoutChanged; i++)
+	{
+		const SceneObject &b = newScene.objects[i];
+		auto found = oldIndex.find(b.name);
+		// 匹配过的名字置为-1，新场景里重复的名字就找不到了
+		if (found == oldIndex.end() || found->second < 0)
+		{
+			diff.layoutChanged = true;
+			break;
+		}
+		const SceneObject &a = oldScene.objects[found->second];
+		diff.oldObjects.push_back(found->second);
+		found->second = -1;
+		if (a.mesh != b.mesh || a.material != b.material)
+			diff.layoutChanged = true;
+		else if (!a.sameTransform(b))
+			diff.movedObjects.push_back((int)i);
+	}
+	if (diff.layoutChanged)
+	{
+		diff.movedObjects.clear();
+		diff.oldObjects.clear();
+	}
+	return diff;
+}
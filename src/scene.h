@@ -0,0 +1,85 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// 场景描述：物体、变换、材质、光源。
+// 场景文件是按行的文本格式，'#'开头为注释，每行一条记录，所有记录都有名字，热重载时按名字比较新旧场景：
+//   light    <name> position x y z [color r g b]
+//   material <name> texture <path> [color r g b]
+//   cube     <name> position x y z [rotate deg ax ay az] [scale s | scale sx sy sz] material <name>
+//   floor    <name> [position x y z] [rotate deg ax ay az] [scale ...] material <name>
+
+enum MeshType
+{
+	MESH_CUBE,		// 36个顶点的正方体，实例化绘制
+	MESH_FLOOR		// 50x50的地板平面
+};
+
+struct Material
+{
+	std::string name;
+	std::string texturePath;
+	glm::vec3 color = glm::vec3(1.0f);
+};
+
+struct SceneObject
+{
+	std::string name;
+	MeshType mesh = MESH_CUBE;
+	glm::vec3 position = glm::vec3(0.0f);
+	float angle = 0.0f;						// 旋转角度（度）
+	glm::vec3 axis = glm::vec3(1.0f, 0.0f, 0.0f);
+	glm::vec3 scale = glm::vec3(1.0f);
+	std::string material;
+
+	glm::mat4 model() const;
+	bool sameTransform(const SceneObject &other) const;
+};
+
+struct SceneLight
+{
+	std::string name;
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::vec3 color = glm::vec3(1.0f);
+};
+
+struct Scene
+{
+	std::vector<Material> materials;
+	std::vector<SceneObject> objects;
+	std::vector<SceneLight> lights;
+
+	int findMaterial(const std::string &name) const;
+};
+
+// 解析场景文件；出错时打印文件名和行号并返回false，scene保持不变
+bool loadScene(const std::string &path, Scene &scene);
+// 没有场景文件时使用的内置场景：10个正方体 + 地板 + 一个白色点光源
+Scene defaultScene();
+// 压力测试场景：cubes个正方体排在带随机扰动的三维网格上，lights个彩色点光源，同一个seed生成的场景完全相同
+Scene generateStressScene(int cubes, int lights, unsigned int seed);
+// 把正方体数量补足到count个（多出的排成网格放在场景后方）或截断到count个，用于压力测试
+void resizeCubes(Scene &scene, int count);
+
+// 两个场景之间的差异，用于热重载时只更新改动的部分
+struct SceneDiff
+{
+	bool layoutChanged = false;				// 物体增删、改名、换网格或换材质：需要重新排布实例缓冲
+	std::vector<int> movedObjects;			// 只改了变换的物体（新场景中的下标）
+	std::vector<int> oldObjects;			// 不需要重新排布时，新场景每个物体在旧场景中的下标（物体可能调整了顺序）
+	std::vector<int> changedMaterials;		// 纹理或颜色改变的材质（新场景中的下标）
+	bool materialsChanged = false;			// 材质增删、改名或调整顺序（实例分组按材质的下标）
+	bool lightsChanged = false;
+
+	bool empty() const
+	{
+		return !layoutChanged && movedObjects.empty() && changedMaterials.empty() && !materialsChanged && !lightsChanged;
+	}
+};
+
+SceneDiff diffScenes(const Scene &oldScene, const Scene &newScene);
+
+#endif
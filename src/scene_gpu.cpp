@@ -0,0 +1,313 @@
+#include "scene_gpu.h"
+#include "normal_matrix.h"
+#include "uniform_blocks.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stb/stb_image.h>
+
+GLuint loadTexture(const std::string &path)
+{
+	// 产生纹理对象(也是通过ID引用的！)
+	unsigned int texture;
+	glGenTextures(1, &texture);	//  参数一：需要生成纹理的数量；参数二：指定生成的纹理保存在哪里
+	// 绑定纹理对象
+	glBindTexture(GL_TEXTURE_2D, texture);	//让之后任何的纹理指令都可以配置当前绑定的纹理
+
+	// 为当前绑定的纹理对象设置环绕、过滤方式
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);	// 多级渐远纹理
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// 纹理图片导入，统一转成3通道
+	int width, height, nrChannels;
+	unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrChannels, 3);
+	if (data)
+	{
+		// 用载入的图片数据生成纹理，再自动生成所有需要的多级渐远纹理
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	else
+	{
+		std::cout << "Failed to load texture " << path << std::endl;
+	}
+	// 生成了纹理和相应的多级渐远纹理后，释放图像的内存
+	stbi_image_free(data);
+	return texture;
+}
+
+SceneGpu::~SceneGpu()
+{
+	destroy();
+}
+
+void SceneGpu::init(const Scene &scene, GLuint cubeVAO)
+{
+	vao = cubeVAO;
+	glGenBuffers(1, &modelVBO);
+	glGenBuffers(1, &normalVBO);
+	glGenBuffers(1, &casterVBO);
+	glGenBuffers(1, &materialUBO);
+	// glBindBufferRange的偏移必须是GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT的倍数
+	GLint alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	materialStride = ((GLsizeiptr)sizeof(MaterialData) + alignment - 1) / alignment * alignment;
+
+	// 每个正方体的model矩阵，一个mat4占4个vec4属性(location 3~6)，法线矩阵占3个vec3(location 7~9)。
+	// 属性除数设为1表示每个实例前进一次，而不是每个顶点
+	glBindVertexArray(vao);
+	for (int column = 0; column < 4; column++)
+	{
+		glEnableVertexAttribArray(3 + column);
+		glVertexAttribDivisor(3 + column, 1);
+	}
+	for (int column = 0; column < 3; column++)
+	{
+		glEnableVertexAttribArray(7 + column);
+		glVertexAttribDivisor(7 + column, 1);
+	}
+
+	for (const Material &material : scene.materials)
+	{
+		textures.push_back(loadTexture(material.texturePath));
+		colors.push_back(material.color);
+		texturePaths.push_back(material.texturePath);
+	}
+	uploadMaterials();
+	rebuildLayout(scene);
+}
+
+void SceneGpu::destroy()
+{
+	if (!modelVBO)
+		return;
+	glDeleteBuffers(1, &modelVBO);
+	glDeleteBuffers(1, &normalVBO);
+	glDeleteBuffers(1, &casterVBO);
+	glDeleteBuffers(1, &materialUBO);
+	glDeleteTextures((GLsizei)textures.size(), textures.data());
+	modelVBO = normalVBO = casterVBO = materialUBO = 0;
+	textures.clear();
+}
+
+void SceneGpu::uploadMaterials()
+{
+	// 材质很少，改动时整块重写
+	std::vector<char> data(colors.size() * materialStride, 0);
+	for (size_t i = 0; i < colors.size(); i++)
+	{
+		MaterialData material;
+		material.objectColor = glm::vec4(colors[i], 1.0f);
+		memcpy(&data[i * materialStride], &material, sizeof(material));
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, materialUBO);
+	glBufferData(GL_UNIFORM_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
+}
+
+void SceneGpu::bindMaterial(int material) const
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_UNIFORM_BINDING, materialUBO, material * materialStride, sizeof(MaterialData));
+}
+
+void SceneGpu::bindInstanceRange(GLsizei first) const
+{
+	glBindBuffer(GL_ARRAY_BUFFER, modelVBO);
+	for (int column = 0; column < 4; column++)
+		glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+							  (void *)(first * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+	glBindBuffer(GL_ARRAY_BUFFER, normalVBO);
+	for (int column = 0; column < 3; column++)
+		glVertexAttribPointer(7 + column, 3, GL_FLOAT, GL_FALSE, sizeof(glm::mat3),
+							  (void *)(first * sizeof(glm::mat3) + column * sizeof(glm::vec3)));
+}
+
+void SceneGpu::uploadCasterInstances(const std::vector<GLsizei> &cubes)
+{
+	casterModels.resize(cubes.size());
+	for (size_t i = 0; i < cubes.size(); i++)
+		casterModels[i] = cubeModels[cubes[i]];
+	glBindBuffer(GL_ARRAY_BUFFER, casterVBO);
+	glBufferData(GL_ARRAY_BUFFER, casterModels.size() * sizeof(glm::mat4), casterModels.data(), GL_STREAM_DRAW);
+}
+
+void SceneGpu::bindCasterInstances() const
+{
+	glBindBuffer(GL_ARRAY_BUFFER, casterVBO);
+	for (int column = 0; column < 4; column++)
+		glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(column * sizeof(glm::vec4)));
+}
+
+void SceneGpu::attachDepthVAO(GLuint depthVAO, GLuint divisor)
+{
+	// 深度着色器只读model矩阵，法线矩阵（7~9号）不挂
+	glBindVertexArray(depthVAO);
+	for (int column = 0; column < 4; column++)
+	{
+		glEnableVertexAttribArray(3 + column);
+		glVertexAttribDivisor(3 + column, divisor);
+	}
+	bindInstanceRange(0);
+}
+
+void SceneGpu::rebuildLayout(const Scene &scene)
+{
+	// 按材质做一次计数排序，同一材质的正方体在实例缓冲里连续存放
+	std::vector<GLsizei> perMaterial(scene.materials.size(), 0);
+	for (const SceneObject &object : scene.objects)
+		if (object.mesh == MESH_CUBE)
+			perMaterial[scene.findMaterial(object.material)]++;
+
+	cubeGroups.clear();
+	std::vector<GLsizei> cursor(scene.materials.size(), 0);
+	GLsizei total = 0;
+	for (size_t material = 0; material < perMaterial.size(); material++)
+	{
+		cursor[material] = total;
+		if (perMaterial[material] > 0)
+			cubeGroups.push_back({(int)material, total, perMaterial[material]});
+		total += perMaterial[material];
+	}
+
+	cubeModels.assign(total, glm::mat4(1.0f));
+	slotOfObject.assign(scene.objects.size(), -1);
+	otherDraws.clear();
+	for (size_t i = 0; i < scene.objects.size(); i++)
+	{
+		const SceneObject &object = scene.objects[i];
+		int material = scene.findMaterial(object.material);
+		if (object.mesh == MESH_CUBE)
+		{
+			GLsizei slot = cursor[material]++;
+			slotOfObject[i] = slot;
+			cubeModels[slot] = object.model();
+		}
+		else
+		{
+			glm::mat4 model = object.model();
+			otherDraws.push_back({(int)i, material, model, normalMatrix(model)});
+		}
+	}
+	cubeNormals.resize(cubeModels.size());
+	computeNormalMatrices(cubeModels.data(), cubeNormals.data(), cubeModels.size());
+
+	glBindBuffer(GL_ARRAY_BUFFER, modelVBO);
+	glBufferData(GL_ARRAY_BUFFER, cubeModels.size() * sizeof(glm::mat4), cubeModels.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, normalVBO);
+	glBufferData(GL_ARRAY_BUFFER, cubeNormals.size() * sizeof(glm::mat3), cubeNormals.data(), GL_STATIC_DRAW);
+	glBindVertexArray(vao);
+	bindInstanceRange(0);
+}
+
+void SceneGpu::uploadSlots(const std::vector<GLsizei> &slots)
+{
+	// 相邻的槽位合并成一段，一次glBufferSubData
+	glBindBuffer(GL_ARRAY_BUFFER, modelVBO);
+	for (size_t begin = 0; begin < slots.size();)
+	{
+		size_t end = begin + 1;
+		while (end < slots.size() && slots[end] == slots[end - 1] + 1)
+			end++;
+		GLsizei first = slots[begin], count = (GLsizei)(end - begin);
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(glm::mat4), count * sizeof(glm::mat4), &cubeModels[first]);
+		begin = end;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, normalVBO);
+	for (size_t begin = 0; begin < slots.size();)
+	{
+		size_t end = begin + 1;
+		while (end < slots.size() && slots[end] == slots[end - 1] + 1)
+			end++;
+		GLsizei first = slots[begin], count = (GLsizei)(end - begin);
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(glm::mat3), count * sizeof(glm::mat3), &cubeNormals[first]);
+		begin = end;
+	}
+}
+
+SceneGpu::UpdateStats SceneGpu::apply(const Scene &oldScene, const Scene &newScene, const SceneDiff &diff)
+{
+	UpdateStats stats;
+
+	// 材质：按名字复用旧纹理，只有纹理路径变了或新增的材质才加载图片
+	if (diff.materialsChanged || !diff.changedMaterials.empty())
+	{
+		std::vector<GLuint> newTextures(newScene.materials.size(), 0);
+		std::vector<bool> reused(textures.size(), false);
+		for (size_t i = 0; i < newScene.materials.size(); i++)
+		{
+			const Material &material = newScene.materials[i];
+			int old = oldScene.findMaterial(material.name);
+			if (old >= 0 && texturePaths[old] == material.texturePath)
+			{
+				newTextures[i] = textures[old];
+				reused[old] = true;
+			}
+			else
+			{
+				newTextures[i] = loadTexture(material.texturePath);
+				stats.reloadedTextures++;
+			}
+		}
+		for (size_t old = 0; old < textures.size(); old++)
+			if (!reused[old])
+				glDeleteTextures(1, &textures[old]);
+		textures.swap(newTextures);
+		colors.clear();
+		texturePaths.clear();
+		for (const Material &material : newScene.materials)
+		{
+			colors.push_back(material.color);
+			texturePaths.push_back(material.texturePath);
+		}
+		uploadMaterials();
+	}
+
+	if (diff.layoutChanged)
+	{
+		rebuildLayout(newScene);
+		stats.rebuilt = true;
+		return stats;
+	}
+
+	// 物体可能调整了顺序：槽位和逐个绘制的物体跟着物体走，换成新场景中的下标
+	std::vector<GLsizei> newSlots(newScene.objects.size());
+	std::vector<int> newIndex(oldScene.objects.size());
+	for (size_t i = 0; i < newScene.objects.size(); i++)
+	{
+		newSlots[i] = slotOfObject[diff.oldObjects[i]];
+		newIndex[diff.oldObjects[i]] = (int)i;
+	}
+	slotOfObject.swap(newSlots);
+	for (ObjectDraw &draw : otherDraws)
+		draw.object = newIndex[draw.object];
+
+	// 只移动了的物体：正方体重写实例缓冲中它的槽位，其他物体更新CPU端的矩阵
+	std::vector<GLsizei> slots;
+	for (int i : diff.movedObjects)
+	{
+		const SceneObject &object = newScene.objects[i];
+		glm::mat4 model = object.model();
+		if (slotOfObject[i] >= 0)
+		{
+			GLsizei slot = slotOfObject[i];
+			cubeModels[slot] = model;
+			cubeNormals[slot] = normalMatrix(model);
+			slots.push_back(slot);
+		}
+		else
+		{
+			for (ObjectDraw &draw : otherDraws)
+				if (draw.object == i)
+				{
+					draw.model = model;
+					draw.normal = normalMatrix(model);
+				}
+		}
+	}
+	std::sort(slots.begin(), slots.end());
+	uploadSlots(slots);
+	stats.updatedInstances = (int)slots.size();
+	return stats;
+}
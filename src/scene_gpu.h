@@ -0,0 +1,97 @@
+#ifndef SCENE_GPU_H
+#define SCENE_GPU_H
+
+#include <glad/glad.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "scene.h"
+
+// 场景在GPU上的数据
+// 正方体的model矩阵和法线矩阵放在两个实例缓冲里，按材质分组连续排布，每组一次实例化绘制；
+// 地板这类数量很少的物体逐个绘制。每个材质对应一张纹理和材质uniform缓冲里的一段。
+// 热重载时根据SceneDiff只更新改动的部分：移动的正方体只重写它们在实例缓冲里的那几段，
+// 纹理只在路径改变时重新加载。
+class SceneGpu
+{
+public:
+	struct CubeGroup
+	{
+		int material;		// 在Scene::materials中的下标
+		GLsizei first;		// 组内第一个实例
+		GLsizei count;
+	};
+
+	struct ObjectDraw
+	{
+		int object;			// 在Scene::objects中的下标
+		int material;
+		glm::mat4 model;
+		glm::mat3 normal;
+	};
+
+	// 热重载时的更新统计
+	struct UpdateStats
+	{
+		bool rebuilt = false;			// 实例缓冲整体重排
+		int updatedInstances = 0;		// 只重写了变换的实例数
+		int reloadedTextures = 0;
+	};
+
+	SceneGpu() = default;
+	~SceneGpu();
+	SceneGpu(const SceneGpu &) = delete;
+	SceneGpu &operator=(const SceneGpu &) = delete;
+
+	// 创建实例缓冲并挂到cubeVAO的3~9号属性上，加载所有材质纹理
+	void init(const Scene &scene, GLuint cubeVAO);
+	UpdateStats apply(const Scene &oldScene, const Scene &newScene, const SceneDiff &diff);
+	void destroy();
+
+	GLsizei cubeCount() const { return (GLsizei)cubeModels.size(); }
+	const std::vector<CubeGroup> &groups() const { return cubeGroups; }
+	// 按实例顺序排列的矩阵，逐个绘制时使用
+	const std::vector<glm::mat4> &models() const { return cubeModels; }
+	const std::vector<glm::mat3> &normals() const { return cubeNormals; }
+	const std::vector<ObjectDraw> &objectDraws() const { return otherDraws; }
+
+	GLuint texture(int material) const { return textures[material]; }
+	const glm::vec3 &color(int material) const { return colors[material]; }
+	// 把材质在uniform缓冲里的那一段绑到MATERIAL_UNIFORM_BINDING
+	void bindMaterial(int material) const;
+
+	// 把3~9号实例属性指向第first个实例开始的数据（OpenGL 3.3没有baseInstance），需要先绑定cubeVAO
+	void bindInstanceRange(GLsizei first) const;
+	// 把model矩阵的实例属性（3~6号）也挂到只有位置的深度VAO上，每divisor个实例前进一次：
+	// 级联阴影的深度pass把每个正方体画级联数次（每个级联一次），除数就是级联数
+	void attachDepthVAO(GLuint depthVAO, GLuint divisor);
+	// 深度pass只画没被剔除的投射者：把这些正方体（实例下标）的model矩阵按顺序写进单独的投射者缓冲
+	void uploadCasterInstances(const std::vector<GLsizei> &cubes);
+	// 把3~6号实例属性（model矩阵）指向投射者缓冲，需要先绑定深度VAO；不剔除时用bindInstanceRange(0)指回实例缓冲
+	void bindCasterInstances() const;
+
+private:
+	void rebuildLayout(const Scene &scene);
+	void uploadSlots(const std::vector<GLsizei> &slots);
+	void uploadMaterials();
+
+	GLuint vao = 0;
+	GLuint modelVBO = 0;
+	GLuint normalVBO = 0;
+	GLuint casterVBO = 0;
+	std::vector<glm::mat4> casterModels;
+	std::vector<glm::mat4> cubeModels;
+	std::vector<glm::mat3> cubeNormals;
+	std::vector<GLsizei> slotOfObject;		// 物体 -> 实例槽位，非正方体为-1
+	std::vector<CubeGroup> cubeGroups;
+	std::vector<ObjectDraw> otherDraws;
+	std::vector<GLuint> textures;			// 与Scene::materials一一对应
+	std::vector<glm::vec3> colors;
+	std::vector<std::string> texturePaths;
+	GLuint materialUBO = 0;				// 每个材质一份MaterialData，间隔materialStride字节
+	GLsizeiptr materialStride = 0;
+};
+
+// 加载一张RGB纹理，带多级渐远纹理；失败时打印错误并返回一个没有数据的纹理对象
+GLuint loadTexture(const std::string &path);
+
+#endif
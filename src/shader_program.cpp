@@ -0,0 +1,132 @@
+#include "shader_program.h"
+#include <iostream>
+#include <vector>
+
+ShaderProgram::~ShaderProgram()
+{
+	destroy();
+}
+
+bool ShaderProgram::compile(GLuint shader, const char *source, const char *stage)
+{
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	// 查看编译是否成功
+	int success;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		char infoLog[512];
+		glGetShaderInfoLog(shader, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::" << stage << "::COMPILATION_FAILED (" << programName << ")\n"
+				  << infoLog << std::endl;
+	}
+	return success;
+}
+
+bool ShaderProgram::build(const char *name, const char *vertexSource, const char *fragmentSource, const char *geometrySource)
+{
+	destroy();
+	programName = name;
+
+	unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	unsigned int geometryShader = geometrySource ? glCreateShader(GL_GEOMETRY_SHADER) : 0;
+	bool compiled = compile(vertexShader, vertexSource, "VERTEX");
+	compiled = compile(fragmentShader, fragmentSource, "FRAGMENT") && compiled;
+	if (geometryShader)
+		compiled = compile(geometryShader, geometrySource, "GEOMETRY") && compiled;
+
+	// 把顶点着色器与片段着色器（以及几何着色器）链接成完整的着色器程序
+	program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	if (geometryShader)
+		glAttachShader(program, geometryShader);
+	glLinkProgram(program);
+	int success;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		char infoLog[512];
+		glGetProgramInfoLog(program, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED (" << programName << ")\n"
+				  << infoLog << std::endl;
+	}
+	// 链接完成后着色器对象就不再需要了
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	if (geometryShader)
+		glDeleteShader(geometryShader);
+
+	if (!compiled || !success)
+	{
+		destroy();
+		return false;
+	}
+	reflect();
+	return true;
+}
+
+void ShaderProgram::reflect()
+{
+	activeUniforms.clear();
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+	for (GLint i = 0; i < count; i++)
+	{
+		UniformInfo info;
+		GLsizei length = 0;
+		glGetActiveUniform(program, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &info.size, &info.type, nameBuffer.data());
+		std::string uniformName(nameBuffer.data(), length);
+		// uniform块里的成员没有位置，跳过
+		info.location = glGetUniformLocation(program, uniformName.c_str());
+		if (info.location < 0)
+			continue;
+		// 数组报告为"name[0]"，登记为不带下标的名字
+		if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+			uniformName.erase(uniformName.size() - 3);
+		activeUniforms[uniformName] = info;
+	}
+}
+
+void ShaderProgram::destroy()
+{
+	if (program)
+		glDeleteProgram(program);
+	program = 0;
+	activeUniforms.clear();
+}
+
+GLint ShaderProgram::uniform(const char *name) const
+{
+	auto it = activeUniforms.find(name);
+	return it == activeUniforms.end() ? -1 : it->second.location;
+}
+
+void ShaderProgram::setSampler(const char *name, int unit) const
+{
+	GLint location = uniform(name);
+	if (location < 0)
+		return;
+	use();
+	glUniform1i(location, unit);
+}
+
+bool ShaderProgram::bindUniformBlock(const char *blockName, GLuint binding, GLint expectedSize) const
+{
+	GLuint index = glGetUniformBlockIndex(program, blockName);
+	if (index == GL_INVALID_INDEX)
+		return false;
+	GLint size = 0;
+	glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+	if (size != expectedSize)
+	{
+		std::cout << "ERROR::SHADER::UNIFORM_BLOCK_SIZE (" << programName << ") " << blockName << " is " << size
+				  << " bytes, expected " << expectedSize << std::endl;
+	}
+	glUniformBlockBinding(program, index, binding);
+	return true;
+}
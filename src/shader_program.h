@@ -0,0 +1,50 @@
+#ifndef SHADER_PROGRAM_H
+#define SHADER_PROGRAM_H
+
+#include <glad/glad.h>
+#include <string>
+#include <unordered_map>
+
+// 着色器程序：编译、链接，并在链接时用glGetActiveUniform反射出所有活动的uniform。
+// 渲染循环里不再调用glGetUniformLocation，只使用初始化时解析好的位置。
+class ShaderProgram
+{
+public:
+	struct UniformInfo
+	{
+		GLint location = -1;
+		GLenum type = 0;
+		GLint size = 0;		// 数组元素个数，非数组为1
+	};
+
+	ShaderProgram() = default;
+	~ShaderProgram();
+	ShaderProgram(const ShaderProgram &) = delete;
+	ShaderProgram &operator=(const ShaderProgram &) = delete;
+
+	// name只用于出错信息；编译或链接失败时打印日志并返回false。geometrySource为NULL时没有几何着色器
+	bool build(const char *name, const char *vertexSource, const char *fragmentSource, const char *geometrySource = NULL);
+	void destroy();
+
+	void use() const { glUseProgram(program); }
+	GLuint id() const { return program; }
+
+	// 链接后解析好的uniform位置，着色器中不存在（或被编译器优化掉）时返回-1，glUniform*会忽略-1
+	GLint uniform(const char *name) const;
+	const std::unordered_map<std::string, UniformInfo> &uniforms() const { return activeUniforms; }
+	// 采样器绑定的纹理单元只需在链接后设置一次
+	void setSampler(const char *name, int unit) const;
+	// 把uniform块绑到固定的绑定点；块不存在（或被优化掉）时返回false。
+	// expectedSize是C++端结构体的大小，与驱动报告的块大小不一致时说明两边的布局对不上，打印错误
+	bool bindUniformBlock(const char *blockName, GLuint binding, GLint expectedSize) const;
+
+private:
+	bool compile(GLuint shader, const char *source, const char *stage);
+	void reflect();
+
+	GLuint program = 0;
+	std::string programName;
+	std::unordered_map<std::string, UniformInfo> activeUniforms;
+};
+
+#endif
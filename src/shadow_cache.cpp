@@ -0,0 +1,26 @@
+#include "shadow_cache.h"
+#include <algorithm>
+
+bool ShadowCache::needsUpdate(const glm::mat4 *lightSpaceMatrices, int count, unsigned int casterVersion, unsigned long long casterSet,
+							  int width, int height)
+{
+	bool hit = enabled && valid &&
+			   cachedMatrices.size() == (size_t)count &&
+			   std::equal(cachedMatrices.begin(), cachedMatrices.end(), lightSpaceMatrices) &&
+			   cachedVersion == casterVersion &&
+			   cachedSet == casterSet &&
+			   cachedWidth == width && cachedHeight == height;
+	if (hit)
+	{
+		skipped++;
+		return false;
+	}
+	valid = true;
+	cachedMatrices.assign(lightSpaceMatrices, lightSpaceMatrices + count);
+	cachedVersion = casterVersion;
+	cachedSet = casterSet;
+	cachedWidth = width;
+	cachedHeight = height;
+	executed++;
+	return true;
+}
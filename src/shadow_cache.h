@@ -0,0 +1,34 @@
+#ifndef SHADOW_CACHE_H
+#define SHADOW_CACHE_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// 阴影贴图缓存
+// 光源和投射阴影的物体都不动时，每帧重画一遍深度贴图是纯粹的浪费。
+// 这里记住上一次渲染深度贴图时的光源变换矩阵（每个级联一个）、投射者几何体的版本号、
+// 剔除后留下的投射者集合（的哈希）和贴图分辨率，都没变就跳过深度pass，继续使用上一帧留在depthMap里的结果。
+class ShadowCache
+{
+public:
+	// 本帧是否需要重新渲染深度贴图；返回true时调用者必须真的去渲染，缓存随即视为有效
+	bool needsUpdate(const glm::mat4 *lightSpaceMatrices, int count, unsigned int casterVersion, unsigned long long casterSet,
+					 int width, int height);
+	void setEnabled(bool enable) { enabled = enable; }
+
+	unsigned long long executedPasses() const { return executed; }
+	unsigned long long skippedPasses() const { return skipped; }
+
+private:
+	bool enabled = true;
+	bool valid = false;
+	std::vector<glm::mat4> cachedMatrices;
+	unsigned int cachedVersion = 0;
+	unsigned long long cachedSet = 0;
+	int cachedWidth = 0;
+	int cachedHeight = 0;
+	unsigned long long executed = 0;
+	unsigned long long skipped = 0;
+};
+
+#endif
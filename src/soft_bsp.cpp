@@ -0,0 +1,326 @@
+#include "soft_bsp.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+// ------------------------建树----------------------------
+
+// 选分割平面时试的候选数，以及给每个候选估价时抽查的片数
+static const int BSP_CANDIDATES = 8;
+static const size_t BSP_SAMPLES = 256;
+// 到平面的距离在这个范围内算作在平面上（世界坐标，场景的尺度在几十以内）
+static const float BSP_EPSILON = 1e-4f;
+
+enum BspSide
+{
+	BSP_ON = 0,
+	BSP_FRONT = 1,
+	BSP_BACK = 2,
+	BSP_SPANNING = BSP_FRONT | BSP_BACK
+};
+
+static bool trianglePlane(const SoftTriangle &triangle, glm::vec4 &plane)
+{
+	const glm::vec3 &p0 = triangle.v[0].position, &p1 = triangle.v[1].position, &p2 = triangle.v[2].position;
+	glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+	float length = glm::length(n);
+	if (!(length > 1e-12f))
+		return false;	// 退化的三角形定不出平面
+	n /= length;
+	plane = glm::vec4(n, -glm::dot(n, p0));
+	return true;
+}
+
+static int classify(const glm::vec4 &plane, const BspFragment &fragment, float *distance)
+{
+	int side = BSP_ON;
+	for (int k = 0; k < 3; k++)
+	{
+		distance[k] = glm::dot(glm::vec3(plane), fragment.position[k]) + plane.w;
+		if (distance[k] > BSP_EPSILON)
+			side |= BSP_FRONT;
+		else if (distance[k] < -BSP_EPSILON)
+			side |= BSP_BACK;
+	}
+	return side;
+}
+
+// 把跨平面的片切成正面、背面两个凸多边形（各3~4个顶点），再按扇形拆成三角形
+static void splitFragment(const BspFragment &fragment, const float *distance, std::vector<BspFragment> &front,
+						  std::vector<BspFragment> &back)
+{
+	glm::vec3 position[2][4], bary[2][4];
+	int count[2] = {0, 0};
+	for (int i = 0; i < 3; i++)
+	{
+		int j = (i + 1) % 3;
+		float di = distance[i], dj = distance[j];
+		// 在平面上的顶点两边都要
+		if (di >= -BSP_EPSILON)
+		{
+			position[0][count[0]] = fragment.position[i];
+			bary[0][count[0]++] = fragment.bary[i];
+		}
+		if (di <= BSP_EPSILON)
+		{
+			position[1][count[1]] = fragment.position[i];
+			bary[1][count[1]++] = fragment.bary[i];
+		}
+		if ((di > BSP_EPSILON && dj < -BSP_EPSILON) || (di < -BSP_EPSILON && dj > BSP_EPSILON))
+		{
+			// 两边用同一个交点，切开后的两片沿切线严丝合缝
+			float t = di / (di - dj);
+			glm::vec3 p = glm::mix(fragment.position[i], fragment.position[j], t);
+			glm::vec3 b = glm::mix(fragment.bary[i], fragment.bary[j], t);
+			for (int s = 0; s < 2; s++)
+			{
+				position[s][count[s]] = p;
+				bary[s][count[s]++] = b;
+			}
+		}
+	}
+	for (int s = 0; s < 2; s++)
+		for (int k = 1; k + 1 < count[s]; k++)
+		{
+			BspFragment piece;
+			const int index[3] = {0, k, k + 1};
+			for (int v = 0; v < 3; v++)
+			{
+				piece.position[v] = position[s][index[v]];
+				piece.bary[v] = bary[s][index[v]];
+			}
+			piece.source = fragment.source;
+			(s == 0 ? front : back).push_back(piece);
+		}
+}
+
+// 从几个均匀分布的候选片里挑分割平面：抽查一部分片，切开的越少、两边越平衡越好。
+// 片的平面取源三角形的平面，切得很细的片自己算出的法线误差太大；返回选中的片，没有可用的平面时返回-1
+static int chooseSplitter(const std::vector<BspFragment> &fragments, const std::vector<glm::vec4> &planes,
+						  const std::vector<unsigned char> &valid)
+{
+	size_t step = std::max<size_t>(1, fragments.size() / BSP_SAMPLES);
+	float bestScore = 0.0f;
+	int best = -1;
+	for (int c = 0; c < BSP_CANDIDATES; c++)
+	{
+		int candidate = (int)(fragments.size() * c / BSP_CANDIDATES);
+		if (!valid[fragments[candidate].source])
+			continue;
+		const glm::vec4 &plane = planes[fragments[candidate].source];
+		int front = 0, back = 0, spanning = 0;
+		for (size_t i = 0; i < fragments.size(); i += step)
+		{
+			float distance[3];
+			int side = classify(plane, fragments[i], distance);
+			front += side == BSP_FRONT;
+			back += side == BSP_BACK;
+			spanning += side == BSP_SPANNING;
+		}
+		float score = (float)std::abs(front - back) + 8.0f * spanning;
+		if (best < 0 || score < bestScore)
+		{
+			best = candidate;
+			bestScore = score;
+		}
+	}
+	if (best >= 0)
+		return best;
+	// 候选都退化时找第一个能定出平面的片
+	for (size_t i = 0; i < fragments.size(); i++)
+		if (valid[fragments[i].source])
+			return (int)i;
+	return -1;
+}
+
+void BspTree::build(const std::vector<SoftTriangle> &triangles, size_t count)
+{
+	treeNodes.clear();
+	treeFragments.clear();
+	sources = count;
+	splits = 0;
+
+	struct BuildTask
+	{
+		std::vector<BspFragment> fragments;
+		int parent;
+		bool front;
+	};
+	std::vector<BuildTask> stack(1);
+	stack[0].parent = -1;
+	stack[0].front = false;
+	stack[0].fragments.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		BspFragment &fragment = stack[0].fragments[i];
+		for (int k = 0; k < 3; k++)
+		{
+			fragment.position[k] = triangles[i].v[k].position;
+			fragment.bary[k] = glm::vec3(k == 0, k == 1, k == 2);
+		}
+		fragment.source = (unsigned int)i;
+	}
+	if (count == 0)
+		return;
+	std::vector<glm::vec4> planes(count);
+	std::vector<unsigned char> valid(count);
+	for (size_t i = 0; i < count; i++)
+		valid[i] = trianglePlane(triangles[i], planes[i]);
+
+	// 用显式的栈代替递归，退化的场景树很深时也不会爆栈
+	while (!stack.empty())
+	{
+		BuildTask task = std::move(stack.back());
+		stack.pop_back();
+		int index = (int)treeNodes.size();
+		treeNodes.push_back(Node());
+		if (task.parent >= 0)
+			(task.front ? treeNodes[task.parent].front : treeNodes[task.parent].back) = index;
+
+		glm::vec4 plane(0.0f, 1.0f, 0.0f, 0.0f);
+		std::vector<BspFragment> coplanar, front, back;
+		int splitter = chooseSplitter(task.fragments, planes, valid);
+		if (splitter < 0)
+			coplanar.swap(task.fragments);	// 全是退化的片，直接放在这个节点上
+		else
+			plane = planes[task.fragments[splitter].source];
+		for (size_t i = 0; i < task.fragments.size(); i++)
+		{
+			const BspFragment &fragment = task.fragments[i];
+			float distance[3];
+			int side = classify(plane, fragment, distance);
+			// 分割平面所在的片一定留在这个节点上，保证每个节点至少拿走一片
+			if (side == BSP_ON || (int)i == splitter)
+				coplanar.push_back(fragment);
+			else if (side == BSP_FRONT)
+				front.push_back(fragment);
+			else if (side == BSP_BACK)
+				back.push_back(fragment);
+			else
+			{
+				splitFragment(fragment, distance, front, back);
+				splits++;
+			}
+		}
+		task.fragments = std::vector<BspFragment>();
+
+		std::sort(coplanar.begin(), coplanar.end(),
+				  [](const BspFragment &a, const BspFragment &b) { return a.source < b.source; });
+		Node &node = treeNodes[index];
+		node.plane = plane;
+		node.first = (unsigned int)treeFragments.size();
+		node.count = (unsigned int)coplanar.size();
+		treeFragments.insert(treeFragments.end(), coplanar.begin(), coplanar.end());
+		if (!back.empty())
+			stack.push_back({std::move(back), index, false});
+		if (!front.empty())
+			stack.push_back({std::move(front), index, true});
+	}
+}
+
+void BspTree::order(const glm::vec3 &eye, bool backToFront, std::vector<int> &out) const
+{
+	out.clear();
+	if (treeNodes.empty())
+		return;
+	// 栈里的非负数是待展开的子树，取反的是待输出的节点
+	std::vector<int> stack(1, 0);
+	while (!stack.empty())
+	{
+		int item = stack.back();
+		stack.pop_back();
+		if (item < 0)
+		{
+			out.push_back(~item);
+			continue;
+		}
+		const Node &node = treeNodes[item];
+		bool eyeInFront = glm::dot(node.plane, glm::vec4(eye, 1.0f)) >= 0.0f;
+		int nearSide = eyeInFront ? node.front : node.back, farSide = eyeInFront ? node.back : node.front;
+		int first = backToFront ? farSide : nearSide, last = backToFront ? nearSide : farSide;
+		if (last >= 0)
+			stack.push_back(last);
+		stack.push_back(~item);
+		if (first >= 0)
+			stack.push_back(first);
+	}
+}
+
+size_t BspTree::bytes() const
+{
+	return treeNodes.capacity() * sizeof(Node) + treeFragments.capacity() * sizeof(BspFragment);
+}
+
+void BspTree::printSummary(double ms) const
+{
+	std::cout << "BSP tree: " << sources << " triangles -> " << treeFragments.size() << " fragments (" << splits << " splits), "
+			  << treeNodes.size() << " nodes, built in " << ms << " ms" << std::endl;
+}
+
+// ------------------------画家算法----------------------------
+
+BspPainter::BspPainter(ThreadPool &pool) : pool(pool)
+{
+}
+
+size_t BspPainter::tableBytes() const
+{
+	return bsp.bytes() + nodeOrder.capacity() * sizeof(int) + painted.capacity() * sizeof(RasterTriangle) + buffer.bytes();
+}
+
+void BspPainter::render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image)
+{
+	if (builtFor != scene.generation)
+	{
+		auto start = std::chrono::steady_clock::now();
+		bsp.build(scene.triangles, scene.triangles.size());
+		builtFor = scene.generation;
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		bsp.printSummary(ms);
+	}
+
+	// 从后到前排好片，同一节点里下标大的先画，共面重叠时下标小的留在上面，与z-buffer的规则一致
+	bsp.order(view.viewPosition, true, nodeOrder);
+	std::vector<unsigned int> sequence;
+	sequence.reserve(bsp.fragments().size());
+	for (int index : nodeOrder)
+	{
+		const BspTree::Node &node = bsp.nodes()[index];
+		for (unsigned int i = node.first + node.count; i > node.first; i--)
+			sequence.push_back(i - 1);
+	}
+
+	// 投影可以并行：按顺序切成块，各块的结果再按块的顺序接起来
+	int chunks = std::max(1, std::min((int)sequence.size() / 1024, pool.size() * 4));
+	std::vector<std::vector<RasterTriangle>> chunkTriangles(chunks);
+	pool.parallelFor(chunks, [&](int chunk, int) {
+		size_t begin = sequence.size() * chunk / chunks, end = sequence.size() * (chunk + 1) / chunks;
+		std::vector<RasterTriangle> &out = chunkTriangles[chunk];
+		for (size_t i = begin; i < end; i++)
+		{
+			const BspFragment &fragment = bsp.fragments()[sequence[i]];
+			SoftTriangle triangle;
+			for (int k = 0; k < 3; k++)
+				triangle.v[k].position = fragment.position[k];
+			ScreenTriangle clipped[3];
+			int n = projectTriangle(triangle, view.viewProjection, view.width, view.height, fragment.source, clipped);
+			for (int j = 0; j < n; j++)
+			{
+				// 裁剪得到的是片内的重心坐标，换算成源三角形的
+				for (int k = 0; k < 3; k++)
+				{
+					glm::vec3 b = clipped[j].bary[k];
+					clipped[j].bary[k] = fragment.bary[0] * b.x + fragment.bary[1] * b.y + fragment.bary[2] * b.z;
+				}
+				RasterTriangle raster;
+				if (RasterTriangle::setup(clipped[j], view.width, view.height, raster))
+					out.push_back(raster);
+			}
+		}
+	});
+	painted.clear();
+	for (const std::vector<RasterTriangle> &chunk : chunkTriangles)
+		painted.insert(painted.end(), chunk.begin(), chunk.end());
+
+	buffer.paint(pool, painted, scene, shadow, view, image);
+}
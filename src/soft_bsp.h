@@ -0,0 +1,75 @@
+#ifndef SOFT_BSP_H
+#define SOFT_BSP_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "soft_painter.h"
+#include "soft_raster.h"
+#include "thread_pool.h"
+
+// BSP树的一片：源三角形被分割平面切开后剩下的部分，没被切开时就是源三角形本身
+struct BspFragment
+{
+	glm::vec3 position[3];		// 世界坐标
+	glm::vec3 bary[3];			// 三个顶点在源三角形中的重心坐标
+	unsigned int source;		// 源三角形的下标
+};
+
+// 静态几何体的BSP树：只在场景改变时建一次，跨分割平面的三角形被切开。
+// 之后每帧只需从视点出发遍历一次，就能得到严格的从后到前（画家算法）或从前到后（提前深度测试）的顺序，
+// 不需要逐帧排序，也没有循环遮挡和相交面的问题。
+class BspTree
+{
+public:
+	struct Node
+	{
+		glm::vec4 plane;		// dot(plane, (p, 1)) >= 0 为正面
+		int front = -1, back = -1;
+		unsigned int first = 0, count = 0;	// 与分割平面共面的片在fragments中的范围，按源三角形下标排序
+	};
+
+	// 用triangles的前count个建树
+	void build(const std::vector<SoftTriangle> &triangles, size_t count);
+
+	// 从eye看过去的节点顺序；backToFront为false时从前到后。同一节点内的片互不遮挡（共面）
+	void order(const glm::vec3 &eye, bool backToFront, std::vector<int> &out) const;
+
+	const std::vector<Node> &nodes() const { return treeNodes; }
+	const std::vector<BspFragment> &fragments() const { return treeFragments; }
+	size_t sourceCount() const { return sources; }
+	size_t splitCount() const { return splits; }
+	size_t bytes() const;
+	// 打印建树的统计：源三角形、切出的片、节点数和耗时（ms由调用者计时，可以包括上传等后续工作）
+	void printSummary(double ms) const;
+
+private:
+	std::vector<Node> treeNodes;
+	std::vector<BspFragment> treeFragments;
+	size_t sources = 0;
+	size_t splits = 0;			// 被切开的三角形（每次切开算一次）
+};
+
+// BSP画家算法：从后到前遍历BSP树，按这个顺序把片交给PaintBuffer去画
+class BspPainter
+{
+public:
+	explicit BspPainter(ThreadPool &pool);
+
+	// 第一次调用时（或场景换了时）建树
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image);
+
+	// BSP树、投影后的片和整屏的三角形下标缓冲
+	size_t tableBytes() const;
+	const BspTree &tree() const { return bsp; }
+	const PaintBuffer::Stats &stats() const { return buffer.stats(); }
+
+private:
+	ThreadPool &pool;
+	BspTree bsp;
+	unsigned int builtFor = 0;		// 树对应的SoftScene::generation
+	std::vector<int> nodeOrder;
+	std::vector<RasterTriangle> painted;		// 按从后到前的顺序
+	PaintBuffer buffer;
+};
+
+#endif
@@ -0,0 +1,424 @@
+#include "soft_painter.h"
+#include <algorithm>
+#include <cstring>
+
+// ------------------------画家的最后一步----------------------------
+
+void PaintBuffer::paint(ThreadPool &pool, const std::vector<RasterTriangle> &ordered, const SoftScene &scene,
+						const SoftShadowMap &shadow, const SoftView &view, SoftImage &image)
+{
+	image.resize(view.width, view.height);
+	visible.resize((size_t)view.width * view.height);
+	int bands = pool.size() == 1 ? 1 : std::min(view.height, pool.size() * 4);
+	bandStats.assign(bands, Stats());
+	pool.parallelFor(bands, [&](int band, int) {
+		int firstRow = (int)((long long)view.height * band / bands);
+		int lastRow = (int)((long long)view.height * (band + 1) / bands) - 1;
+		Stats &stats = bandStats[band];
+		std::fill(visible.begin() + (size_t)firstRow * view.width, visible.begin() + (size_t)(lastRow + 1) * view.width, -1);
+		for (size_t i = 0; i < ordered.size(); i++)
+		{
+			const RasterTriangle &t = ordered[i];
+			int y0 = std::max(t.minY, firstRow), y1 = std::min(t.maxY, lastRow);
+			for (int y = y0; y <= y1; y++)
+			{
+				int *row = &visible[(size_t)y * view.width];
+				for (int x = t.minX; x <= t.maxX; x++)
+					if (t.covers(x + 0.5f, y + 0.5f))
+					{
+						row[x] = (int)i;
+						stats.paintedPixels++;
+					}
+			}
+		}
+		for (int y = firstRow; y <= lastRow; y++)
+			for (int x = 0; x < view.width; x++)
+			{
+				int index = visible[(size_t)y * view.width + x];
+				if (index < 0)
+				{
+					image.set(x, y, SOFT_CLEAR_COLOR);
+					continue;
+				}
+				image.set(x, y, shadePixel(scene, shadow, view, ordered[index].screen, x, y));
+				stats.coveredPixels++;
+			}
+	});
+
+	frameStats = Stats();
+	for (const Stats &stats : bandStats)
+	{
+		frameStats.paintedPixels += stats.paintedPixels;
+		frameStats.coveredPixels += stats.coveredPixels;
+	}
+}
+
+// ------------------------基数排序----------------------------
+
+// 浮点数的位模式换成无符号整数后按从大到小的顺序排列：正数翻转符号位，负数全部取反，最后整体取反
+static inline unsigned int descendingBits(float key)
+{
+	unsigned int bits;
+	memcpy(&bits, &key, sizeof(bits));
+	bits = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+	return ~bits;
+}
+
+static inline float descendingKey(unsigned int bits)
+{
+	bits = ~bits;
+	bits = (bits & 0x80000000u) ? (bits & 0x7fffffffu) : ~bits;
+	float key;
+	memcpy(&key, &bits, sizeof(key));
+	return key;
+}
+
+void radixSortDescending(ThreadPool &pool, std::vector<float> &keys, std::vector<unsigned int> &values)
+{
+	const int RADIX = 256;
+	size_t n = keys.size();
+	std::vector<unsigned int> bits(n), bitsTemp(n), valuesTemp(n);
+	int chunks = pool.size() == 1 ? 1 : std::max(1, std::min((int)(n / 4096), pool.size() * 4));
+	std::vector<size_t> histogram((size_t)chunks * RADIX);
+	pool.parallelFor(chunks, [&](int chunk, int) {
+		for (size_t i = n * chunk / chunks; i < n * (chunk + 1) / chunks; i++)
+			bits[i] = descendingBits(keys[i]);
+	});
+
+	for (int shift = 0; shift < 32; shift += 8)
+	{
+		std::fill(histogram.begin(), histogram.end(), 0);
+		pool.parallelFor(chunks, [&](int chunk, int) {
+			size_t *counts = &histogram[(size_t)chunk * RADIX];
+			for (size_t i = n * chunk / chunks; i < n * (chunk + 1) / chunks; i++)
+				counts[(bits[i] >> shift) & (RADIX - 1)]++;
+		});
+		// 数字在外、块在内做前缀和，同一个数字里前面块的元素排在前面，排序是稳定的
+		size_t sum = 0;
+		bool trivial = false;
+		for (int digit = 0; digit < RADIX; digit++)
+		{
+			size_t total = 0;
+			for (int chunk = 0; chunk < chunks; chunk++)
+			{
+				size_t count = histogram[(size_t)chunk * RADIX + digit];
+				histogram[(size_t)chunk * RADIX + digit] = sum;
+				sum += count;
+				total += count;
+			}
+			trivial = trivial || total == n;
+		}
+		if (trivial)
+			continue;	// 这一位所有键都相同，不用动
+		pool.parallelFor(chunks, [&](int chunk, int) {
+			size_t *offsets = &histogram[(size_t)chunk * RADIX];
+			for (size_t i = n * chunk / chunks; i < n * (chunk + 1) / chunks; i++)
+			{
+				size_t target = offsets[(bits[i] >> shift) & (RADIX - 1)]++;
+				bitsTemp[target] = bits[i];
+				valuesTemp[target] = values[i];
+			}
+		});
+		bits.swap(bitsTemp);
+		values.swap(valuesTemp);
+	}
+	for (size_t i = 0; i < n; i++)
+		keys[i] = descendingKey(bits[i]);
+}
+
+// ------------------------深度排序----------------------------
+
+// 深度差在这个范围内算作在平面上（窗口深度，与float深度的精度相当）
+static const double PLANE_TOLERANCE = 1e-7;
+
+DepthSortPainter::DepthSortPainter(ThreadPool &pool) : pool(pool)
+{
+}
+
+size_t DepthSortPainter::tableBytes() const
+{
+	return polygons.capacity() * sizeof(Polygon) + keys.capacity() * sizeof(float) +
+		   order.capacity() * sizeof(unsigned int) + ordered.capacity() * sizeof(RasterTriangle) + buffer.bytes();
+}
+
+// 多边形所在平面在(x, y)处的深度，用double从顶点重新算，免得自己的顶点离自己的平面都有误差
+static double planeDepth(const RasterTriangle &plane, double x, double y)
+{
+	const glm::vec3 *v = plane.screen.screen;
+	double ax = (double)v[1].x - v[0].x, ay = (double)v[1].y - v[0].y, az = (double)v[1].z - v[0].z;
+	double bx = (double)v[2].x - v[0].x, by = (double)v[2].y - v[0].y, bz = (double)v[2].z - v[0].z;
+	double area = ax * by - ay * bx;
+	double zdx = (az * by - bz * ay) / area, zdy = (bz * ax - az * bx) / area;
+	return v[0].z + zdx * (x - v[0].x) + zdy * (y - v[0].y);
+}
+
+// polygon三个顶点比plane所在平面远多少（正数在平面后面）
+static void depthAgainst(const RasterTriangle &polygon, const RasterTriangle &plane, double *difference)
+{
+	for (int k = 0; k < 3; k++)
+	{
+		const glm::vec3 &v = polygon.screen.screen[k];
+		difference[k] = v.z - planeDepth(plane, v.x, v.y);
+	}
+}
+
+static bool allBehind(const double *difference)
+{
+	return difference[0] >= -PLANE_TOLERANCE && difference[1] >= -PLANE_TOLERANCE && difference[2] >= -PLANE_TOLERANCE;
+}
+
+static bool allInFront(const double *difference)
+{
+	return difference[0] <= PLANE_TOLERANCE && difference[1] <= PLANE_TOLERANCE && difference[2] <= PLANE_TOLERANCE;
+}
+
+// 分离轴：两个三角形在某条边的法向上的投影区间不相交（只接触也算分开，公共边上的像素只属于一个三角形）
+static bool separatedBy(const RasterTriangle &a, const RasterTriangle &b)
+{
+	const glm::vec3 *p = a.screen.screen, *q = b.screen.screen;
+	for (int k = 0; k < 3; k++)
+	{
+		double nx = (double)p[k].y - p[(k + 1) % 3].y, ny = (double)p[(k + 1) % 3].x - p[k].x;
+		double aMin = 1e300, aMax = -1e300, bMin = 1e300, bMax = -1e300;
+		for (int j = 0; j < 3; j++)
+		{
+			double s = nx * p[j].x + ny * p[j].y, t = nx * q[j].x + ny * q[j].y;
+			aMin = std::min(aMin, s);
+			aMax = std::max(aMax, s);
+			bMin = std::min(bMin, t);
+			bMax = std::max(bMax, t);
+		}
+		if (aMax <= bMin || bMax <= aMin)
+			return true;
+	}
+	return false;
+}
+
+DepthSortPainter::Order DepthSortPainter::compare(const Polygon &p, const Polygon &q)
+{
+	const RasterTriangle &a = p.raster, &b = q.raster;
+	if (a.maxX < b.minX || b.maxX < a.minX || a.maxY < b.minY || b.maxY < a.minY)
+	{
+		frameStats.extentResolved++;
+		return ORDER_OK;
+	}
+	frameStats.expensivePairs++;
+	double pToQ[3], qToP[3];
+	depthAgainst(a, b, pToQ);
+	if (allBehind(pToQ))
+		return ORDER_OK;
+	depthAgainst(b, a, qToP);
+	if (allInFront(qToP))
+		return ORDER_OK;
+	frameStats.projectionTests++;
+	if (separatedBy(a, b) || separatedBy(b, a))
+		return ORDER_OK;
+	// 交换后能否满足3、4
+	if (allBehind(qToP) || allInFront(pToQ))
+		return ORDER_SWAP;
+	return ORDER_INTERSECT;
+}
+
+void DepthSortPainter::addPolygon(const RasterTriangle &raster)
+{
+	Polygon polygon;
+	polygon.raster = raster;
+	const glm::vec3 *v = raster.screen.screen;
+	polygon.zNear = std::min(std::min(v[0].z, v[1].z), v[2].z);
+	polygon.zFar = std::max(std::max(v[0].z, v[1].z), v[2].z);
+	polygon.prev = polygon.next = -1;
+	polygon.moved = false;
+	polygons.push_back(polygon);
+}
+
+void DepthSortPainter::unlink(int polygon)
+{
+	Polygon &p = polygons[polygon];
+	if (p.prev >= 0)
+		polygons[p.prev].next = p.next;
+	else
+		head = p.next;
+	if (p.next >= 0)
+		polygons[p.next].prev = p.prev;
+	p.prev = p.next = -1;
+}
+
+void DepthSortPainter::insertAfter(int polygon, int after)
+{
+	Polygon &p = polygons[polygon];
+	p.prev = after;
+	p.next = after >= 0 ? polygons[after].next : head;
+	if (p.next >= 0)
+		polygons[p.next].prev = polygon;
+	if (after >= 0)
+		polygons[after].next = polygon;
+	else
+		head = polygon;
+}
+
+bool DepthSortPainter::split(int polygon, const RasterTriangle &plane)
+{
+	// plane可能就在polygons里，加新多边形前先复制一份
+	RasterTriangle cutter = plane;
+	const ScreenTriangle source = polygons[polygon].raster.screen;
+	double difference[3];
+	depthAgainst(polygons[polygon].raster, cutter, difference);
+	bool behind = false, front = false;
+	for (int k = 0; k < 3; k++)
+	{
+		behind = behind || difference[k] > PLANE_TOLERANCE;
+		front = front || difference[k] < -PLANE_TOLERANCE;
+	}
+	if (!behind || !front)
+		return false;
+
+	// 屏幕坐标和1/w在屏幕上是线性的，重心坐标要透视校正：先插值 bary/w 再除以插值出的 1/w
+	struct Corner
+	{
+		glm::vec3 screen;
+		float invW;
+		glm::vec3 baryOverW;
+	};
+	Corner pieces[2][4];
+	int count[2] = {0, 0};
+	for (int i = 0; i < 3; i++)
+	{
+		int j = (i + 1) % 3;
+		Corner a = {source.screen[i], source.invW[i], source.bary[i] * source.invW[i]};
+		Corner b = {source.screen[j], source.invW[j], source.bary[j] * source.invW[j]};
+		double di = difference[i], dj = difference[j];
+		if (di >= -PLANE_TOLERANCE)
+			pieces[0][count[0]++] = a;
+		if (di <= PLANE_TOLERANCE)
+			pieces[1][count[1]++] = a;
+		if ((di > PLANE_TOLERANCE && dj < -PLANE_TOLERANCE) || (di < -PLANE_TOLERANCE && dj > PLANE_TOLERANCE))
+		{
+			float t = (float)(di / (di - dj));
+			Corner c = {glm::mix(a.screen, b.screen, t), a.invW + (b.invW - a.invW) * t, glm::mix(a.baryOverW, b.baryOverW, t)};
+			pieces[0][count[0]++] = c;
+			pieces[1][count[1]++] = c;
+		}
+	}
+
+	// 碎片按最远深度插回：它们不会比原来的多边形更远，从原来的位置往后找，跳过挪到前面的
+	int after = polygons[polygon].prev;
+	unlink(polygon);
+	for (int s = 0; s < 2; s++)
+		for (int k = 1; k + 1 < count[s]; k++)
+		{
+			ScreenTriangle piece;
+			const int index[3] = {0, k, k + 1};
+			for (int v = 0; v < 3; v++)
+			{
+				const Corner &c = pieces[s][index[v]];
+				piece.screen[v] = c.screen;
+				piece.invW[v] = c.invW;
+				piece.bary[v] = c.baryOverW / c.invW;
+			}
+			piece.source = source.source;
+			RasterTriangle raster;
+			if (!RasterTriangle::setup(piece, width, height, raster))
+				continue;	// 不覆盖任何像素中心
+			int added = (int)polygons.size();
+			addPolygon(raster);
+			int position = after, next = after >= 0 ? polygons[after].next : head;
+			while (next >= 0 && (polygons[next].moved || polygons[next].zFar >= polygons[added].zFar))
+			{
+				position = next;
+				next = polygons[next].next;
+			}
+			insertAfter(added, position);
+		}
+	return true;
+}
+
+void DepthSortPainter::render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image)
+{
+	width = view.width;
+	height = view.height;
+	frameStats = Stats();
+
+	// 投影、裁剪、建立边函数：按块并行，再按块的顺序接起来
+	int chunks = std::max(1, std::min((int)scene.triangles.size() / 1024, pool.size() * 4));
+	std::vector<std::vector<RasterTriangle>> chunkTriangles(chunks);
+	pool.parallelFor(chunks, [&](int chunk, int) {
+		size_t begin = scene.triangles.size() * chunk / chunks, end = scene.triangles.size() * (chunk + 1) / chunks;
+		for (size_t i = begin; i < end; i++)
+		{
+			ScreenTriangle clipped[3];
+			int n = projectTriangle(scene.triangles[i], view.viewProjection, view.width, view.height, (unsigned int)i, clipped);
+			for (int j = 0; j < n; j++)
+			{
+				RasterTriangle raster;
+				if (RasterTriangle::setup(clipped[j], view.width, view.height, raster))
+					chunkTriangles[chunk].push_back(raster);
+			}
+		}
+	});
+	polygons.clear();
+	for (const std::vector<RasterTriangle> &chunk : chunkTriangles)
+		for (const RasterTriangle &raster : chunk)
+			addPolygon(raster);
+	frameStats.polygons = (double)polygons.size();
+
+	// 按最远深度从远到近排序，串成待画列表
+	keys.resize(polygons.size());
+	order.resize(polygons.size());
+	for (size_t i = 0; i < polygons.size(); i++)
+	{
+		keys[i] = polygons[i].zFar;
+		order[i] = (unsigned int)i;
+	}
+	radixSortDescending(pool, keys, order);
+	head = -1;
+	for (size_t i = order.size(); i > 0; i--)
+		insertAfter(order[i - 1], -1);
+
+	// 每次取列表头P，检查深度范围与它重叠的Q；列表的形状始终是[挪到前面的...][按最远深度排好的...]，
+	// 所以遇到第一个没挪过、最远深度不超过P最近深度的Q就可以停下
+	ordered.clear();
+	double splitBudget = 4.0 * polygons.size() + 1024.0;	// 精度很差时防止一直切下去
+	while (head >= 0)
+	{
+		int p = head;
+		bool ready = true;
+		for (int q = polygons[p].next; q >= 0;)
+		{
+			if (!polygons[q].moved && polygons[q].zFar <= polygons[p].zNear)
+				break;
+			int next = polygons[q].next;
+			frameStats.depthOverlapPairs++;
+			Order result = compare(polygons[p], polygons[q]);
+			if (result == ORDER_OK)
+			{
+				q = next;
+				continue;
+			}
+			if (result == ORDER_SWAP && !polygons[q].moved)
+			{
+				polygons[q].moved = true;
+				unlink(q);
+				insertAfter(q, -1);
+				frameStats.reorders++;
+				ready = false;
+				break;
+			}
+			// 循环遮挡或者相交：先试着用P的平面切Q，不行再用Q的平面切P
+			if (frameStats.splits < splitBudget && (split(q, polygons[p].raster) || split(p, polygons[q].raster)))
+			{
+				frameStats.splits++;
+				ready = false;
+				break;
+			}
+			frameStats.unresolved++;
+			q = next;
+		}
+		if (ready)
+		{
+			unlink(p);
+			ordered.push_back(polygons[p].raster);
+		}
+	}
+
+	buffer.paint(pool, ordered, scene, shadow, view, image);
+}
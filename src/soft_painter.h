@@ -0,0 +1,102 @@
+#ifndef SOFT_PAINTER_H
+#define SOFT_PAINTER_H
+
+#include <vector>
+#include "soft_raster.h"
+#include "thread_pool.h"
+
+// 画家算法共用的最后一步：按给定的顺序把三角形画进一张三角形下标缓冲，后画的覆盖先画的，完全不比较深度；
+// 最后只给每个像素最终留下的三角形着色。画家的顺序是全局的，所以多线程按行带划分屏幕，每个线程按同样的顺序画自己的行带
+class PaintBuffer
+{
+public:
+	struct Stats
+	{
+		double paintedPixels = 0;	// 画家写入的像素（含被覆盖的）
+		double coveredPixels = 0;	// 最终不是背景的像素
+	};
+
+	// ordered从后到前
+	void paint(ThreadPool &pool, const std::vector<RasterTriangle> &ordered, const SoftScene &scene,
+			   const SoftShadowMap &shadow, const SoftView &view, SoftImage &image);
+
+	size_t bytes() const { return visible.capacity() * sizeof(int); }
+	const Stats &stats() const { return frameStats; }
+
+private:
+	std::vector<int> visible;		// 每个像素最后画上的三角形下标，-1为背景
+	std::vector<Stats> bandStats;
+	Stats frameStats;
+};
+
+// 浮点键的多线程基数排序（LSD，每趟8位，共4趟）：values按keys从大到小稳定排序，keys也一起重排。
+// 各线程先统计自己那一块的直方图，前缀和之后按块的顺序分散，结果与线程数无关
+void radixSortDescending(ThreadPool &pool, std::vector<float> &keys, std::vector<unsigned int> &values);
+
+// 深度排序的画家算法（Newell）：先按最远深度排序，再逐对检查深度范围重叠的多边形能否按这个顺序画：
+//   1、2 屏幕上x、y范围不重叠
+//   3    P整个在Q所在平面的后面
+//   4    Q整个在P所在平面的前面
+//   5    P、Q在屏幕上的投影不重叠
+// 都不满足时看交换后能否满足3、4，能就把Q挪到前面先画；Q已经挪过一次（循环遮挡）或者两者相交时，
+// 用对方的平面把Q（或P）切开，碎片按最远深度插回列表。
+// 所有检查都在窗口坐标(x, y, 深度)里做：透视投影保持平面，视线方向就是+z，深度越大越远
+class DepthSortPainter
+{
+public:
+	struct Stats
+	{
+		double polygons = 0;				// 排序的多边形（投影、裁剪后的三角形）
+		double depthOverlapPairs = 0;		// 深度范围重叠、需要检查的多边形对
+		double extentResolved = 0;			// 用x、y范围就判定的对
+		double expensivePairs = 0;			// 需要平面测试或投影重叠测试的对
+		double projectionTests = 0;			// 走到投影重叠测试的对
+		double reorders = 0;				// 挪到前面的次数
+		double splits = 0;					// 切开的次数
+		double unresolved = 0;				// 切不开只好按原顺序画的对（精度问题）
+	};
+
+	explicit DepthSortPainter(ThreadPool &pool);
+
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image);
+
+	// 多边形表、排序键和整屏的三角形下标缓冲
+	size_t tableBytes() const;
+	const Stats &stats() const { return frameStats; }
+	const PaintBuffer::Stats &paintStats() const { return buffer.stats(); }
+
+private:
+	struct Polygon
+	{
+		RasterTriangle raster;
+		float zNear, zFar;
+		int prev, next;			// 待画列表中的前后
+		bool moved;
+	};
+
+	enum Order
+	{
+		ORDER_OK,			// P可以先画
+		ORDER_SWAP,			// Q要先画
+		ORDER_INTERSECT		// 交换也不行，要切开
+	};
+
+	Order compare(const Polygon &p, const Polygon &q);
+	// 用plane所在平面切开polygon，碎片按最远深度插回列表；polygon不跨过这个平面时返回false
+	bool split(int polygon, const RasterTriangle &plane);
+	void addPolygon(const RasterTriangle &raster);
+	void unlink(int polygon);
+	void insertAfter(int polygon, int after);
+
+	ThreadPool &pool;
+	std::vector<Polygon> polygons;
+	std::vector<float> keys;
+	std::vector<unsigned int> order;
+	std::vector<RasterTriangle> ordered;
+	int head = -1;
+	int width = 0, height = 0;
+	PaintBuffer buffer;
+	Stats frameStats;
+};
+
+#endif
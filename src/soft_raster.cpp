@@ -0,0 +1,255 @@
+#include "soft_raster.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SOFT_RASTER_SSE 1
+#endif
+
+// 分箱时每个任务处理的三角形数
+static const size_t BIN_CHUNK = 1024;
+
+// std::min按引用取参数，要有定义
+const int TileRasterizer::TILE_SIZE;
+
+TileRasterizer::TileRasterizer(ThreadPool &pool) : pool(pool)
+{
+	bins.resize(pool.size());
+	buffers.resize(pool.size());
+	workerFragments.resize(pool.size());
+}
+
+size_t TileRasterizer::binBytes() const
+{
+	size_t bytes = 0;
+	for (const WorkerBins &worker : bins)
+	{
+		bytes += worker.triangles.capacity() * sizeof(RasterTriangle);
+		for (const std::vector<unsigned int> &tile : worker.tiles)
+			bytes += tile.capacity() * sizeof(unsigned int);
+	}
+	return bytes;
+}
+
+bool RasterTriangle::setup(const ScreenTriangle &screen, int width, int height, RasterTriangle &out)
+{
+	const glm::vec3 *v = screen.screen;
+	float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+	if (!(area != 0.0f) || !std::isfinite(area))
+		return false;	// 退化成线段的三角形不产生片段
+
+	float minX = std::min(std::min(v[0].x, v[1].x), v[2].x), maxX = std::max(std::max(v[0].x, v[1].x), v[2].x);
+	float minY = std::min(std::min(v[0].y, v[1].y), v[2].y), maxY = std::max(std::max(v[0].y, v[1].y), v[2].y);
+	// 像素中心落在包围盒内的像素
+	out.minX = std::max(0, (int)std::ceil(minX - 0.5f));
+	out.maxX = std::min(width - 1, (int)std::floor(maxX - 0.5f));
+	out.minY = std::max(0, (int)std::ceil(minY - 0.5f));
+	out.maxY = std::min(height - 1, (int)std::floor(maxY - 0.5f));
+	if (out.minX > out.maxX || out.minY > out.maxY)
+		return false;
+
+	// 不剔除背面：顺时针的三角形把边函数整体取反，使内部总是 e > 0
+	float orientation = area > 0.0f ? 1.0f : -1.0f;
+	for (int k = 0; k < 3; k++)
+	{
+		// 第k条边从v[k]到v[k+1]；基点取两端点中(y, x)较小的那个
+		const glm::vec3 &a = v[k], &b = v[(k + 1) % 3];
+		bool swapped = b.y < a.y || (b.y == a.y && b.x < a.x);
+		const glm::vec3 &p = swapped ? b : a, &q = swapped ? a : b;
+		out.edgeA[k] = p.y - q.y;
+		out.edgeB[k] = q.x - p.x;
+		out.baseX[k] = p.x;
+		out.baseY[k] = p.y;
+		out.sign[k] = swapped ? -orientation : orientation;
+		float A = out.sign[k] * out.edgeA[k], B = out.sign[k] * out.edgeB[k];
+		// 内部在右侧的边（左边）和水平且内部在下方的边（上边）
+		out.topLeft[k] = A > 0.0f || (A == 0.0f && B < 0.0f);
+	}
+
+	out.x0 = v[0].x;
+	out.y0 = v[0].y;
+	out.zBase = v[0].z;
+	out.zdx = ((v[1].z - v[0].z) * (v[2].y - v[0].y) - (v[2].z - v[0].z) * (v[1].y - v[0].y)) / area;
+	out.zdy = ((v[2].z - v[0].z) * (v[1].x - v[0].x) - (v[1].z - v[0].z) * (v[2].x - v[0].x)) / area;
+	out.screen = screen;
+	return true;
+}
+
+void TileRasterizer::bin(const SoftScene &scene, size_t count, const glm::mat4 &transform, int w, int h)
+{
+	width = w;
+	height = h;
+	tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	for (WorkerBins &worker : bins)
+	{
+		worker.triangles.clear();
+		worker.tiles.resize(tilesX * tilesY);
+		for (std::vector<unsigned int> &tile : worker.tiles)
+			tile.clear();
+	}
+
+	int chunks = (int)((count + BIN_CHUNK - 1) / BIN_CHUNK);
+	pool.parallelFor(chunks, [&](int chunk, int worker) {
+		WorkerBins &out = bins[worker];
+		size_t end = std::min(count, (chunk + 1) * BIN_CHUNK);
+		for (size_t i = chunk * BIN_CHUNK; i < end; i++)
+		{
+			ScreenTriangle clipped[3];
+			int n = projectTriangle(scene.triangles[i], transform, width, height, (unsigned int)i, clipped);
+			for (int j = 0; j < n; j++)
+			{
+				RasterTriangle triangle;
+				if (!RasterTriangle::setup(clipped[j], width, height, triangle))
+					continue;
+				unsigned int index = (unsigned int)out.triangles.size();
+				out.triangles.push_back(triangle);
+				for (int ty = triangle.minY / TILE_SIZE; ty <= triangle.maxY / TILE_SIZE; ty++)
+					for (int tx = triangle.minX / TILE_SIZE; tx <= triangle.maxX / TILE_SIZE; tx++)
+						out.tiles[ty * tilesX + tx].push_back(index);
+			}
+		}
+	});
+}
+
+// 4个相邻像素(x..x+3, y)中被覆盖、且深度不大于缓冲中已有值的像素，返回4位掩码，z带回各像素的深度，
+// covered带回只看覆盖的掩码（做了深度测试的片段）
+static inline int testQuad(const float *edgeA, const float *rowE, const float *baseX, const float *sign,
+						   const bool *topLeft, float zRow, float zdx, float x0, int x,
+						   const float *depth, float *z, int &covered)
+{
+#ifdef SOFT_RASTER_SSE
+	const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	__m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+	__m128 inside = _mm_cmpeq_ps(px, px);
+	for (int k = 0; k < 3; k++)
+	{
+		__m128 e = _mm_mul_ps(_mm_set1_ps(sign[k]),
+							  _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[k]), _mm_sub_ps(px, _mm_set1_ps(baseX[k]))),
+										 _mm_set1_ps(rowE[k])));
+		__m128 onSide = topLeft[k] ? _mm_cmpge_ps(e, _mm_setzero_ps()) : _mm_cmpgt_ps(e, _mm_setzero_ps());
+		inside = _mm_and_ps(inside, onSide);
+	}
+	int mask = _mm_movemask_ps(inside);
+	covered = mask;
+	if (!mask)
+		return 0;
+	__m128 zq = _mm_add_ps(_mm_set1_ps(zRow), _mm_mul_ps(_mm_set1_ps(zdx), _mm_sub_ps(px, _mm_set1_ps(x0))));
+	_mm_storeu_ps(z, zq);
+	return mask & _mm_movemask_ps(_mm_cmple_ps(zq, _mm_loadu_ps(depth)));
+#else
+	int mask = 0;
+	covered = 0;
+	for (int lane = 0; lane < 4; lane++)
+	{
+		float px = (float)x + (lane + 0.5f);
+		bool inside = true;
+		for (int k = 0; k < 3; k++)
+		{
+			float e = sign[k] * (edgeA[k] * (px - baseX[k]) + rowE[k]);
+			inside = inside && (topLeft[k] ? e >= 0.0f : e > 0.0f);
+		}
+		z[lane] = zRow + zdx * (px - x0);
+		covered |= inside << lane;
+		if (inside && z[lane] <= depth[lane])
+			mask |= 1 << lane;
+	}
+	return mask;
+#endif
+}
+
+size_t TileRasterizer::rasterizeTile(int tile, TileBuffer &buffer) const
+{
+	size_t fragments = 0;
+	int tileX = tile % tilesX * TILE_SIZE, tileY = tile / tilesX * TILE_SIZE;
+	int lastX = std::min(tileX + TILE_SIZE, width) - 1, lastY = std::min(tileY + TILE_SIZE, height) - 1;
+	std::fill(buffer.depth, buffer.depth + TILE_SIZE * TILE_SIZE, 1.0f);
+	std::fill(buffer.visible, buffer.visible + TILE_SIZE * TILE_SIZE, (const RasterTriangle *)NULL);
+
+	for (const WorkerBins &worker : bins)
+	{
+		for (unsigned int index : worker.tiles[tile])
+		{
+			const RasterTriangle &t = worker.triangles[index];
+			int x0 = std::max(t.minX, tileX), x1 = std::min(t.maxX, lastX);
+			int y0 = std::max(t.minY, tileY), y1 = std::min(t.maxY, lastY);
+			for (int y = y0; y <= y1; y++)
+			{
+				float py = y + 0.5f;
+				float rowE[3];
+				for (int k = 0; k < 3; k++)
+					rowE[k] = t.edgeB[k] * (py - t.baseY[k]);
+				float zRow = t.zBase + t.zdy * (py - t.y0);
+				float *depthRow = buffer.depth + (y - tileY) * TILE_SIZE - tileX;
+				const RasterTriangle **visibleRow = buffer.visible + (y - tileY) * TILE_SIZE - tileX;
+				// tile的左边界是4的倍数，按4个像素对齐地走，包围盒外的像素用掩码去掉
+				for (int x = x0 & ~3; x <= x1; x += 4)
+				{
+					float z[4];
+					int covered;
+					int mask = testQuad(t.edgeA, rowE, t.baseX, t.sign, t.topLeft, zRow, t.zdx, t.x0, x, depthRow + x, z, covered);
+					for (int lane = 0; lane < 4; covered >>= 1, mask >>= 1, lane++)
+					{
+						int px = x + lane;
+						if (!(covered & 1) || px < x0 || px > x1)
+							continue;
+						fragments++;
+						if (!(mask & 1))
+							continue;
+						// GL_LESS；深度相同时源三角形下标小的优先（相当于先提交的先画）
+						const RasterTriangle *current = visibleRow[px];
+						if (z[lane] < depthRow[px] ||
+							(current && z[lane] == depthRow[px] && t.screen.source < current->screen.source))
+						{
+							depthRow[px] = z[lane];
+							visibleRow[px] = &t;
+						}
+					}
+				}
+			}
+		}
+	}
+	return fragments;
+}
+
+void TileRasterizer::renderDepth(const SoftScene &scene, size_t count, const glm::mat4 &transform, int size,
+								 SoftShadowMap &shadow)
+{
+	bin(scene, count, transform, size, size);
+	shadow.size = size;
+	shadow.depth.resize((size_t)size * size);
+	pool.parallelFor(tilesX * tilesY, [&](int tile, int worker) {
+		TileBuffer &buffer = buffers[worker];
+		rasterizeTile(tile, buffer);
+		int tileX = tile % tilesX * TILE_SIZE, tileY = tile / tilesX * TILE_SIZE;
+		int columns = std::min(TILE_SIZE, width - tileX), rows = std::min(TILE_SIZE, height - tileY);
+		for (int y = 0; y < rows; y++)
+			std::copy(buffer.depth + y * TILE_SIZE, buffer.depth + y * TILE_SIZE + columns,
+					  &shadow.depth[(size_t)(tileY + y) * size + tileX]);
+	});
+}
+
+void TileRasterizer::render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image)
+{
+	bin(scene, scene.triangles.size(), view.viewProjection, view.width, view.height);
+	image.resize(view.width, view.height);
+	std::fill(workerFragments.begin(), workerFragments.end(), 0.0);
+	pool.parallelFor(tilesX * tilesY, [&](int tile, int worker) {
+		TileBuffer &buffer = buffers[worker];
+		workerFragments[worker] += (double)rasterizeTile(tile, buffer);
+		// 可见性确定之后才着色，每个像素只着色一次
+		int tileX = tile % tilesX * TILE_SIZE, tileY = tile / tilesX * TILE_SIZE;
+		int columns = std::min(TILE_SIZE, width - tileX), rows = std::min(TILE_SIZE, height - tileY);
+		for (int y = 0; y < rows; y++)
+			for (int x = 0; x < columns; x++)
+			{
+				const RasterTriangle *visible = buffer.visible[y * TILE_SIZE + x];
+				image.set(tileX + x, tileY + y,
+						  visible ? shadePixel(scene, shadow, view, visible->screen, tileX + x, tileY + y) : SOFT_CLEAR_COLOR);
+			}
+	});
+	frameFragments = 0;
+	for (double fragments : workerFragments)
+		frameFragments += fragments;
+}
@@ -0,0 +1,89 @@
+#ifndef SOFT_RASTER_H
+#define SOFT_RASTER_H
+
+#include <vector>
+#include "soft_scene.h"
+#include "thread_pool.h"
+
+// 建立好边函数的三角形。共享一条边的两个三角形以同一个端点为基点、同样的运算顺序求这条边的值，
+// 所以结果只差一个符号，再配合top-left规则，边上的像素恰好属于其中一个三角形，不会漏也不会重复。
+// 别的引擎逐像素判断覆盖时也用它，这样与TileRasterizer的结果逐像素一致
+struct RasterTriangle
+{
+	ScreenTriangle screen;
+	float edgeA[3], edgeB[3];		// 边函数 e = sign * (A * (x - baseX) + B * (y - baseY))
+	float baseX[3], baseY[3];
+	float sign[3];
+	bool topLeft[3];				// e == 0 时是否算作覆盖
+	float zBase, zdx, zdy;			// 深度平面 z = zBase + zdy * (y - y0) + zdx * (x - x0)
+	float x0, y0;
+	int minX, minY, maxX, maxY;		// 像素包围盒（已截到屏幕内）
+
+	// 建立边函数和深度平面；退化或不覆盖屏幕内任何像素中心时返回false
+	static bool setup(const ScreenTriangle &screen, int width, int height, RasterTriangle &out);
+
+	// 下面几个函数的运算顺序与TileRasterizer的SSE路径完全相同
+	float edge(int k, float x, float y) const { return sign[k] * (edgeA[k] * (x - baseX[k]) + edgeB[k] * (y - baseY[k])); }
+	bool insideEdge(int k, float x, float y) const
+	{
+		float e = edge(k, x, y);
+		return topLeft[k] ? e >= 0.0f : e > 0.0f;
+	}
+	bool covers(float x, float y) const { return insideEdge(0, x, y) && insideEdge(1, x, y) && insideEdge(2, x, y); }
+	float depthAt(float x, float y) const { return zBase + zdy * (y - y0) + zdx * (x - x0); }
+};
+
+// 基于tile的多线程z-buffer光栅化器。
+// 每帧分两步：
+//   1. 分箱：三角形按块分给各线程做裁剪、投影和边函数的建立，再按包围盒挂到覆盖的每个64x64 tile上
+//   2. 光栅化：各线程按tile领任务，先用SSE一次测试4个像素的覆盖和深度，得到tile的可见性缓冲
+//      （每个像素最近的三角形），再只对最终可见的像素着色
+// 深度相同时取源三角形下标小的那个，与GL按提交顺序GL_LESS的结果一致，也与线程数和调度顺序无关。
+class TileRasterizer
+{
+public:
+	static const int TILE_SIZE = 64;
+
+	explicit TileRasterizer(ThreadPool &pool);
+
+	// 只写深度：scene.triangles的前count个三角形经transform投影到size x size的深度贴图（阴影pass）
+	void renderDepth(const SoftScene &scene, size_t count, const glm::mat4 &transform, int size, SoftShadowMap &shadow);
+	// 可见性 + 着色：画出整个场景
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image);
+
+	// 深度存储：每个线程一块tile大小的可见性缓冲（深度 + 可见三角形）
+	size_t depthBytes() const { return buffers.size() * sizeof(TileBuffer); }
+	// 上一帧分箱用的内存：建立好的三角形和各tile的三角形下标
+	size_t binBytes() const;
+	// 上一帧render中做了深度测试的片段数，比较各引擎的逐像素工作量用
+	double fragments() const { return frameFragments; }
+
+private:
+	// 一个线程分箱的结果：它建立的三角形，以及每个tile上挂着的三角形下标
+	struct WorkerBins
+	{
+		std::vector<RasterTriangle> triangles;
+		std::vector<std::vector<unsigned int>> tiles;
+	};
+
+	// 一个线程光栅化tile时用的可见性缓冲
+	struct TileBuffer
+	{
+		float depth[TILE_SIZE * TILE_SIZE];
+		const RasterTriangle *visible[TILE_SIZE * TILE_SIZE];
+	};
+
+	void bin(const SoftScene &scene, size_t count, const glm::mat4 &transform, int width, int height);
+	// 返回做了深度测试的片段数（被三角形覆盖的像素）
+	size_t rasterizeTile(int tile, TileBuffer &buffer) const;
+
+	ThreadPool &pool;
+	int width = 0, height = 0;
+	int tilesX = 0, tilesY = 0;
+	std::vector<WorkerBins> bins;
+	std::vector<TileBuffer> buffers;
+	std::vector<double> workerFragments;
+	double frameFragments = 0;
+};
+
+#endif
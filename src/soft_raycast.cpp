@@ -0,0 +1,509 @@
+#include "soft_raycast.h"
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SOFT_RAY_SSE 1
+#endif
+
+// 叶子里最多的三角形数；少于等于LEAF_SIZE时不再尝试分割
+static const int LEAF_SIZE = 4;
+static const int MAX_LEAF_SIZE = 16;
+// 遍历用定长的栈，建树时限制深度
+static const int MAX_DEPTH = 60;
+static const int SAH_BINS = 16;
+// 重心坐标的容差：Möller-Trumbore不是严格不漏缝的，公共边上的光线可能两边都判成不相交
+static const float BARY_EPSILON = 1e-6f;
+// 阴影光线的起点离开表面的距离（光线参数，光线长度是到光源视锥体近平面的距离）
+static const float SHADOW_EPSILON = 1e-4f;
+static const int TILE_SIZE = 16;
+
+// ------------------------BVH----------------------------
+
+static float surfaceArea(const glm::vec3 &min, const glm::vec3 &max)
+{
+	glm::vec3 d = max - min;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+size_t Bvh::bytes() const
+{
+	return treeNodes.capacity() * sizeof(Node) + treeTriangles.capacity() * sizeof(Triangle);
+}
+
+void Bvh::build(const std::vector<SoftTriangle> &triangles)
+{
+	size_t n = triangles.size();
+	std::vector<glm::vec3> boundsMin(n), boundsMax(n), centroids(n);
+	std::vector<unsigned int> order(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		const SoftTriangle &t = triangles[i];
+		boundsMin[i] = glm::min(glm::min(t.v[0].position, t.v[1].position), t.v[2].position);
+		boundsMax[i] = glm::max(glm::max(t.v[0].position, t.v[1].position), t.v[2].position);
+		centroids[i] = (boundsMin[i] + boundsMax[i]) * 0.5f;
+		order[i] = (unsigned int)i;
+	}
+
+	treeNodes.clear();
+	maxDepth = 0;
+	if (n == 0)
+		return;
+	struct Task
+	{
+		int node;
+		size_t begin, end;
+		int depth;
+	};
+	std::vector<Task> stack;
+	treeNodes.push_back(Node());
+	stack.push_back({0, 0, n, 0});
+	while (!stack.empty())
+	{
+		Task task = stack.back();
+		stack.pop_back();
+		maxDepth = std::max(maxDepth, task.depth);
+
+		glm::vec3 nodeMin(1e30f), nodeMax(-1e30f), centroidMin(1e30f), centroidMax(-1e30f);
+		for (size_t i = task.begin; i < task.end; i++)
+		{
+			nodeMin = glm::min(nodeMin, boundsMin[order[i]]);
+			nodeMax = glm::max(nodeMax, boundsMax[order[i]]);
+			centroidMin = glm::min(centroidMin, centroids[order[i]]);
+			centroidMax = glm::max(centroidMax, centroids[order[i]]);
+		}
+		treeNodes[task.node].min = nodeMin;
+		treeNodes[task.node].max = nodeMax;
+		int count = (int)(task.end - task.begin);
+
+		// 按质心分箱，在每条轴的箱子边界上找SAH代价最小的分割
+		int bestAxis = -1, bestSplit = 0;
+		float bestCost = 1e30f;
+		if (count > LEAF_SIZE && task.depth < MAX_DEPTH)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				float extent = centroidMax[axis] - centroidMin[axis];
+				if (!(extent > 0.0f))
+					continue;
+				int binCount[SAH_BINS] = {};
+				glm::vec3 binMin[SAH_BINS], binMax[SAH_BINS];
+				std::fill(binMin, binMin + SAH_BINS, glm::vec3(1e30f));
+				std::fill(binMax, binMax + SAH_BINS, glm::vec3(-1e30f));
+				float scale = SAH_BINS / extent;
+				for (size_t i = task.begin; i < task.end; i++)
+				{
+					unsigned int t = order[i];
+					int bin = std::min(SAH_BINS - 1, (int)((centroids[t][axis] - centroidMin[axis]) * scale));
+					binCount[bin]++;
+					binMin[bin] = glm::min(binMin[bin], boundsMin[t]);
+					binMax[bin] = glm::max(binMax[bin], boundsMax[t]);
+				}
+				// 从右往左累积出每个分割位置右边的面积和数量，再从左往右扫
+				float rightArea[SAH_BINS];
+				int rightCount[SAH_BINS];
+				glm::vec3 accMin(1e30f), accMax(-1e30f);
+				int accCount = 0;
+				for (int b = SAH_BINS - 1; b > 0; b--)
+				{
+					accCount += binCount[b];
+					if (binCount[b] > 0)
+					{
+						accMin = glm::min(accMin, binMin[b]);
+						accMax = glm::max(accMax, binMax[b]);
+					}
+					rightCount[b] = accCount;
+					rightArea[b] = accCount > 0 ? surfaceArea(accMin, accMax) : 0.0f;
+				}
+				accMin = glm::vec3(1e30f);
+				accMax = glm::vec3(-1e30f);
+				accCount = 0;
+				for (int b = 0; b < SAH_BINS - 1; b++)
+				{
+					accCount += binCount[b];
+					if (binCount[b] > 0)
+					{
+						accMin = glm::min(accMin, binMin[b]);
+						accMax = glm::max(accMax, binMax[b]);
+					}
+					if (accCount == 0 || rightCount[b + 1] == 0)
+						continue;
+					float cost = surfaceArea(accMin, accMax) * accCount + rightArea[b + 1] * rightCount[b + 1];
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestAxis = axis;
+						bestSplit = b + 1;
+					}
+				}
+			}
+		}
+		// 代价按父节点面积归一：遍历一次内部节点约等于测一个三角形
+		float leafCost = (float)count, area = surfaceArea(nodeMin, nodeMax);
+		bool split = bestAxis >= 0 && (count > MAX_LEAF_SIZE || area <= 0.0f || 1.0f + bestCost / area < leafCost);
+		if (!split)
+		{
+			treeNodes[task.node].first = (int)task.begin;
+			treeNodes[task.node].count = count;
+			treeNodes[task.node].axis = 0;
+			continue;
+		}
+
+		float scale = SAH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		float lowest = centroidMin[bestAxis];
+		unsigned int *middle = std::partition(order.data() + task.begin, order.data() + task.end, [&](unsigned int t) {
+			return std::min(SAH_BINS - 1, (int)((centroids[t][bestAxis] - lowest) * scale)) < bestSplit;
+		});
+		size_t mid = middle - order.data();
+		int children = (int)treeNodes.size();
+		treeNodes[task.node].first = children;
+		treeNodes[task.node].count = 0;
+		treeNodes[task.node].axis = bestAxis;
+		treeNodes.push_back(Node());
+		treeNodes.push_back(Node());
+		stack.push_back({children + 1, mid, task.end, task.depth + 1});
+		stack.push_back({children, task.begin, mid, task.depth + 1});
+	}
+
+	treeTriangles.resize(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		const SoftTriangle &t = triangles[order[i]];
+		treeTriangles[i].v0 = t.v[0].position;
+		treeTriangles[i].e1 = t.v[1].position - t.v[0].position;
+		treeTriangles[i].e2 = t.v[2].position - t.v[0].position;
+		treeTriangles[i].index = order[i];
+	}
+}
+
+// ------------------------求交----------------------------
+
+void RayPacket::setDirection(int lane, const glm::vec3 &direction)
+{
+	dx[lane] = direction.x;
+	dy[lane] = direction.y;
+	dz[lane] = direction.z;
+	const float tiny = 1e-20f;
+	invDx[lane] = 1.0f / (std::fabs(direction.x) > tiny ? direction.x : tiny);
+	invDy[lane] = 1.0f / (std::fabs(direction.y) > tiny ? direction.y : tiny);
+	invDz[lane] = 1.0f / (std::fabs(direction.z) > tiny ? direction.z : tiny);
+}
+
+// 与节点包围盒相交的光线的位掩码（slab测试，只算[0, tMax]内的部分）
+static int boxMask(const Bvh::Node &node, const RayPacket &p)
+{
+	int mask = 0;
+#ifdef SOFT_RAY_SSE
+	const __m128 minX = _mm_set1_ps(node.min.x), minY = _mm_set1_ps(node.min.y), minZ = _mm_set1_ps(node.min.z);
+	const __m128 maxX = _mm_set1_ps(node.max.x), maxY = _mm_set1_ps(node.max.y), maxZ = _mm_set1_ps(node.max.z);
+	for (int h = 0; h < RayPacket::SIZE; h += 4)
+	{
+		__m128 ox = _mm_load_ps(p.ox + h), oy = _mm_load_ps(p.oy + h), oz = _mm_load_ps(p.oz + h);
+		__m128 ix = _mm_load_ps(p.invDx + h), iy = _mm_load_ps(p.invDy + h), iz = _mm_load_ps(p.invDz + h);
+		__m128 x0 = _mm_mul_ps(_mm_sub_ps(minX, ox), ix), x1 = _mm_mul_ps(_mm_sub_ps(maxX, ox), ix);
+		__m128 y0 = _mm_mul_ps(_mm_sub_ps(minY, oy), iy), y1 = _mm_mul_ps(_mm_sub_ps(maxY, oy), iy);
+		__m128 z0 = _mm_mul_ps(_mm_sub_ps(minZ, oz), iz), z1 = _mm_mul_ps(_mm_sub_ps(maxZ, oz), iz);
+		__m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)),
+								  _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+		__m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)),
+								 _mm_min_ps(_mm_max_ps(z0, z1), _mm_load_ps(p.tMax + h)));
+		mask |= _mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) << h;
+	}
+#else
+	for (int i = 0; i < RayPacket::SIZE; i++)
+	{
+		float x0 = (node.min.x - p.ox[i]) * p.invDx[i], x1 = (node.max.x - p.ox[i]) * p.invDx[i];
+		float y0 = (node.min.y - p.oy[i]) * p.invDy[i], y1 = (node.max.y - p.oy[i]) * p.invDy[i];
+		float z0 = (node.min.z - p.oz[i]) * p.invDz[i], z1 = (node.max.z - p.oz[i]) * p.invDz[i];
+		float tNear = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), 0.0f));
+		float tFar = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::min(std::max(z0, z1), p.tMax[i]));
+		if (tNear <= tFar)
+			mask |= 1 << i;
+	}
+#endif
+	return mask;
+}
+
+// Möller-Trumbore：与三角形相交、交点参数在(tMin, tMax]内的光线的位掩码，交点写进t、u、v
+static int triangleMask(const Bvh::Triangle &tri, const RayPacket &p, float tMin, float *t, float *u, float *v)
+{
+	int mask = 0;
+#ifdef SOFT_RAY_SSE
+	const __m128 e1x = _mm_set1_ps(tri.e1.x), e1y = _mm_set1_ps(tri.e1.y), e1z = _mm_set1_ps(tri.e1.z);
+	const __m128 e2x = _mm_set1_ps(tri.e2.x), e2y = _mm_set1_ps(tri.e2.y), e2z = _mm_set1_ps(tri.e2.z);
+	const __m128 low = _mm_set1_ps(-BARY_EPSILON), high = _mm_set1_ps(1.0f + BARY_EPSILON);
+	for (int h = 0; h < RayPacket::SIZE; h += 4)
+	{
+		__m128 dx = _mm_load_ps(p.dx + h), dy = _mm_load_ps(p.dy + h), dz = _mm_load_ps(p.dz + h);
+		// pvec = d x e2
+		__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+		__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+		__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+		__m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), det);
+		__m128 tx = _mm_sub_ps(_mm_load_ps(p.ox + h), _mm_set1_ps(tri.v0.x));
+		__m128 ty = _mm_sub_ps(_mm_load_ps(p.oy + h), _mm_set1_ps(tri.v0.y));
+		__m128 tz = _mm_sub_ps(_mm_load_ps(p.oz + h), _mm_set1_ps(tri.v0.z));
+		__m128 uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv);
+		// qvec = tvec x e1
+		__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+		__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+		__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+		__m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv);
+		__m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv);
+		__m128 hit = _mm_cmpneq_ps(det, _mm_setzero_ps());
+		hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(uu, low), _mm_cmpge_ps(vv, low)));
+		hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(uu, vv), high));
+		hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(tt, _mm_set1_ps(tMin)), _mm_cmple_ps(tt, _mm_load_ps(p.tMax + h))));
+		_mm_store_ps(t + h, tt);
+		_mm_store_ps(u + h, uu);
+		_mm_store_ps(v + h, vv);
+		mask |= _mm_movemask_ps(hit) << h;
+	}
+#else
+	for (int i = 0; i < RayPacket::SIZE; i++)
+	{
+		glm::vec3 d(p.dx[i], p.dy[i], p.dz[i]);
+		glm::vec3 pvec = glm::cross(d, tri.e2);
+		float det = glm::dot(tri.e1, pvec);
+		if (det == 0.0f)
+			continue;
+		float inv = 1.0f / det;
+		glm::vec3 tvec = glm::vec3(p.ox[i], p.oy[i], p.oz[i]) - tri.v0;
+		glm::vec3 qvec = glm::cross(tvec, tri.e1);
+		u[i] = glm::dot(tvec, pvec) * inv;
+		v[i] = glm::dot(d, qvec) * inv;
+		t[i] = glm::dot(tri.e2, qvec) * inv;
+		if (u[i] >= -BARY_EPSILON && v[i] >= -BARY_EPSILON && u[i] + v[i] <= 1.0f + BARY_EPSILON && t[i] > tMin &&
+			t[i] <= p.tMax[i])
+			mask |= 1 << i;
+	}
+#endif
+	return mask;
+}
+
+// 光线所在直线与三角形所在平面交点的重心坐标（可以在三角形外），求mipmap级别时用相邻像素的光线
+static glm::vec3 planeBarycentric(const Bvh::Triangle &tri, const RayPacket &p, int lane)
+{
+	glm::vec3 d(p.dx[lane], p.dy[lane], p.dz[lane]);
+	glm::vec3 pvec = glm::cross(d, tri.e2);
+	float det = glm::dot(tri.e1, pvec);
+	if (det == 0.0f)
+		return glm::vec3(1.0f, 0.0f, 0.0f);
+	glm::vec3 tvec = glm::vec3(p.ox[lane], p.oy[lane], p.oz[lane]) - tri.v0;
+	float u = glm::dot(tvec, pvec) / det, v = glm::dot(d, glm::cross(tvec, tri.e1)) / det;
+	return glm::vec3(1.0f - u - v, u, v);
+}
+
+void RayCaster::trace(RayPacket &packet, bool primary, Stats &stats) const
+{
+	const std::vector<Bvh::Node> &nodes = bvh.nodes();
+	const std::vector<Bvh::Triangle> &triangles = bvh.triangles();
+	if (nodes.empty())
+		return;
+	alignas(16) float t[RayPacket::SIZE], u[RayPacket::SIZE], v[RayPacket::SIZE];
+	float tMin = primary ? 0.0f : SHADOW_EPSILON;
+	int stack[MAX_DEPTH + 2];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0 && packet.active)
+	{
+		const Bvh::Node &node = nodes[stack[--top]];
+		stats.nodeVisits++;
+		int mask = boxMask(node, packet) & packet.active;
+		if (!mask)
+			continue;
+		if (node.count == 0)
+		{
+			// 按第一条还在测的光线的方向先走近的子节点（左子节点的质心坐标小）
+			int lane = 0;
+			while (!(mask & (1 << lane)))
+				lane++;
+			float direction = node.axis == 0 ? packet.dx[lane] : node.axis == 1 ? packet.dy[lane] : packet.dz[lane];
+			bool leftFirst = direction >= 0.0f;
+			stack[top++] = leftFirst ? node.first + 1 : node.first;
+			stack[top++] = leftFirst ? node.first : node.first + 1;
+			continue;
+		}
+		for (int k = node.first; k < node.first + node.count; k++)
+		{
+			const Bvh::Triangle &tri = triangles[k];
+			if (!primary && tri.index >= casterCount)
+				continue;	// 光源立方体不投射阴影
+			stats.triangleTests++;
+			stats.testedLanes += (double)std::bitset<RayPacket::SIZE>(mask).count();
+			int hits = triangleMask(tri, packet, tMin, t, u, v) & mask;
+			for (int lane = 0; hits; lane++, hits >>= 1)
+			{
+				if (!(hits & 1))
+					continue;
+				if (primary)
+				{
+					// 距离相同时取下标小的三角形，与z-buffer（先画的留下）一致
+					if (t[lane] == packet.tMax[lane] && packet.triangle[lane] >= 0 &&
+						tri.index > triangles[packet.triangle[lane]].index)
+						continue;
+					packet.tMax[lane] = t[lane];
+					packet.u[lane] = u[lane];
+					packet.v[lane] = v[lane];
+					packet.triangle[lane] = k;
+				}
+				else if ((int)tri.index != packet.ignore[lane])
+				{
+					packet.tMax[lane] = 0.0f;
+					packet.triangle[lane] = k;
+					packet.active &= ~(1 << lane);
+					mask &= ~(1 << lane);
+				}
+			}
+			if (!mask)
+				break;
+		}
+	}
+}
+
+// ------------------------渲染----------------------------
+
+RayCaster::RayCaster(ThreadPool &pool) : pool(pool)
+{
+	workerStats.resize(pool.size());
+}
+
+void RayCaster::render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image)
+{
+	if (builtFor != scene.generation)
+	{
+		auto start = std::chrono::steady_clock::now();
+		bvh.build(scene.triangles);
+		builtFor = scene.generation;
+		casterCount = scene.casterCount;
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "BVH: " << bvh.triangles().size() << " triangles, " << bvh.nodes().size() << " nodes, depth "
+				  << bvh.depth() << ", built in " << ms << " ms" << std::endl;
+	}
+
+	image.resize(view.width, view.height);
+	for (Stats &stats : workerStats)
+		stats = Stats();
+	glm::mat4 inverse = glm::inverse(view.viewProjection);
+	// 阴影光线回答与阴影贴图相同的问题：沿光源视锥体（正交投影）的方向，点与近平面之间有没有投射阴影的三角形。
+	// 光源空间的z沿光线线性变化，每走单位长度减少depthScale
+	const glm::mat4 &lightSpace = view.lightSpace;
+	float depthScale = glm::length(glm::vec3(lightSpace[0][2], lightSpace[1][2], lightSpace[2][2]));
+	bool shadows = !scene.lights.empty() && depthScale > 0.0f;
+	int tilesX = (view.width + TILE_SIZE - 1) / TILE_SIZE, tilesY = (view.height + TILE_SIZE - 1) / TILE_SIZE;
+
+	pool.parallelFor(tilesX * tilesY, [&](int tile, int worker) {
+		Stats &stats = workerStats[worker];
+		int tileX = tile % tilesX * TILE_SIZE, tileY = tile / tilesX * TILE_SIZE;
+		RayPacket packet, shadowPacket;
+		// 包是4x2个像素，左下角的x是4的倍数、y是偶数，所以包里正好是两个完整的2x2像素块
+		for (int y0 = tileY; y0 < std::min(tileY + TILE_SIZE, view.height); y0 += 2)
+			for (int x0 = tileX; x0 < std::min(tileX + TILE_SIZE, view.width); x0 += 4)
+			{
+				// 屏幕外的像素也生成光线（不参与求交），求mipmap级别时要用到
+				packet.active = 0;
+				for (int lane = 0; lane < RayPacket::SIZE; lane++)
+				{
+					int x = x0 + lane % 4, y = y0 + lane / 4;
+					float ndcX = (x + 0.5f) / view.width * 2.0f - 1.0f, ndcY = (y + 0.5f) / view.height * 2.0f - 1.0f;
+					glm::vec4 nearPoint = inverse * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+					glm::vec4 farPoint = inverse * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+					glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+					packet.ox[lane] = origin.x;
+					packet.oy[lane] = origin.y;
+					packet.oz[lane] = origin.z;
+					// 光线参数0是近平面、1是远平面，与光栅化时的近/远平面裁剪一致
+					packet.setDirection(lane, glm::vec3(farPoint) / farPoint.w - origin);
+					packet.tMax[lane] = 1.0f;
+					packet.triangle[lane] = -1;
+					if (x < view.width && y < view.height)
+						packet.active |= 1 << lane;
+				}
+				int visible = packet.active;
+				trace(packet, true, stats);
+				stats.primaryPackets++;
+
+				// 命中了投射阴影的表面、又在光源视锥体里的像素，一起向0号光源发阴影光线；视锥体外算作照亮（与阴影贴图相同）
+				glm::vec3 position[RayPacket::SIZE];
+				shadowPacket.active = 0;
+				for (int lane = 0; lane < RayPacket::SIZE; lane++)
+				{
+					shadowPacket.tMax[lane] = 1.0f - SHADOW_EPSILON;
+					shadowPacket.triangle[lane] = -1;
+					shadowPacket.ox[lane] = shadowPacket.oy[lane] = shadowPacket.oz[lane] = 0.0f;
+					shadowPacket.setDirection(lane, glm::vec3(1.0f));
+					if (!(visible & (1 << lane)) || packet.triangle[lane] < 0)
+						continue;
+					const Bvh::Triangle &tri = bvh.triangles()[packet.triangle[lane]];
+					position[lane] = tri.v0 + tri.e1 * packet.u[lane] + tri.e2 * packet.v[lane];
+					if (!shadows || scene.triangles[tri.index].material < 0)
+						continue;
+					glm::vec4 light = lightSpace * glm::vec4(position[lane], 1.0f);
+					if (light.z > 1.0f || light.z <= -1.0f || light.x < -1.0f || light.x > 1.0f || light.y < -1.0f || light.y > 1.0f)
+						continue;
+					shadowPacket.ox[lane] = position[lane].x;
+					shadowPacket.oy[lane] = position[lane].y;
+					shadowPacket.oz[lane] = position[lane].z;
+					shadowPacket.setDirection(lane, view.shadowDirection * ((light.z + 1.0f) / depthScale));
+					shadowPacket.ignore[lane] = (int)tri.index;
+					shadowPacket.active |= 1 << lane;
+				}
+				int lit = shadowPacket.active;
+				if (lit)
+				{
+					trace(shadowPacket, false, stats);
+					stats.shadowPackets++;
+				}
+
+				for (int lane = 0; lane < RayPacket::SIZE; lane++)
+				{
+					if (!(visible & (1 << lane)))
+						continue;
+					int x = x0 + lane % 4, y = y0 + lane / 4;
+					if (packet.triangle[lane] < 0)
+					{
+						image.set(x, y, SOFT_CLEAR_COLOR);
+						continue;
+					}
+					const Bvh::Triangle &tri = bvh.triangles()[packet.triangle[lane]];
+					const SoftTriangle &source = scene.triangles[tri.index];
+					if (source.material < 0)
+					{
+						image.set(x, y, glm::vec3(1.0f));	// 光源立方体
+						continue;
+					}
+					glm::vec3 bary(1.0f - packet.u[lane] - packet.v[lane], packet.u[lane], packet.v[lane]);
+					// 同一个2x2块里左下、右下、左上三个像素的光线与这个三角形平面的交点
+					int quad = lane % 4 & ~1;
+					float lod = textureLod(scene, source, planeBarycentric(tri, packet, quad),
+										   planeBarycentric(tri, packet, quad + 1), planeBarycentric(tri, packet, quad + 4));
+					float shadowed = (lit & (1 << lane)) && !(shadowPacket.active & (1 << lane)) ? 1.0f : 0.0f;
+					stats.shadowedPixels += shadowed;
+					if (checkShadowMap)
+					{
+						// 过滤后的阴影边缘是过渡值，按0.5分成在不在阴影里再比较
+						glm::vec3 normal = source.v[0].normal * bary.x + source.v[1].normal * bary.y + source.v[2].normal * bary.z;
+						stats.shadowMapMismatches += (shadowMapFactor(shadow, view, position[lane], normal) > 0.5f) != (shadowed > 0.0f);
+					}
+					image.set(x, y, shadeSurface(scene, view, source, bary, lod, shadowed));
+				}
+			}
+	});
+
+	frameStats = Stats();
+	for (const Stats &stats : workerStats)
+	{
+		frameStats.primaryPackets += stats.primaryPackets;
+		frameStats.shadowPackets += stats.shadowPackets;
+		frameStats.nodeVisits += stats.nodeVisits;
+		frameStats.triangleTests += stats.triangleTests;
+		frameStats.testedLanes += stats.testedLanes;
+		frameStats.shadowedPixels += stats.shadowedPixels;
+		frameStats.shadowMapMismatches += stats.shadowMapMismatches;
+	}
+}
@@ -0,0 +1,102 @@
+#ifndef SOFT_RAYCAST_H
+#define SOFT_RAYCAST_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "soft_scene.h"
+#include "thread_pool.h"
+
+// 三角形的包围盒层次（BVH），按表面积启发（SAH）分箱构建。
+// 节点按深度优先顺序存放，内部节点的两个子节点相邻；叶子里的三角形在triangles中连续存放
+class Bvh
+{
+public:
+	struct Node
+	{
+		glm::vec3 min, max;
+		int first;				// 内部节点：左子节点的下标（右子节点是first + 1）；叶子：第一个三角形
+		int count;				// 叶子的三角形数，0为内部节点
+		int axis;				// 内部节点的分割轴，遍历时按光线方向先走近的一侧
+	};
+
+	// 预先算好Möller-Trumbore求交要用的两条边
+	struct Triangle
+	{
+		glm::vec3 v0, e1, e2;
+		unsigned int index;		// SoftScene::triangles中的下标
+	};
+
+	void build(const std::vector<SoftTriangle> &triangles);
+
+	const std::vector<Node> &nodes() const { return treeNodes; }
+	const std::vector<Triangle> &triangles() const { return treeTriangles; }
+	int depth() const { return maxDepth; }
+	size_t bytes() const;
+
+private:
+	std::vector<Node> treeNodes;
+	std::vector<Triangle> treeTriangles;
+	int maxDepth = 0;
+};
+
+// 8条光线的包（结构数组），对应屏幕上4x2个像素。求交时8条光线一起测同一个节点、同一个三角形，
+// 有SSE时分成两组4路SIMD（构建参数里没有打开AVX）
+struct alignas(16) RayPacket
+{
+	static const int SIZE = 8;
+	float ox[SIZE], oy[SIZE], oz[SIZE];
+	float dx[SIZE], dy[SIZE], dz[SIZE];
+	float invDx[SIZE], invDy[SIZE], invDz[SIZE];
+	float tMax[SIZE];				// 光线参数的上限，最近求交时随命中缩小；阴影光线被挡住后置0
+	float u[SIZE], v[SIZE];			// 命中点在三角形上的重心坐标（v1、v2的权重）
+	int triangle[SIZE];				// 命中的三角形（Bvh::triangles中的下标），-1为没有命中
+	int ignore[SIZE];				// 阴影光线跳过的三角形（出发点所在的三角形）
+	int active;						// 有效光线的位掩码
+
+	// 设置方向并求倒数；分量为0时用一个很小的数代替，免得包围盒测试里出现0 * inf
+	void setDirection(int lane, const glm::vec3 &direction);
+};
+
+// 光线投射：每个像素从近平面向远平面发一条光线，在BVH里求最近交点；0号光源的阴影不查阴影贴图，
+// 而是从交点沿阴影贴图的光源方向发阴影光线，得到同一个遮挡测试的精确结果（没有阴影贴图的量化和偏移）。屏幕按16x16的tile分给所有线程（动态分配，谁先做完谁取下一块），
+// 像素之间没有共享的写，所以线程数翻倍帧时间就减半；BVH只在场景改变时建一次
+class RayCaster
+{
+public:
+	struct Stats
+	{
+		double primaryPackets = 0;
+		double shadowPackets = 0;
+		double nodeVisits = 0;			// 包与节点包围盒的测试
+		double triangleTests = 0;		// 包与三角形的测试（每次8条光线）
+		double testedLanes = 0;			// 三角形测试时还需要测试的光线数之和，除以8倍的测试次数就是包的利用率
+		double shadowedPixels = 0;
+		double shadowMapMismatches = 0;	// 阴影光线与阴影贴图结论不同的像素（阴影贴图的误差），只在setShadowMapCheck(true)时统计
+	};
+
+	explicit RayCaster(ThreadPool &pool);
+
+	// 第一次调用时（或场景重建后）建BVH。shadow只在打开阴影贴图检查时使用
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image);
+	// 诊断：每个像素再查一次阴影贴图，统计shadowMapMismatches；会算进可见性pass的时间，测性能时不要打开
+	void setShadowMapCheck(bool enabled) { checkShadowMap = enabled; }
+	bool checksShadowMap() const { return checkShadowMap; }
+
+	size_t tableBytes() const { return bvh.bytes(); }
+	const Bvh &hierarchy() const { return bvh; }
+	const Stats &stats() const { return frameStats; }
+
+private:
+	// 最近交点（primary为true）或任意交点（阴影光线，只测投射阴影的三角形）
+	void trace(RayPacket &packet, bool primary, Stats &stats) const;
+
+	ThreadPool &pool;
+	Bvh bvh;
+	unsigned int builtFor = 0;		// BVH对应的SoftScene::generation
+	size_t casterCount = 0;
+	bool checkShadowMap = false;
+	std::vector<Stats> workerStats;
+	Stats frameStats;
+};
+
+#endif
@@ -0,0 +1,458 @@
+#include "soft_renderer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+#include "benchmark.h"
+#include "camera_path.h"
+#include "frame_compare.h"
+#include "profiler.h"
+#include "soft_bsp.h"
+#include "soft_painter.h"
+#include "soft_raster.h"
+#include "soft_raycast.h"
+#include "soft_scanline.h"
+#include "soft_warnock.h"
+#include "soft_weiler.h"
+#include "view_setup.h"
+
+// 需要单独计时的pass
+enum SoftPass
+{
+	SOFT_PASS_SHADOW,		// 阴影贴图
+	SOFT_PASS_VISIBLE,		// 消隐 + 着色
+	SOFT_PASS_EXPORT,		// 帧写盘（PPM或SVG）
+	SOFT_PASS_COUNT
+};
+
+// 多线程tile z-buffer
+class ZBufferEngine : public SoftEngine
+{
+public:
+	explicit ZBufferEngine(ThreadPool &pool) : rasterizer(pool) {}
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image) override
+	{
+		rasterizer.render(scene, shadow, view, image);
+	}
+	size_t depthBytes() const override { return rasterizer.depthBytes(); }
+	size_t tableBytes() const override { return rasterizer.binBytes(); }
+	double visibilityWork() const override { return rasterizer.fragments(); }
+
+private:
+	TileRasterizer rasterizer;
+};
+
+// 扫描线z-buffer
+class ScanlineEngine : public SoftEngine
+{
+public:
+	explicit ScanlineEngine(ThreadPool &pool) : scanline(pool) {}
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image) override
+	{
+		scanline.render(scene, shadow, view, image);
+	}
+	size_t depthBytes() const override { return scanline.depthBytes(); }
+	size_t tableBytes() const override { return scanline.tableBytes(); }
+	double visibilityWork() const override { return scanline.fragments(); }
+
+private:
+	ScanlineZBuffer scanline;
+};
+
+// 区间扫描线
+class IntervalEngine : public SoftEngine
+{
+public:
+	explicit IntervalEngine(ThreadPool &pool) : scanline(pool) {}
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image) override
+	{
+		scanline.render(scene, shadow, view, image);
+	}
+	size_t depthBytes() const override { return 0; }
+	size_t tableBytes() const override { return scanline.tableBytes(); }
+	double visibilityWork() const override { return scanline.stats().comparisons; }
+	std::vector<std::pair<std::string, double>> frameCounters() const override
+	{
+		const IntervalScanline::Stats &stats = scanline.stats();
+		return {{"intervals", stats.intervals},
+				{"split_intervals", stats.splitIntervals},
+				{"depth_comparisons", stats.comparisons},
+				{"zbuffer_depth_comparisons", stats.zbufferComparisons},
+				{"depth_comparisons_saved", stats.saved()}};
+	}
+
+private:
+	IntervalScanline scanline;
+};
+
+// Warnock区域细分
+class WarnockEngine : public SoftEngine
+{
+public:
+	explicit WarnockEngine(ThreadPool &pool) : subdivision(pool) {}
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image) override
+	{
+		subdivision.render(scene, shadow, view, image);
+	}
+	size_t depthBytes() const override { return 0; }
+	size_t tableBytes() const override { return subdivision.tableBytes(); }
+	double visibilityWork() const override { return subdivision.stats().polygonTests; }
+	std::vector<std::pair<std::string, double>> frameCounters() const override
+	{
+		const WarnockSubdivision::Stats &stats = subdivision.stats();
+		return {{"quadtree_nodes", stats.nodes},
+				{"empty_regions", stats.emptyRegions},
+				{"single_polygon_regions", stats.singleRegions},
+				{"surrounded_regions", stats.surroundedRegions},
+				{"pixel_regions", stats.pixelRegions},
+				{"stolen_regions", stats.steals},
+				{"polygon_tests", stats.polygonTests}};
+	}
+
+private:
+	WarnockSubdivision subdivision;
+};
+
+// BSP树上的画家算法
+class BspEngine : public SoftEngine
+{
+public:
+	explicit BspEngine(ThreadPool &pool) : painter(pool) {}
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image) override
+	{
+		painter.render(scene, shadow, view, image);
+	}
+	size_t depthBytes() const override { return 0; }
+	size_t tableBytes() const override { return painter.tableBytes(); }
+	double visibilityWork() const override { return painter.stats().paintedPixels; }
+	std::vector<std::pair<std::string, double>> frameCounters() const override
+	{
+		const PaintBuffer::Stats &stats = painter.stats();
+		return {{"bsp_nodes", (double)painter.tree().nodes().size()},
+				{"bsp_fragments", (double)painter.tree().fragments().size()},
+				{"bsp_splits", (double)painter.tree().splitCount()},
+				{"painted_pixels", stats.paintedPixels},
+				{"depth_complexity", stats.coveredPixels > 0 ? stats.paintedPixels / stats.coveredPixels : 0.0}};
+	}
+
+private:
+	BspPainter painter;
+};
+
+// 深度排序的画家算法
+class DepthSortEngine : public SoftEngine
+{
+public:
+	explicit DepthSortEngine(ThreadPool &pool) : painter(pool) {}
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image) override
+	{
+		painter.render(scene, shadow, view, image);
+	}
+	size_t depthBytes() const override { return 0; }
+	size_t tableBytes() const override { return painter.tableBytes(); }
+	double visibilityWork() const override { return painter.paintStats().paintedPixels; }
+	std::vector<std::pair<std::string, double>> frameCounters() const override
+	{
+		const DepthSortPainter::Stats &stats = painter.stats();
+		const PaintBuffer::Stats &paint = painter.paintStats();
+		return {{"sorted_polygons", stats.polygons},
+				{"depth_overlap_pairs", stats.depthOverlapPairs},
+				{"extent_resolved_pairs", stats.extentResolved},
+				{"expensive_test_pairs", stats.expensivePairs},
+				{"projection_overlap_tests", stats.projectionTests},
+				{"reorders", stats.reorders},
+				{"splits", stats.splits},
+				{"unresolved_pairs", stats.unresolved},
+				{"painted_pixels", paint.paintedPixels},
+				{"depth_complexity", paint.coveredPixels > 0 ? paint.paintedPixels / paint.coveredPixels : 0.0}};
+	}
+
+private:
+	DepthSortPainter painter;
+};
+
+// Weiler-Atherton区域排序，物体精度，可以输出SVG
+class WeilerEngine : public SoftEngine
+{
+public:
+	explicit WeilerEngine(ThreadPool &pool) : sorter(pool) {}
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image) override
+	{
+		sorter.render(scene, shadow, view, image);
+	}
+	size_t depthBytes() const override { return 0; }
+	size_t tableBytes() const override { return sorter.tableBytes(); }
+	double visibilityWork() const override { return sorter.stats().clips; }
+	std::vector<std::pair<std::string, double>> frameCounters() const override
+	{
+		const WeilerAtherton::Stats &stats = sorter.stats();
+		return {{"input_polygons", stats.inputPolygons},
+				{"clipper_passes", stats.clipperPasses},
+				{"clipped_polygons", stats.clips},
+				{"hidden_fragments", stats.hiddenFragments},
+				{"front_fragments", stats.frontFragments},
+				{"plane_splits", stats.planeSplits},
+				{"visible_polygons", stats.visiblePolygons},
+				{"unresolved_polygons", stats.unresolved},
+				{"arena_bytes", stats.arenaBytes}};
+	}
+	bool setVectorOutput(bool enabled) override
+	{
+		sorter.setVectorOnly(enabled);
+		return true;
+	}
+	bool writeSvg(const std::string &path) const override { return sorter.writeSvg(path); }
+
+private:
+	WeilerAtherton sorter;
+};
+
+// BVH上的包光线投射，阴影用阴影光线
+class RayCastEngine : public SoftEngine
+{
+public:
+	explicit RayCastEngine(ThreadPool &pool) : caster(pool) {}
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image) override
+	{
+		caster.render(scene, shadow, view, image);
+	}
+	size_t depthBytes() const override { return 0; }
+	size_t tableBytes() const override { return caster.tableBytes(); }
+	double visibilityWork() const override { return caster.stats().testedLanes; }
+	std::vector<std::pair<std::string, double>> frameCounters() const override
+	{
+		const RayCaster::Stats &stats = caster.stats();
+		std::vector<std::pair<std::string, double>> counters = {
+			{"bvh_nodes", (double)caster.hierarchy().nodes().size()},
+			{"primary_packets", stats.primaryPackets},
+			{"shadow_packets", stats.shadowPackets},
+			{"node_visits", stats.nodeVisits},
+			{"triangle_tests", stats.triangleTests},
+			{"packet_utilization", stats.triangleTests > 0 ? stats.testedLanes / (stats.triangleTests * RayPacket::SIZE) : 0.0},
+			{"shadowed_pixels", stats.shadowedPixels}};
+		if (caster.checksShadowMap())
+			counters.push_back({"shadow_map_mismatches", stats.shadowMapMismatches});
+		return counters;
+	}
+	bool needsShadowMap() const override { return caster.checksShadowMap(); }
+	bool setShadowMapCheck(bool enabled) override
+	{
+		caster.setShadowMapCheck(enabled);
+		return true;
+	}
+
+private:
+	RayCaster caster;
+};
+
+std::unique_ptr<SoftEngine> createSoftEngine(const std::string &name, ThreadPool &pool)
+{
+	if (name == "zbuffer")
+		return std::unique_ptr<SoftEngine>(new ZBufferEngine(pool));
+	if (name == "scanline")
+		return std::unique_ptr<SoftEngine>(new ScanlineEngine(pool));
+	if (name == "interval")
+		return std::unique_ptr<SoftEngine>(new IntervalEngine(pool));
+	if (name == "warnock")
+		return std::unique_ptr<SoftEngine>(new WarnockEngine(pool));
+	if (name == "bsp")
+		return std::unique_ptr<SoftEngine>(new BspEngine(pool));
+	if (name == "depthsort")
+		return std::unique_ptr<SoftEngine>(new DepthSortEngine(pool));
+	if (name == "weiler")
+		return std::unique_ptr<SoftEngine>(new WeilerEngine(pool));
+	if (name == "raycast")
+		return std::unique_ptr<SoftEngine>(new RayCastEngine(pool));
+	return std::unique_ptr<SoftEngine>();
+}
+
+int runSoftwareRenderer(const RenderOptions &options)
+{
+	ThreadPool pool(options.threads);
+	std::unique_ptr<SoftEngine> engine = createSoftEngine(options.renderer, pool);
+	if (!engine)
+	{
+		std::cout << "Unknown renderer: " << options.renderer << std::endl;
+		return -1;
+	}
+	if (!engine->setVectorOutput(options.svgFrames))
+	{
+		std::cout << "The " << options.renderer << " renderer has no vector output, --svg needs --renderer weiler" << std::endl;
+		return -1;
+	}
+	if (!engine->setShadowMapCheck(options.checkShadowMap))
+	{
+		std::cout << "The " << options.renderer << " renderer shades with the shadow map, --check-shadow-map needs --renderer raycast" << std::endl;
+		return -1;
+	}
+
+	// 场景：与GL路径相同的来源；CPU渲染器不监视场景文件
+	Scene scene;
+	if (options.generateCubes > 0)
+		scene = generateStressScene(options.generateCubes, options.generateLights, options.seed);
+	else if (!loadScene(options.scenePath, scene))
+	{
+		std::cout << "Using the built-in scene" << std::endl;
+		scene = defaultScene();
+	}
+	if (options.instances > 0)
+		resizeCubes(scene, options.instances);
+	SoftScene softScene;
+	buildSoftScene(scene, softScene);
+
+	CameraPath cameraPath;
+	if (!options.cameraPath.empty() && !cameraPath.load(options.cameraPath))
+		return -1;
+	if (options.writeFrames)
+		std::filesystem::create_directories(options.outputDir);
+
+	bool benchmark = !options.benchmarkPath.empty();
+	FrameProfiler profiler;
+	if (!options.tracePath.empty() || benchmark)
+		profiler.init({"shadow depth pass", "visibility pass", "frame export"}, options.tracePath, benchmark, false);
+
+	SoftView view;
+	view.width = options.width;
+	view.height = options.height;
+	view.shadowFilter = options.shadowFilter;
+	glm::mat4 projection = cameraProjection(options.width, options.height);
+	Bounds casters = casterBounds(scene);
+	float shadowTexelSize = 0.0f;
+	double shadowTexelSum = 0.0;
+	glm::mat4 shadowLightSpace;		// 深度贴图是按哪个矩阵画的
+
+	// 阴影贴图用tile光栅化器的只写深度模式生成；场景不动，开着缓存时只画一次。用阴影光线的引擎不生成
+	TileRasterizer shadowRasterizer(pool);
+	SoftShadowMap shadow;
+	SoftImage image;
+	int shadowPasses = 0;
+	size_t peakDepthBytes = 0, peakTableBytes = 0;
+	double exportBytes = 0.0;		// 测量帧写出的文件大小之和
+	double visibilityWork = 0.0;	// 测量帧的消隐工作量之和
+	std::vector<std::pair<std::string, double>> counterSums;	// 测量帧的引擎计数之和
+
+	// 与GL的无窗口模式相同的固定时间线：预热帧在0时刻之前
+	const double TIMELINE_FPS = 60.0;
+	int warmupFrames = benchmark ? options.warmupFrames : 0;
+	auto renderStart = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < warmupFrames + options.frames; frame++)
+	{
+		int timelineFrame = frame - warmupFrames;
+		profiler.beginFrame();
+		// 相机决定光源视角的范围（--light-fit camera），要在阴影pass之前定下来
+		glm::vec3 target;
+		cameraPose(timelineFrame / TIMELINE_FPS, cameraPath, view.viewPosition, target);
+		glm::mat4 cameraView = glm::lookAt(view.viewPosition, target, glm::vec3(0.0f, 1.0f, 0.0f));
+		view.viewProjection = projection * cameraView;
+		view.lightSpace = fittedLightSpaceMatrix(scene.lights[0].position, options.lightFit, casters, cameraView,
+												 (float)options.width / options.height, CAMERA_NEAR, options.shadowDistance, options.shadowSize,
+												 shadowTexelSize);
+		view.shadowDepthPerTexel = shadowDepthPerTexel(view.lightSpace, options.shadowSize);
+		view.shadowDirection = shadowDirection(view.lightSpace);
+		if (timelineFrame >= 0)
+			shadowTexelSum += shadowTexelSize;
+		if (engine->needsShadowMap() && (shadowPasses == 0 || !options.shadowCache || view.lightSpace != shadowLightSpace))
+		{
+			ProfileScope shadowScope(profiler, SOFT_PASS_SHADOW);
+			shadowRasterizer.renderDepth(softScene, softScene.casterCount, view.lightSpace, options.shadowSize, shadow);
+			shadowPasses++;
+			shadowLightSpace = view.lightSpace;
+		}
+
+		{
+			ProfileScope visibleScope(profiler, SOFT_PASS_VISIBLE);
+			engine->render(softScene, shadow, view, image);
+		}
+		peakDepthBytes = std::max(peakDepthBytes, engine->depthBytes());
+		peakTableBytes = std::max(peakTableBytes, engine->tableBytes());
+		if (timelineFrame >= 0)
+		{
+			visibilityWork += engine->visibilityWork();
+			std::vector<std::pair<std::string, double>> counters = engine->frameCounters();
+			counterSums.resize(counters.size());
+			for (size_t i = 0; i < counters.size(); i++)
+			{
+				counterSums[i].first = counters[i].first;
+				counterSums[i].second += counters[i].second;
+			}
+		}
+
+		if (options.writeFrames && timelineFrame >= 0)
+		{
+			ProfileScope exportScope(profiler, SOFT_PASS_EXPORT);
+			char framePath[64];
+			snprintf(framePath, sizeof(framePath), options.svgFrames ? "/frame_%04d.svg" : "/frame_%04d.ppm", timelineFrame);
+			std::string path = options.outputDir + framePath;
+			bool written = options.svgFrames ? engine->writeSvg(path) : image.writePPM(path.c_str());
+			std::error_code error;
+			if (written)
+				exportBytes += (double)std::filesystem::file_size(path, error);
+		}
+		profiler.endFrame();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+	int frames = warmupFrames + options.frames;
+	std::cout << "Rendered " << frames << " frames with the " << options.renderer << " renderer on " << pool.size()
+			  << " threads in " << seconds << " s (" << seconds * 1000.0 / frames << " ms/frame), "
+			  << softScene.triangles.size() << " triangles, depth storage " << peakDepthBytes / 1024.0 << " KiB, tables "
+			  << peakTableBytes / 1024.0 << " KiB" << std::endl;
+	for (const std::pair<std::string, double> &counter : counterSums)
+		std::cout << "  " << counter.first << ": " << counter.second / options.frames << " per frame" << std::endl;
+	double workPerPixel = visibilityWork / ((double)options.frames * options.width * options.height);
+	std::cout << "  visibility work: " << workPerPixel << " per pixel" << std::endl;
+
+	ImageAgreement agreement;
+	bool compared = !options.referenceDir.empty() && compareFrames(options.outputDir, options.referenceDir, options.frames, agreement);
+	if (compared)
+		std::cout << "Agreement with " << options.referenceDir << ": min PSNR " << agreement.minPsnr << " dB, mean abs error "
+				  << agreement.meanAbsError << ", at most " << agreement.maxMismatchPercent << "% pixels off" << std::endl;
+
+	profiler.shutdown();
+	if (benchmark)
+	{
+		BenchmarkInfo info;
+		info.scenePath = options.scenePath;
+		info.cameraPath = options.cameraPath;
+		info.engine = options.renderer;
+		info.renderer = "CPU " + options.renderer + " (" + std::to_string(pool.size()) + " threads)";
+		for (const SceneObject &object : scene.objects)
+			info.cubes += object.mesh == MESH_CUBE;
+		info.lights = (int)scene.lights.size();
+		info.shadowSize = options.shadowSize;
+		info.width = options.width;
+		info.height = options.height;
+		info.warmupFrames = warmupFrames;
+		info.measuredFrames = options.frames;
+		info.timelineFps = TIMELINE_FPS;
+		info.instancing = options.instancing;
+		info.shadowCache = options.shadowCache;
+		info.shadowFilter = shadowFilterName(options.shadowFilter);
+		info.visibilityBytes = (double)(peakDepthBytes + peakTableBytes);
+		info.counters.push_back({"threads", (double)pool.size()});
+		info.counters.push_back({"triangles", (double)softScene.triangles.size()});
+		info.counters.push_back({"depth_storage_bytes", (double)peakDepthBytes});
+		info.counters.push_back({"table_bytes", (double)peakTableBytes});
+		info.counters.push_back({"shadow_passes_executed", (double)shadowPasses});
+		info.counters.push_back({"shadow_texel_size", shadowTexelSum / options.frames});
+		info.counters.push_back({"shadow_filter_taps", (double)shadowFilterTaps(options.shadowFilter)});
+		info.counters.push_back({"shadow_filter_texels", (double)shadowFilterTexels(options.shadowFilter)});
+		info.counters.push_back({"export_bytes_per_frame", exportBytes / options.frames});
+		for (const std::pair<std::string, double> &counter : counterSums)
+			info.counters.push_back({counter.first + "_per_frame", counter.second / options.frames});
+		info.counters.push_back({"visibility_work_per_pixel", workPerPixel});
+		if (compared)
+		{
+			info.counters.push_back({"image_psnr_db", agreement.minPsnr});
+			info.counters.push_back({"image_mean_abs_error", agreement.meanAbsError});
+			info.counters.push_back({"image_mismatch_percent", agreement.maxMismatchPercent});
+		}
+		writeBenchmarkReport(options.benchmarkPath, info, profiler);
+		if (!options.benchmarkCsvPath.empty())
+			appendBenchmarkCsv(options.benchmarkCsvPath, info, profiler);
+		if (!options.compareCsvPath.empty())
+			appendComparisonCsv(options.compareCsvPath, info, profiler);
+	}
+	return 0;
+}
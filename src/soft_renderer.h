@@ -0,0 +1,44 @@
+#ifndef SOFT_RENDERER_H
+#define SOFT_RENDERER_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "options.h"
+#include "soft_scene.h"
+#include "thread_pool.h"
+
+// CPU渲染引擎：各种消隐算法实现同一个接口，用 --renderer <名字> 选择。
+// 着色、阴影贴图和输出都是共用的（见soft_scene.h），引擎之间只有"每个像素看到哪个三角形"的求法不同
+class SoftEngine
+{
+public:
+	virtual ~SoftEngine() {}
+	// 画出一帧。shadow是0号光源的阴影贴图，所有引擎共用同一张
+	virtual void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image) = 0;
+	// 上一帧消隐所用的内存（字节）：深度存储，以及三角形、边等中间表
+	virtual size_t depthBytes() const = 0;
+	virtual size_t tableBytes() const = 0;
+	// 上一帧的引擎专有计数（例如省下的深度比较次数），基准测试报告里给出测量帧的平均值
+	virtual std::vector<std::pair<std::string, double>> frameCounters() const { return {}; }
+	// 上一帧消隐的主要工作量，按各自最内层循环的操作计数（z-buffer是深度测试的片段，画家算法是写入的像素，
+	// 光线投射是光线与三角形的求交……），除以像素数就是引擎之间可以比较的逐像素工作量
+	virtual double visibilityWork() const = 0;
+	// 矢量输出：只有求可见多边形的引擎支持。打开后render不再写image，帧用writeSvg输出
+	virtual bool setVectorOutput(bool enabled) { return !enabled; }
+	virtual bool writeSvg(const std::string &) const { return false; }
+	// 自己求阴影、不查阴影贴图的引擎返回false，这时不生成阴影贴图，render收到的是空贴图
+	virtual bool needsShadowMap() const { return true; }
+	// 诊断：另外查阴影贴图，与引擎自己的阴影比较；只有不用阴影贴图的引擎支持
+	virtual bool setShadowMapCheck(bool enabled) { return !enabled; }
+};
+
+// 按名字创建引擎，名字不认识时返回空
+std::unique_ptr<SoftEngine> createSoftEngine(const std::string &name, ThreadPool &pool);
+
+// 不创建GL上下文，整个渲染循环在CPU上跑；固定时间线、相机路径、帧输出和基准测试报告都与GL的无窗口模式一致，
+// 所以两边输出的帧可以逐张比较，报告也可以放在一起看。成功返回0
+int runSoftwareRenderer(const RenderOptions &options);
+
+#endif
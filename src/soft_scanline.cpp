@@ -0,0 +1,413 @@
+#include "soft_scanline.h"
+#include <algorithm>
+#include <cmath>
+
+// ------------------------分类多边形表和分类边表----------------------------
+
+// 按起始行做计数排序，rowStart[r]是第r行的第一项在order中的位置；不跨过屏幕内任何一行的项不进表
+template <typename Item>
+static bool coversScreenRow(const Item &item, int height)
+{
+	return item.firstRow <= item.lastRow && item.firstRow < height && item.lastRow >= 0;
+}
+
+template <typename Item>
+static void bucketByRow(const std::vector<Item> &items, int height, std::vector<unsigned int> &order,
+						std::vector<unsigned int> &rowStart)
+{
+	rowStart.assign(height + 1, 0);
+	for (const Item &item : items)
+		if (coversScreenRow(item, height))
+			rowStart[std::max(item.firstRow, 0) + 1]++;
+	for (int row = 0; row < height; row++)
+		rowStart[row + 1] += rowStart[row];
+	order.resize(rowStart[height]);
+	std::vector<unsigned int> next(rowStart.begin(), rowStart.end() - 1);
+	for (size_t i = 0; i < items.size(); i++)
+		if (coversScreenRow(items[i], height))
+			order[next[std::max(items[i].firstRow, 0)]++] = (unsigned int)i;
+}
+
+void ScanlineTables::build(const SoftScene &scene, const glm::mat4 &transform, int width, int height)
+{
+	polygons.clear();
+	edges.clear();
+	for (size_t i = 0; i < scene.triangles.size(); i++)
+	{
+		ScreenTriangle clipped[3];
+		int n = projectTriangle(scene.triangles[i], transform, width, height, (unsigned int)i, clipped);
+		for (int j = 0; j < n; j++)
+		{
+			const glm::vec3 *v = clipped[j].screen;
+			float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+			if (!(area != 0.0f) || !std::isfinite(area))
+				continue;
+			float minX = std::min(std::min(v[0].x, v[1].x), v[2].x), maxX = std::max(std::max(v[0].x, v[1].x), v[2].x);
+			if (std::ceil(minX - 0.5f) >= width || std::ceil(maxX - 0.5f) <= 0)
+				continue;	// 整个在屏幕左右两侧之外
+
+			ScanPolygon polygon;
+			polygon.screen = clipped[j];
+			polygon.x0 = v[0].x;
+			polygon.y0 = v[0].y;
+			polygon.zBase = v[0].z;
+			polygon.zdx = ((v[1].z - v[0].z) * (v[2].y - v[0].y) - (v[2].z - v[0].z) * (v[1].y - v[0].y)) / area;
+			polygon.zdy = ((v[2].z - v[0].z) * (v[1].x - v[0].x) - (v[1].z - v[0].z) * (v[2].x - v[0].x)) / area;
+			polygon.firstRow = height;
+			polygon.lastRow = -1;
+			ScanEdge polygonEdges[3];
+			for (int k = 0; k < 3; k++)
+			{
+				const glm::vec3 &a = v[k], &b = v[(k + 1) % 3];
+				const glm::vec3 &low = a.y <= b.y ? a : b, &high = a.y <= b.y ? b : a;
+				ScanEdge &edge = polygonEdges[k];
+				edge.polygon = (unsigned int)polygons.size();
+				edge.firstRow = (int)std::ceil(low.y - 0.5f);
+				edge.lastRow = (int)std::ceil(high.y - 0.5f) - 1;
+				edge.dxdy = high.y > low.y ? ((double)high.x - low.x) / ((double)high.y - low.y) : 0.0;
+				edge.x = low.x + (edge.firstRow + 0.5 - low.y) * edge.dxdy;
+				if (edge.firstRow <= edge.lastRow)
+				{
+					polygon.firstRow = std::min(polygon.firstRow, edge.firstRow);
+					polygon.lastRow = std::max(polygon.lastRow, edge.lastRow);
+				}
+			}
+			// 不跨过任何采样行，或者整个在屏幕上下之外
+			if (polygon.firstRow > polygon.lastRow || polygon.lastRow < 0 || polygon.firstRow >= height)
+				continue;
+			polygons.push_back(polygon);
+			edges.insert(edges.end(), polygonEdges, polygonEdges + 3);
+		}
+	}
+	bucketByRow(polygons, height, polygonOrder, polygonRowStart);
+	bucketByRow(edges, height, edgeOrder, edgeRowStart);
+}
+
+size_t ScanlineTables::bytes() const
+{
+	return polygons.capacity() * sizeof(ScanPolygon) + edges.capacity() * sizeof(ScanEdge) +
+		   (polygonOrder.capacity() + polygonRowStart.capacity() + edgeOrder.capacity() + edgeRowStart.capacity()) *
+			   sizeof(unsigned int);
+}
+
+// ------------------------扫描线z-buffer----------------------------
+
+ScanlineZBuffer::ScanlineZBuffer(ThreadPool &pool) : pool(pool)
+{
+	rows.resize(pool.size());
+}
+
+size_t ScanlineZBuffer::depthBytes() const
+{
+	return rows.size() * width * (sizeof(float) + sizeof(const ScanPolygon *));
+}
+
+size_t ScanlineZBuffer::tableBytes() const
+{
+	size_t bytes = tables.bytes();
+	for (const RowState &state : rows)
+		bytes += state.peakActive * sizeof(ActiveEdgePair);
+	return bytes;
+}
+
+double ScanlineZBuffer::fragments() const
+{
+	double fragments = 0;
+	for (const RowState &state : rows)
+		fragments += state.fragments;
+	return fragments;
+}
+
+// 多边形在row行成为活化多边形：从边表里找出与这一行相交的两条边
+bool ScanlineZBuffer::activate(unsigned int polygon, int row, ActiveEdgePair &pair) const
+{
+	int found = 0;
+	for (int k = 0; k < 3 && found < 2; k++)
+	{
+		const ScanEdge &edge = tables.edges[polygon * 3 + k];
+		if (edge.firstRow <= row && row <= edge.lastRow)
+		{
+			pair.side[found].x = edge.xAt(row);
+			pair.side[found].dxdy = edge.dxdy;
+			pair.side[found].lastRow = edge.lastRow;
+			found++;
+		}
+	}
+	pair.polygon = polygon;
+	return found == 2;
+}
+
+void ScanlineZBuffer::renderBand(int firstRow, int lastRow, RowState &state, const SoftScene &scene,
+								 const SoftShadowMap &shadow, const SoftView &view, SoftImage &image) const
+{
+	std::vector<ActiveEdgePair> &active = state.active;
+	active.clear();
+	ActiveEdgePair pair;
+	// 条带开始之前就已经出现、还没结束的多边形
+	for (unsigned int i = 0; i < tables.polygonRowStart[firstRow]; i++)
+	{
+		unsigned int polygon = tables.polygonOrder[i];
+		if (tables.polygons[polygon].lastRow >= firstRow && activate(polygon, firstRow, pair))
+			active.push_back(pair);
+	}
+
+	for (int row = firstRow; row <= lastRow; row++)
+	{
+		// 分类多边形表中从这一行开始的多边形加入活化表
+		for (unsigned int i = tables.polygonRowStart[row]; i < tables.polygonRowStart[row + 1]; i++)
+			if (activate(tables.polygonOrder[i], row, pair))
+				active.push_back(pair);
+		state.peakActive = std::max(state.peakActive, active.size());
+
+		// 一行的z-buffer
+		std::fill(state.depth.begin(), state.depth.end(), 1.0f);
+		std::fill(state.visible.begin(), state.visible.end(), (const ScanPolygon *)NULL);
+		float y = row + 0.5f;
+		for (const ActiveEdgePair &edgePair : active)
+		{
+			const ScanPolygon &polygon = tables.polygons[edgePair.polygon];
+			double left = std::min(edgePair.side[0].x, edgePair.side[1].x);
+			double right = std::max(edgePair.side[0].x, edgePair.side[1].x);
+			int x0 = std::max(0, (int)std::ceil(left - 0.5)), x1 = std::min(width, (int)std::ceil(right - 0.5));
+			if (x0 >= x1)
+				continue;
+			state.fragments += x1 - x0;
+			// 跨度起点的深度由平面方程求出，之后每个像素只加一次zdx
+			float z = polygon.depthAt(x0 + 0.5f, y);
+			for (int x = x0; x < x1; x++, z += polygon.zdx)
+			{
+				const ScanPolygon *current = state.visible[x];
+				// GL_LESS；深度相同时源三角形下标小的优先，与TileRasterizer一致
+				if (z < state.depth[x] || (current && z == state.depth[x] && polygon.screen.source < current->screen.source))
+				{
+					state.depth[x] = z;
+					state.visible[x] = &polygon;
+				}
+			}
+		}
+		for (int x = 0; x < width; x++)
+		{
+			const ScanPolygon *visible = state.visible[x];
+			image.set(x, row, visible ? shadePixel(scene, shadow, view, visible->screen, x, row) : SOFT_CLEAR_COLOR);
+		}
+
+		// 更新活化边表：交点沿斜率移到下一行；走完的边换成同一多边形从下一行开始的边，多边形走完则移出
+		for (size_t i = 0; i < active.size();)
+		{
+			ActiveEdgePair &edgePair = active[i];
+			bool alive = tables.polygons[edgePair.polygon].lastRow > row;
+			for (int side = 0; side < 2 && alive; side++)
+			{
+				ActiveEdge &edge = edgePair.side[side];
+				if (edge.lastRow > row)
+				{
+					edge.x += edge.dxdy;
+					continue;
+				}
+				alive = false;
+				for (int k = 0; k < 3; k++)
+				{
+					const ScanEdge &next = tables.edges[edgePair.polygon * 3 + k];
+					if (next.firstRow == row + 1 && next.firstRow <= next.lastRow)
+					{
+						edge.x = next.x;
+						edge.dxdy = next.dxdy;
+						edge.lastRow = next.lastRow;
+						alive = true;
+						break;
+					}
+				}
+			}
+			if (alive)
+			{
+				i++;
+				continue;
+			}
+			edgePair = active.back();
+			active.pop_back();
+		}
+	}
+}
+
+void ScanlineZBuffer::render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image)
+{
+	width = view.width;
+	tables.build(scene, view.viewProjection, view.width, view.height);
+	image.resize(view.width, view.height);
+	for (RowState &state : rows)
+	{
+		state.depth.resize(width);
+		state.visible.resize(width);
+		state.peakActive = 0;
+		state.fragments = 0;
+	}
+	// 单线程时整个画面是一条带；多线程时多分几条，让先做完的线程去取剩下的
+	int bands = pool.size() == 1 ? 1 : std::min(view.height, pool.size() * 4);
+	pool.parallelFor(bands, [&](int band, int worker) {
+		int firstRow = (int)((long long)view.height * band / bands);
+		int lastRow = (int)((long long)view.height * (band + 1) / bands) - 1;
+		renderBand(firstRow, lastRow, rows[worker], scene, shadow, view, image);
+	});
+}
+
+// ------------------------区间扫描线----------------------------
+
+IntervalScanline::IntervalScanline(ThreadPool &pool) : pool(pool)
+{
+	rows.resize(pool.size());
+}
+
+size_t IntervalScanline::tableBytes() const
+{
+	size_t bytes = tables.bytes();
+	for (const RowState &state : rows)
+		bytes += state.peakActive * sizeof(ActiveEdge) + state.peakInside * sizeof(unsigned int);
+	return bytes;
+}
+
+unsigned int IntervalScanline::nearestAt(const std::vector<unsigned int> &inside, float x, float y, Stats &stats) const
+{
+	unsigned int nearest = inside[0];
+	float nearestZ = tables.polygons[nearest].depthAt(x, y);
+	for (size_t i = 1; i < inside.size(); i++)
+	{
+		const ScanPolygon &polygon = tables.polygons[inside[i]];
+		float z = polygon.depthAt(x, y);
+		if (z < nearestZ || (z == nearestZ && polygon.screen.source < tables.polygons[nearest].screen.source))
+		{
+			nearest = inside[i];
+			nearestZ = z;
+		}
+	}
+	stats.comparisons += (double)(inside.size() - 1);
+	return nearest;
+}
+
+int IntervalScanline::resolveInterval(const std::vector<unsigned int> &inside, int x0, int x1, float y, Stats &stats) const
+{
+	if (inside.size() == 1)
+		return (int)inside[0];
+	// 两个平面的深度差沿x是线性的：两端都是它最近，整个区间就都是它最近
+	unsigned int left = nearestAt(inside, x0 + 0.5f, y, stats);
+	if (x1 - x0 == 1)
+		return (int)left;
+	unsigned int right = nearestAt(inside, x1 - 0.5f, y, stats);
+	if (left == right)
+		return (int)left;
+	stats.splitIntervals++;
+	return -1;
+}
+
+void IntervalScanline::renderBand(int firstRow, int lastRow, RowState &state, const SoftScene &scene,
+								  const SoftShadowMap &shadow, const SoftView &view, SoftImage &image) const
+{
+	std::vector<ActiveEdge> &active = state.active;
+	std::vector<unsigned int> &inside = state.inside;
+	active.clear();
+	int width = view.width;
+	// 条带开始之前就已经出现、还没结束的边
+	for (unsigned int i = 0; i < tables.edgeRowStart[firstRow]; i++)
+	{
+		const ScanEdge &edge = tables.edges[tables.edgeOrder[i]];
+		if (edge.lastRow >= firstRow)
+			active.push_back({edge.xAt(firstRow), edge.dxdy, edge.lastRow, edge.polygon});
+	}
+
+	for (int row = firstRow; row <= lastRow; row++)
+	{
+		// 分类边表中从这一行开始的边
+		for (unsigned int i = tables.edgeRowStart[row]; i < tables.edgeRowStart[row + 1]; i++)
+		{
+			const ScanEdge &edge = tables.edges[tables.edgeOrder[i]];
+			active.push_back({edge.xAt(row), edge.dxdy, edge.lastRow, edge.polygon});
+		}
+		// 插入排序：上一行的次序基本还对，只有交叉的边和新插入的边需要挪动
+		for (size_t i = 1; i < active.size(); i++)
+		{
+			ActiveEdge edge = active[i];
+			size_t j = i;
+			for (; j > 0 && active[j - 1].x > edge.x; j--)
+				active[j] = active[j - 1];
+			active[j] = edge;
+		}
+		state.peakActive = std::max(state.peakActive, active.size());
+
+		// 从左到右扫过所有交点：每个交点进入或离开一个多边形，两个交点之间是一个区间
+		float y = row + 0.5f;
+		int cursor = 0;		// 还没写的第一个像素
+		inside.clear();
+		for (size_t i = 0; i <= active.size(); i++)
+		{
+			int x = i < active.size() ? std::min(std::max((int)std::ceil(active[i].x - 0.5), 0), width) : width;
+			if (x > cursor)
+			{
+				if (inside.empty())
+				{
+					for (int px = cursor; px < x; px++)
+						image.set(px, row, SOFT_CLEAR_COLOR);
+				}
+				else
+				{
+					state.stats.intervals++;
+					state.stats.zbufferComparisons += (double)inside.size() * (x - cursor);
+					int visible = resolveInterval(inside, cursor, x, y, state.stats);
+					for (int px = cursor; px < x; px++)
+					{
+						unsigned int polygon = visible >= 0 ? (unsigned int)visible : nearestAt(inside, px + 0.5f, y, state.stats);
+						image.set(px, row, shadePixel(scene, shadow, view, tables.polygons[polygon].screen, px, row));
+					}
+				}
+				cursor = x;
+			}
+			if (i == active.size())
+				break;
+			unsigned int polygon = active[i].polygon;
+			std::vector<unsigned int>::iterator found = std::find(inside.begin(), inside.end(), polygon);
+			if (found == inside.end())
+				inside.push_back(polygon);
+			else
+			{
+				*found = inside.back();
+				inside.pop_back();
+			}
+			state.peakInside = std::max(state.peakInside, inside.size());
+		}
+
+		// 交点移到下一行，删去走完的边
+		size_t kept = 0;
+		for (size_t i = 0; i < active.size(); i++)
+		{
+			if (active[i].lastRow <= row)
+				continue;
+			active[kept] = active[i];
+			active[kept].x += active[kept].dxdy;
+			kept++;
+		}
+		active.resize(kept);
+	}
+}
+
+void IntervalScanline::render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image)
+{
+	tables.build(scene, view.viewProjection, view.width, view.height);
+	image.resize(view.width, view.height);
+	for (RowState &state : rows)
+	{
+		state.peakActive = state.peakInside = 0;
+		state.stats = Stats();
+	}
+	int bands = pool.size() == 1 ? 1 : std::min(view.height, pool.size() * 4);
+	pool.parallelFor(bands, [&](int band, int worker) {
+		int firstRow = (int)((long long)view.height * band / bands);
+		int lastRow = (int)((long long)view.height * (band + 1) / bands) - 1;
+		renderBand(firstRow, lastRow, rows[worker], scene, shadow, view, image);
+	});
+	frameStats = Stats();
+	for (const RowState &state : rows)
+	{
+		frameStats.intervals += state.stats.intervals;
+		frameStats.splitIntervals += state.stats.splitIntervals;
+		frameStats.comparisons += state.stats.comparisons;
+		frameStats.zbufferComparisons += state.stats.zbufferComparisons;
+	}
+}
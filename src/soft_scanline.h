@@ -0,0 +1,156 @@
+#ifndef SOFT_SCANLINE_H
+#define SOFT_SCANLINE_H
+
+#include <vector>
+#include "soft_scene.h"
+#include "thread_pool.h"
+
+// 扫描线类消隐算法共用的分类多边形表和分类边表。
+// 采样约定与TileRasterizer相同：第r行的采样点在 y = r + 0.5；一条边覆盖y坐标在[下端点, 上端点)之间的采样行，
+// 一段跨度覆盖x坐标在[左端, 右端)之间的像素中心，所以公共边上的像素只属于相邻两个三角形中的一个。
+struct ScanPolygon
+{
+	ScreenTriangle screen;
+	float zBase, zdx, zdy;		// 深度平面 z = zBase + zdx * (x - x0) + zdy * (y - y0)
+	float x0, y0;
+	int firstRow, lastRow;		// 覆盖的采样行（没有截到屏幕内）
+
+	float depthAt(float x, float y) const { return zBase + zdx * (x - x0) + zdy * (y - y0); }
+};
+
+struct ScanEdge
+{
+	double x;					// 与firstRow行采样线的交点
+	double dxdy;				// 每上移一行x的增量
+	int firstRow, lastRow;		// firstRow > lastRow 表示这条边不跨过任何采样行（水平边）
+	unsigned int polygon;
+
+	double xAt(int row) const { return x + (row - firstRow) * dxdy; }
+};
+
+class ScanlineTables
+{
+public:
+	// 裁剪、投影scene的全部三角形并建表
+	void build(const SoftScene &scene, const glm::mat4 &transform, int width, int height);
+	// 两张表（含分类索引）占用的内存
+	size_t bytes() const;
+
+	std::vector<ScanPolygon> polygons;
+	std::vector<ScanEdge> edges;		// 第i个多边形的三条边是edges[3i]、edges[3i+1]、edges[3i+2]
+	// 分类索引：按起始行分桶（起始行在屏幕下方的归到第0行），
+	// 第r行开始的多边形是 polygonOrder[polygonRowStart[r] .. polygonRowStart[r+1])，边同理
+	std::vector<unsigned int> polygonOrder, polygonRowStart;
+	std::vector<unsigned int> edgeOrder, edgeRowStart;
+};
+
+// 扫描线z-buffer：逐行处理，只需要一行的深度缓冲。
+// 分类多边形表给出每一行新出现的多边形，活化边表里每个活化多边形有左右一对边，
+// 逐行用边的斜率增量更新交点，沿着跨度用深度平面的x增量逐像素更新深度。
+// 多线程时画面按行分成若干条带，每条带独立维护自己的活化边表和一行深度缓冲。
+class ScanlineZBuffer
+{
+public:
+	explicit ScanlineZBuffer(ThreadPool &pool);
+
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image);
+
+	// 深度存储：每个线程一行深度 + 一行可见多边形
+	size_t depthBytes() const;
+	// 多边形表、边表和活化边表
+	size_t tableBytes() const;
+	// 上一帧跨度上做过深度比较的片段数
+	double fragments() const;
+
+private:
+	struct ActiveEdge
+	{
+		double x, dxdy;
+		int lastRow;
+	};
+
+	// 活化边表的一项：一个活化多边形和它与当前行相交的两条边
+	struct ActiveEdgePair
+	{
+		unsigned int polygon;
+		ActiveEdge side[2];
+	};
+
+	// 一个线程的行缓冲和活化边表
+	struct RowState
+	{
+		std::vector<float> depth;
+		std::vector<const ScanPolygon *> visible;
+		std::vector<ActiveEdgePair> active;
+		size_t peakActive = 0;
+		double fragments = 0;
+	};
+
+	bool activate(unsigned int polygon, int row, ActiveEdgePair &pair) const;
+	void renderBand(int firstRow, int lastRow, RowState &state, const SoftScene &scene, const SoftShadowMap &shadow,
+					const SoftView &view, SoftImage &image) const;
+
+	ThreadPool &pool;
+	ScanlineTables tables;
+	std::vector<RowState> rows;
+	int width = 0;
+};
+
+// 区间扫描线：不要深度缓冲。每一行把活化边按交点x排好序，相邻两个交点之间的区间里覆盖的多边形集合不变，
+// 深度沿x又是线性的，所以只需比较区间两端的深度：两端最近的是同一个多边形，它就在整个区间可见；
+// 不同（多边形互相穿插）时这个区间才逐像素比较。
+// 活化边表在行与行之间增量更新：交点按斜率移动、删去走完的边、插入分类边表中这一行开始的边，
+// 再做一遍插入排序（相邻两行的次序几乎不变，接近线性时间）。
+class IntervalScanline
+{
+public:
+	// 与逐像素z-buffer相比的深度比较次数
+	struct Stats
+	{
+		double intervals = 0;			// 处理过的非空区间
+		double splitIntervals = 0;		// 两端最近的多边形不同、需要逐像素比较的区间
+		double comparisons = 0;			// 实际做的深度比较
+		double zbufferComparisons = 0;	// 同样的画面用z-buffer时的深度测试次数（每个片段一次）
+
+		double saved() const { return zbufferComparisons - comparisons; }
+	};
+
+	explicit IntervalScanline(ThreadPool &pool);
+
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image);
+
+	// 不需要深度存储；表包括多边形表、边表、活化边表和区间内的多边形集合
+	size_t tableBytes() const;
+	const Stats &stats() const { return frameStats; }
+
+private:
+	struct ActiveEdge
+	{
+		double x, dxdy;
+		int lastRow;
+		unsigned int polygon;
+	};
+
+	// 一个线程的活化边表和当前区间内的多边形集合
+	struct RowState
+	{
+		std::vector<ActiveEdge> active;
+		std::vector<unsigned int> inside;
+		size_t peakActive = 0, peakInside = 0;
+		Stats stats;
+	};
+
+	void renderBand(int firstRow, int lastRow, RowState &state, const SoftScene &scene, const SoftShadowMap &shadow,
+					const SoftView &view, SoftImage &image) const;
+	// 区间[x0, x1)内可见的多边形，需要逐像素比较时返回-1
+	int resolveInterval(const std::vector<unsigned int> &inside, int x0, int x1, float y, Stats &stats) const;
+	// 在x处最近的多边形（深度相同时源三角形下标小的优先）
+	unsigned int nearestAt(const std::vector<unsigned int> &inside, float x, float y, Stats &stats) const;
+
+	ThreadPool &pool;
+	ScanlineTables tables;
+	std::vector<RowState> rows;
+	Stats frameStats;
+};
+
+#endif
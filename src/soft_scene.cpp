@@ -0,0 +1,388 @@
+#include "soft_scene.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <stb/stb_image.h>
+#include "meshes.h"
+#include "normal_matrix.h"
+#include "uniform_blocks.h"
+
+// ------------------------纹理----------------------------
+
+bool SoftTexture::load(const std::string &path)
+{
+	levels.clear();
+	int width, height, nrChannels;
+	unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrChannels, 3);
+	if (!data)
+	{
+		std::cout << "Failed to load texture " << path << std::endl;
+		return false;
+	}
+	Level base;
+	base.width = width;
+	base.height = height;
+	base.texels.resize((size_t)width * height);
+	for (size_t i = 0; i < base.texels.size(); i++)
+		base.texels[i] = glm::vec3(data[i * 3], data[i * 3 + 1], data[i * 3 + 2]) / 255.0f;
+	stbi_image_free(data);
+	levels.push_back(std::move(base));
+
+	// 与glGenerateMipmap一样逐级减半，每个纹素取上一级2x2块的平均（奇数边长时边上的块只取到边界）
+	while (levels.back().width > 1 || levels.back().height > 1)
+	{
+		const Level &prev = levels.back();
+		Level next;
+		next.width = std::max(1, prev.width / 2);
+		next.height = std::max(1, prev.height / 2);
+		next.texels.resize((size_t)next.width * next.height);
+		for (int y = 0; y < next.height; y++)
+			for (int x = 0; x < next.width; x++)
+			{
+				int x0 = std::min(x * 2, prev.width - 1), x1 = std::min(x * 2 + 1, prev.width - 1);
+				int y0 = std::min(y * 2, prev.height - 1), y1 = std::min(y * 2 + 1, prev.height - 1);
+				next.texels[(size_t)y * next.width + x] =
+					(prev.texels[(size_t)y0 * prev.width + x0] + prev.texels[(size_t)y0 * prev.width + x1] +
+					 prev.texels[(size_t)y1 * prev.width + x0] + prev.texels[(size_t)y1 * prev.width + x1]) * 0.25f;
+			}
+		levels.push_back(std::move(next));
+	}
+	return true;
+}
+
+static inline int wrapIndex(int i, int size)
+{
+	i %= size;
+	return i < 0 ? i + size : i;
+}
+
+glm::vec3 SoftTexture::bilinear(const Level &level, glm::vec2 uv) const
+{
+	// GL的纹素中心在+0.5处
+	float u = uv.x * level.width - 0.5f, v = uv.y * level.height - 0.5f;
+	float fu = std::floor(u), fv = std::floor(v);
+	float a = u - fu, b = v - fv;
+	int x0 = wrapIndex((int)fu, level.width), x1 = wrapIndex((int)fu + 1, level.width);
+	int y0 = wrapIndex((int)fv, level.height), y1 = wrapIndex((int)fv + 1, level.height);
+	const glm::vec3 *row0 = &level.texels[(size_t)y0 * level.width];
+	const glm::vec3 *row1 = &level.texels[(size_t)y1 * level.width];
+	return (row0[x0] * (1.0f - a) + row0[x1] * a) * (1.0f - b) + (row1[x0] * (1.0f - a) + row1[x1] * a) * b;
+}
+
+glm::vec3 SoftTexture::sample(glm::vec2 uv, float lod) const
+{
+	// 加载失败的纹理在GL里是不完整纹理，采样结果为黑色
+	if (levels.empty())
+		return glm::vec3(0.0f);
+	// 坐标太大时先去掉整数部分，免得乘上纹理尺寸后丢精度
+	uv -= glm::floor(uv);
+	if (!(lod > 0.0f))
+		return bilinear(levels[0], uv);
+	int last = (int)levels.size() - 1;
+	if (lod >= (float)last)
+		return bilinear(levels[last], uv);
+	int level = (int)lod;
+	float t = lod - level;
+	return glm::mix(bilinear(levels[level], uv), bilinear(levels[level + 1], uv), t);
+}
+
+float SoftShadowMap::sample(glm::vec2 uv) const
+{
+	if (size == 0)
+		return 1.0f;
+	uv -= glm::floor(uv);
+	int x = std::min((int)(uv.x * size), size - 1);
+	int y = std::min((int)(uv.y * size), size - 1);
+	return depth[(size_t)y * size + x];
+}
+
+float SoftShadowMap::compare(glm::vec2 uv, float reference) const
+{
+	if (size == 0)
+		return 1.0f;
+	// texel中心在+0.5处，取左下角的texel和到它的小数距离
+	float fx = uv.x * size - 0.5f, fy = uv.y * size - 0.5f;
+	float x0 = std::floor(fx), y0 = std::floor(fy);
+	float ax = fx - x0, ay = fy - y0;
+	float lit[2][2];
+	for (int j = 0; j < 2; j++)
+		for (int i = 0; i < 2; i++)
+		{
+			int x = ((int)x0 + i) % size, y = ((int)y0 + j) % size;
+			x += x < 0 ? size : 0;
+			y += y < 0 ? size : 0;
+			lit[j][i] = reference <= depth[(size_t)y * size + x] ? 1.0f : 0.0f;
+		}
+	return (lit[0][0] * (1.0f - ax) + lit[0][1] * ax) * (1.0f - ay) + (lit[1][0] * (1.0f - ax) + lit[1][1] * ax) * ay;
+}
+
+// ------------------------场景----------------------------
+
+static void appendMesh(std::vector<SoftTriangle> &triangles, const glm::mat4 &model, const glm::mat3 &normal, MeshType mesh, int material)
+{
+	const GLfloat *vertices = mesh == MESH_CUBE ? CUBE_VERTICES : FLOOR_VERTICES;
+	int count = mesh == MESH_CUBE ? CUBE_VERTEX_COUNT : FLOOR_VERTEX_COUNT;
+	// 两个网格的属性顺序不同，见meshes.h
+	int uvOffset = mesh == MESH_CUBE ? 3 : 6, normalOffset = mesh == MESH_CUBE ? 5 : 3;
+	for (int t = 0; t < count; t += 3)
+	{
+		SoftTriangle triangle;
+		triangle.material = material;
+		for (int k = 0; k < 3; k++)
+		{
+			const GLfloat *v = vertices + (t + k) * 8;
+			triangle.v[k].position = glm::vec3(model * glm::vec4(v[0], v[1], v[2], 1.0f));
+			triangle.v[k].normal = normal * glm::vec3(v[normalOffset], v[normalOffset + 1], v[normalOffset + 2]);
+			triangle.v[k].uv = glm::vec2(v[uvOffset], v[uvOffset + 1]);
+		}
+		triangles.push_back(triangle);
+	}
+}
+
+void appendSceneTriangles(const Scene &scene, std::vector<SoftTriangle> &triangles)
+{
+	for (const SceneObject &object : scene.objects)
+	{
+		glm::mat4 model = object.model();
+		appendMesh(triangles, model, normalMatrix(model), object.mesh, scene.findMaterial(object.material));
+	}
+}
+
+bool buildSoftScene(const Scene &scene, SoftScene &soft)
+{
+	static unsigned int lastGeneration = 0;
+	soft = SoftScene();
+	soft.generation = ++lastGeneration;
+	bool ok = true;
+	soft.textures.resize(scene.materials.size());
+	for (size_t i = 0; i < scene.materials.size(); i++)
+	{
+		ok = soft.textures[i].load(scene.materials[i].texturePath) && ok;
+		soft.colors.push_back(scene.materials[i].color);
+	}
+	appendSceneTriangles(scene, soft.triangles);
+	soft.casterCount = soft.triangles.size();
+	// 光源立方体：与GL一样每个光源画一个缩小到0.2倍的正方体
+	for (const SceneLight &light : scene.lights)
+	{
+		glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), light.position), glm::vec3(0.2f));
+		appendMesh(soft.triangles, model, glm::mat3(1.0f), MESH_CUBE, -1);
+	}
+	soft.lights.assign(scene.lights.begin(), scene.lights.begin() + std::min((int)scene.lights.size(), MAX_LIGHTS));
+	return ok;
+}
+
+// ------------------------裁剪与投影----------------------------
+
+struct ClipVertex
+{
+	glm::vec4 clip;
+	glm::vec3 bary;
+};
+
+// 用平面 dot(plane, clip) >= 0 裁剪多边形，返回输出的顶点数
+static int clipPolygon(const ClipVertex *in, int count, const glm::vec4 &plane, ClipVertex *out)
+{
+	int n = 0;
+	for (int i = 0; i < count; i++)
+	{
+		const ClipVertex &a = in[i], &b = in[(i + 1) % count];
+		float da = glm::dot(plane, a.clip), db = glm::dot(plane, b.clip);
+		if (da >= 0.0f)
+			out[n++] = a;
+		if ((da >= 0.0f) != (db >= 0.0f))
+		{
+			float t = da / (da - db);
+			out[n].clip = glm::mix(a.clip, b.clip, t);
+			out[n].bary = glm::mix(a.bary, b.bary, t);
+			n++;
+		}
+	}
+	return n;
+}
+
+int projectTriangle(const SoftTriangle &triangle, const glm::mat4 &transform, int width, int height,
+					unsigned int source, ScreenTriangle *out)
+{
+	ClipVertex polygon[5];
+	unsigned outside[3];
+	for (int k = 0; k < 3; k++)
+	{
+		polygon[k].clip = transform * glm::vec4(triangle.v[k].position, 1.0f);
+		polygon[k].bary = glm::vec3(k == 0, k == 1, k == 2);
+		const glm::vec4 &c = polygon[k].clip;
+		outside[k] = (c.x < -c.w) | (c.x > c.w) << 1 | (c.y < -c.w) << 2 | (c.y > c.w) << 3 |
+					 (c.z < -c.w) << 4 | (c.z > c.w) << 5;
+	}
+	// 三个顶点都在视锥同一个面的外侧
+	if (outside[0] & outside[1] & outside[2])
+		return 0;
+
+	int count = 3;
+	if ((outside[0] | outside[1] | outside[2]) & (1 << 4 | 1 << 5))
+	{
+		// 只有近、远平面需要真正裁剪；左右上下超出屏幕的部分由光栅化时的包围盒截掉
+		ClipVertex temp[5];
+		count = clipPolygon(polygon, count, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f), temp);
+		count = clipPolygon(temp, count, glm::vec4(0.0f, 0.0f, -1.0f, 1.0f), polygon);
+		if (count < 3)
+			return 0;
+	}
+
+	glm::vec3 screen[5];
+	float invW[5];
+	for (int k = 0; k < count; k++)
+	{
+		const glm::vec4 &c = polygon[k].clip;
+		invW[k] = 1.0f / c.w;
+		screen[k] = glm::vec3((c.x * invW[k] * 0.5f + 0.5f) * width, (c.y * invW[k] * 0.5f + 0.5f) * height,
+							  c.z * invW[k] * 0.5f + 0.5f);
+	}
+	// 裁剪后的凸多边形按扇形拆成三角形
+	int triangles = 0;
+	for (int k = 1; k + 1 < count; k++)
+	{
+		ScreenTriangle &t = out[triangles++];
+		const int index[3] = {0, k, k + 1};
+		for (int j = 0; j < 3; j++)
+		{
+			t.screen[j] = screen[index[j]];
+			t.invW[j] = invW[index[j]];
+			t.bary[j] = polygon[index[j]].bary;
+		}
+		t.source = source;
+	}
+	return triangles;
+}
+
+glm::vec3 sourceBarycentric(const ScreenTriangle &triangle, float x, float y)
+{
+	const glm::vec3 &a = triangle.screen[0], &b = triangle.screen[1], &c = triangle.screen[2];
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (area == 0.0f)
+		return triangle.bary[0];
+	float l1 = ((c.x - b.x) * (y - b.y) - (c.y - b.y) * (x - b.x)) / area;
+	float l2 = ((a.x - c.x) * (y - c.y) - (a.y - c.y) * (x - c.x)) / area;
+	float l3 = 1.0f - l1 - l2;
+	// 屏幕空间重心坐标 -> 透视校正
+	float w1 = l1 * triangle.invW[0], w2 = l2 * triangle.invW[1], w3 = l3 * triangle.invW[2];
+	float sum = w1 + w2 + w3;
+	if (sum == 0.0f)
+		return triangle.bary[0];
+	return (triangle.bary[0] * w1 + triangle.bary[1] * w2 + triangle.bary[2] * w3) / sum;
+}
+
+// ------------------------着色----------------------------
+
+glm::vec3 shadePixel(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view,
+					 const ScreenTriangle &triangle, int px, int py)
+{
+	const SoftTriangle &source = scene.triangles[triangle.source];
+	if (source.material < 0)
+		return glm::vec3(1.0f);		// 光源立方体
+
+	glm::vec3 bary = sourceBarycentric(triangle, px + 0.5f, py + 0.5f);
+	// mipmap级别：GL按2x2像素块求纹理坐标的差分，块里4个像素用同一个导数
+	int qx = px & ~1, qy = py & ~1;
+	glm::vec3 b00 = sourceBarycentric(triangle, qx + 0.5f, qy + 0.5f);
+	glm::vec3 b10 = sourceBarycentric(triangle, qx + 1.5f, qy + 0.5f);
+	glm::vec3 b01 = sourceBarycentric(triangle, qx + 0.5f, qy + 1.5f);
+	float lod = textureLod(scene, source, b00, b10, b01);
+
+	glm::vec3 position = source.v[0].position * bary.x + source.v[1].position * bary.y + source.v[2].position * bary.z;
+	glm::vec3 normal = source.v[0].normal * bary.x + source.v[1].normal * bary.y + source.v[2].normal * bary.z;
+	return shadeSurface(scene, view, source, bary, lod, shadowMapFactor(shadow, view, position, normal));
+}
+
+float textureLod(const SoftScene &scene, const SoftTriangle &source, const glm::vec3 &b00, const glm::vec3 &b10,
+				 const glm::vec3 &b01)
+{
+	const SoftTexture &texture = scene.textures[source.material];
+	glm::vec2 uv00 = source.v[0].uv * b00.x + source.v[1].uv * b00.y + source.v[2].uv * b00.z;
+	glm::vec2 dx = (source.v[0].uv * b10.x + source.v[1].uv * b10.y + source.v[2].uv * b10.z - uv00) *
+				   glm::vec2(texture.width(), texture.height());
+	glm::vec2 dy = (source.v[0].uv * b01.x + source.v[1].uv * b01.y + source.v[2].uv * b01.z - uv00) *
+				   glm::vec2(texture.width(), texture.height());
+	float rho = std::max(glm::dot(dx, dx), glm::dot(dy, dy));
+	return rho > 0.0f ? 0.5f * std::log2(rho) : 0.0f;
+}
+
+float shadowMapFactor(const SoftShadowMap &shadow, const SoftView &view, const glm::vec3 &position, const glm::vec3 &normal)
+{
+	glm::vec4 lightSpace = view.lightSpace * glm::vec4(position, 1.0f);
+	glm::vec3 coords = glm::vec3(lightSpace) / lightSpace.w * 0.5f + 0.5f;
+	// 光源视锥体以外没有阴影信息，算作照亮（与GL片段着色器相同）
+	if (coords.z > 1.0f || coords.x < 0.0f || coords.x > 1.0f || coords.y < 0.0f || coords.y > 1.0f)
+		return 0.0f;
+	if (view.shadowFilter == SHADOW_FILTER_HARD)
+		return coords.z > shadow.sample(glm::vec2(coords)) ? 1.0f : 0.0f;
+	float bias = shadowBias(view.shadowFilter, view.shadowDepthPerTexel, glm::dot(glm::normalize(normal), view.shadowDirection));
+	return 1.0f - shadow.compare(glm::vec2(coords), coords.z - bias);
+}
+
+glm::vec3 shadeSurface(const SoftScene &scene, const SoftView &view, const SoftTriangle &source, const glm::vec3 &bary,
+					   float lod, float shadowFactor)
+{
+	if (source.material < 0)
+		return glm::vec3(1.0f);		// 光源立方体
+
+	glm::vec3 position = source.v[0].position * bary.x + source.v[1].position * bary.y + source.v[2].position * bary.z;
+	glm::vec3 normal = source.v[0].normal * bary.x + source.v[1].normal * bary.y + source.v[2].normal * bary.z;
+	glm::vec2 uv = source.v[0].uv * bary.x + source.v[1].uv * bary.y + source.v[2].uv * bary.z;
+	glm::vec3 texel = scene.textures[source.material].sample(uv, lod);
+
+	// 以下与GL片段着色器逐行对应
+	const float ambientStrength = 0.2f;
+	glm::vec3 normal_dir = glm::normalize(normal);
+	glm::vec3 view_dir = glm::normalize(view.viewPosition - position);
+
+	glm::vec3 result(0.0f);
+	for (size_t i = 0; i < scene.lights.size(); i++)
+	{
+		const glm::vec3 &color = scene.lights[i].color;
+		glm::vec3 ambient = ambientStrength * color;
+		glm::vec3 light_dir = glm::normalize(scene.lights[i].position - position);
+		float diffStrength = std::max(glm::dot(normal_dir, light_dir), 0.0f);
+		glm::vec3 diffuse = diffStrength * color;
+		glm::vec3 halfway_dir = glm::normalize(light_dir + view_dir);
+		float specularStrength = std::pow(std::max(glm::dot(view_dir, halfway_dir), 0.0f), 128.0f);
+		glm::vec3 specular = specularStrength * color;
+		float lit = i == 0 ? 1.0f - shadowFactor : 1.0f;
+		result += ambient + lit * (diffuse + specular);
+	}
+	return result * texel * scene.colors[source.material];
+}
+
+// ------------------------图像----------------------------
+
+void SoftImage::resize(int w, int h)
+{
+	width = w;
+	height = h;
+	rgb.assign((size_t)w * h * 3, 0);
+}
+
+void SoftImage::set(int x, int y, const glm::vec3 &color)
+{
+	unsigned char *p = &rgb[((size_t)y * width + x) * 3];
+	for (int c = 0; c < 3; c++)
+		p[c] = (unsigned char)(std::min(std::max(color[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+bool SoftImage::writePPM(const char *path) const
+{
+	FILE *file = fopen(path, "wb");
+	if (!file)
+	{
+		std::cout << "Failed to open " << path << " for writing" << std::endl;
+		return false;
+	}
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	size_t rowBytes = (size_t)width * 3;
+	for (int y = height - 1; y >= 0; y--)
+		fwrite(rgb.data() + y * rowBytes, 1, rowBytes, file);
+	fclose(file);
+	return true;
+}
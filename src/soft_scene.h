@@ -0,0 +1,135 @@
+#ifndef SOFT_SCENE_H
+#define SOFT_SCENE_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "scene.h"
+#include "view_setup.h"
+
+// CPU渲染器共用的数据：世界空间的三角形、纹理、阴影贴图、图像，以及与GL片段着色器一致的着色。
+// 各种消隐算法（z-buffer、扫描线、区域细分……）只负责决定每个像素看到哪个三角形，着色都走这里，
+// 所以它们的输出可以逐像素比较。
+
+// 背景色，与GL的glClearColor一致
+const glm::vec3 SOFT_CLEAR_COLOR(0.2f, 0.3f, 0.3f);
+
+struct SoftVertex
+{
+	glm::vec3 position;		// 世界坐标
+	glm::vec3 normal;		// 世界空间法线（已乘法线矩阵，未归一化）
+	glm::vec2 uv;
+};
+
+struct SoftTriangle
+{
+	SoftVertex v[3];
+	int material;			// Scene::materials中的下标，-1表示光源立方体（纯白，不投射阴影）
+};
+
+// RGB纹理，采样方式与GL_LINEAR_MIPMAP_LINEAR + GL_REPEAT一致
+class SoftTexture
+{
+public:
+	bool load(const std::string &path);
+	int width() const { return levels.empty() ? 0 : levels[0].width; }
+	int height() const { return levels.empty() ? 0 : levels[0].height; }
+	// lod = log2(每个像素覆盖的纹素数)，不大于0时是放大，只用第0级双线性
+	glm::vec3 sample(glm::vec2 uv, float lod) const;
+
+private:
+	struct Level
+	{
+		int width, height;
+		std::vector<glm::vec3> texels;	// 第0行是图片的第一行，对应t=0
+	};
+	glm::vec3 bilinear(const Level &level, glm::vec2 uv) const;
+	std::vector<Level> levels;
+};
+
+// 0号光源的阴影贴图：窗口深度[0,1]，第0行在底部（与GL的纹理坐标一致），GL_REPEAT
+struct SoftShadowMap
+{
+	int size = 0;
+	std::vector<float> depth;
+
+	// 最近点采样
+	float sample(glm::vec2 uv) const;
+	// 与GL的深度比较 + GL_LINEAR相同：相邻2x2个texel各自比较（reference <= 深度为1），再按双线性权重混合，返回照亮的比例
+	float compare(glm::vec2 uv, float reference) const;
+};
+
+struct SoftScene
+{
+	std::vector<SoftTriangle> triangles;	// 投射阴影的三角形（正方体、地板）在前，光源立方体在后
+	size_t casterCount = 0;
+	std::vector<SoftTexture> textures;		// 与Scene::materials一一对应
+	std::vector<glm::vec3> colors;
+	std::vector<SceneLight> lights;			// 参与着色的光源，最多MAX_LIGHTS个
+	// 每次buildSoftScene都取一个新的值（从1开始）。缓存了由三角形建出的结构的引擎按它判断要不要重建，
+	// 不能按地址：场景可能在同一个地址上重建，新场景也可能分配在旧场景释放的地址上
+	unsigned int generation = 0;
+};
+
+// 把场景展开成世界空间三角形并加载纹理
+bool buildSoftScene(const Scene &scene, SoftScene &soft);
+// 只展开场景物体（不含光源立方体）的世界空间三角形，按物体顺序追加到triangles
+void appendSceneTriangles(const Scene &scene, std::vector<SoftTriangle> &triangles);
+
+// 一帧的相机参数
+struct SoftView
+{
+	int width = 0;
+	int height = 0;
+	glm::mat4 viewProjection;
+	glm::mat4 lightSpace;
+	glm::vec3 viewPosition;
+	ShadowFilter shadowFilter = SHADOW_FILTER_HARD;	// 只支持hard和hardware
+	float shadowDepthPerTexel = 0.0f;		// lightSpace的shadowDepthPerTexel
+	glm::vec3 shadowDirection;				// 指向0号光源
+};
+
+// 投影到屏幕上的三角形，可能是被近/远平面裁剪后的一部分
+struct ScreenTriangle
+{
+	glm::vec3 screen[3];		// 像素坐标（GL约定，y向上，像素中心在+0.5处），z为窗口深度[0,1]
+	float invW[3];				// 1/w，用于透视校正插值
+	glm::vec3 bary[3];			// 三个顶点在源三角形中的重心坐标，没被裁剪时是单位矩阵
+	unsigned int source;		// SoftScene::triangles中的下标
+};
+
+// 变换到裁剪空间，对近、远平面做Sutherland-Hodgman裁剪，投影到屏幕；完全在视锥外时返回0。
+// 最多产生3个三角形
+int projectTriangle(const SoftTriangle &triangle, const glm::mat4 &transform, int width, int height,
+					unsigned int source, ScreenTriangle *out);
+
+// 屏幕上(x, y)处透视校正后的源三角形重心坐标
+glm::vec3 sourceBarycentric(const ScreenTriangle &triangle, float x, float y);
+
+// 像素(px, py)看到triangle时的颜色：与GL一样按2x2像素块求纹理坐标的导数来选mipmap级别，再做Blinn-Phong着色
+glm::vec3 shadePixel(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view,
+					 const ScreenTriangle &triangle, int px, int py);
+
+// shadePixel拆开的几步，给不经过屏幕三角形的渲染器（例如光线投射）用。
+// 2x2像素块左下、右下、左上三个像素中心处的源三角形重心坐标（可以在三角形外）-> mipmap级别
+float textureLod(const SoftScene &scene, const SoftTriangle &source, const glm::vec3 &b00, const glm::vec3 &b10,
+				 const glm::vec3 &b01);
+// 0号光源的阴影贴图测试：返回在阴影里的比例，1表示完全在阴影里。normal用于深度偏移（不必是单位向量）
+float shadowMapFactor(const SoftShadowMap &shadow, const SoftView &view, const glm::vec3 &position, const glm::vec3 &normal);
+// 源三角形上bary处的Blinn-Phong着色，0号光源的阴影由调用者给出
+glm::vec3 shadeSurface(const SoftScene &scene, const SoftView &view, const SoftTriangle &source, const glm::vec3 &bary,
+					   float lod, float shadowFactor);
+
+// RGB8图像，第0行在底部（与glReadPixels一致）
+struct SoftImage
+{
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> rgb;
+
+	void resize(int w, int h);
+	void set(int x, int y, const glm::vec3 &color);
+	bool writePPM(const char *path) const;
+};
+
+#endif
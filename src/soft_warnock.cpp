@@ -0,0 +1,271 @@
+#include "soft_warnock.h"
+#include <algorithm>
+#include <thread>
+
+WarnockSubdivision::WarnockSubdivision(ThreadPool &pool) : pool(pool), queues(pool.size()), workers(pool.size())
+{
+}
+
+size_t WarnockSubdivision::tableBytes() const
+{
+	return polygons.capacity() * sizeof(RasterTriangle) + peakListBytes;
+}
+
+void WarnockSubdivision::push(Region &region, int worker)
+{
+	pending++;
+	WorkQueue &queue = queues[worker];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	queue.regions.push_back(std::move(region));
+}
+
+bool WarnockSubdivision::take(Region &region, int worker)
+{
+	// 先从自己队列的底部取
+	{
+		WorkQueue &queue = queues[worker];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.regions.empty())
+		{
+			region = std::move(queue.regions.back());
+			queue.regions.pop_back();
+			return true;
+		}
+	}
+	// 再从别人队列的顶部偷
+	for (size_t i = 1; i < queues.size(); i++)
+	{
+		WorkQueue &queue = queues[(worker + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.regions.empty())
+		{
+			region = std::move(queue.regions.front());
+			queue.regions.pop_front();
+			workers[worker].stats.steals++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void WarnockSubdivision::workerLoop(int worker, const Frame &frame)
+{
+	Region region;
+	while (pending.load() > 0)
+	{
+		if (!take(region, worker))
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		process(region, worker, frame);
+		pending--;
+	}
+}
+
+void WarnockSubdivision::fill(const Region &region, const RasterTriangle *polygon, const Frame &frame) const
+{
+	for (int y = region.y0; y < region.y1; y++)
+		for (int x = region.x0; x < region.x1; x++)
+		{
+			float px = x + 0.5f, py = y + 0.5f;
+			// 与z-buffer一样，深度不小于清除值1.0的片段不可见
+			bool visible = polygon && polygon->covers(px, py) && polygon->depthAt(px, py) < 1.0f;
+			frame.image->set(x, y, visible ? shadePixel(*frame.scene, *frame.shadow, *frame.view, polygon->screen, x, y)
+										   : SOFT_CLEAR_COLOR);
+		}
+}
+
+void WarnockSubdivision::process(Region &region, int worker, const Frame &frame)
+{
+	WorkerState &state = workers[worker];
+	state.stats.nodes++;
+	state.stats.polygonTests += region.count;
+
+	// 相交的多边形接着压在草稿栈上，最多count个；先预留，压栈时不会重新分配，list指针一直有效
+	std::vector<unsigned int> &scratch = state.scratch;
+	size_t base = scratch.size();
+	scratch.reserve(base + region.count);
+	state.peakListBytes = std::max(state.peakListBytes, scratch.capacity() * sizeof(unsigned int) + state.sharedBytes);
+	const unsigned int *list = region.shared ? region.shared->data() : scratch.data() + region.first;
+
+	// 区域内像素中心构成的矩形的四个角；边函数和深度都是线性的，四个角就能确定整个区域的情况
+	const float cx[4] = {region.x0 + 0.5f, region.x1 - 0.5f, region.x0 + 0.5f, region.x1 - 0.5f};
+	const float cy[4] = {region.y0 + 0.5f, region.y0 + 0.5f, region.y1 - 0.5f, region.y1 - 0.5f};
+	std::vector<float> &nearZ = state.nearZ, &farZ = state.farZ;
+	nearZ.clear();
+	farZ.clear();
+	int surrounder = -1;	// inside中的下标
+	for (size_t i = 0; i < region.count; i++)
+	{
+		unsigned int index = list[i];
+		const RasterTriangle &t = polygons[index];
+		if (t.maxX < region.x0 || t.minX >= region.x1 || t.maxY < region.y0 || t.minY >= region.y1)
+			continue;
+		bool outside = false, surrounds = true;
+		for (int k = 0; k < 3 && !outside; k++)
+		{
+			int corners = 0;
+			for (int c = 0; c < 4; c++)
+				corners += t.insideEdge(k, cx[c], cy[c]);
+			// 四个角都在某条边的外侧，区域内所有像素中心也都在外侧
+			outside = corners == 0;
+			surrounds = surrounds && corners == 4;
+		}
+		if (outside)
+			continue;
+		float zMin = 2.0f, zMax = -1.0f;
+		for (int c = 0; c < 4; c++)
+		{
+			float z = t.depthAt(cx[c], cy[c]);
+			zMin = std::min(zMin, z);
+			zMax = std::max(zMax, z);
+		}
+		if (surrounds && (surrounder < 0 || zMax < farZ[surrounder]))
+			surrounder = (int)nearZ.size();
+		scratch.push_back(index);
+		nearZ.push_back(zMin);
+		farZ.push_back(zMax);
+	}
+	const unsigned int *inside = scratch.data() + base;
+	size_t insideCount = scratch.size() - base;
+
+	if (insideCount == 0)
+	{
+		state.stats.emptyRegions++;
+		fill(region, NULL, frame);
+		scratch.resize(base);
+		return;
+	}
+	if (insideCount == 1)
+	{
+		state.stats.singleRegions++;
+		fill(region, &polygons[inside[0]], frame);
+		scratch.resize(base);
+		return;
+	}
+	if (surrounder >= 0 && farZ[surrounder] < 1.0f)
+	{
+		// 包围区域的多边形最远处比其他所有多边形的最近处还近
+		bool front = true;
+		for (size_t i = 0; i < insideCount && front; i++)
+			front = (int)i == surrounder || farZ[surrounder] < nearZ[i];
+		if (front)
+		{
+			state.stats.surroundedRegions++;
+			fill(region, &polygons[inside[surrounder]], frame);
+			scratch.resize(base);
+			return;
+		}
+	}
+	if (region.x1 - region.x0 == 1 && region.y1 - region.y0 == 1)
+	{
+		// 单个像素：与z-buffer相同的规则，深度相同时源三角形下标小的优先
+		state.stats.pixelRegions++;
+		const RasterTriangle *best = NULL;
+		float bestZ = 1.0f;
+		for (size_t i = 0; i < insideCount; i++)
+		{
+			const RasterTriangle &t = polygons[inside[i]];
+			if (!t.covers(cx[0], cy[0]))
+				continue;
+			float z = t.depthAt(cx[0], cy[0]);
+			if (z < bestZ || (best && z == bestZ && t.screen.source < best->screen.source))
+			{
+				best = &t;
+				bestZ = z;
+			}
+		}
+		frame.image->set(region.x0, region.y0,
+						 best ? shadePixel(*frame.scene, *frame.shadow, *frame.view, best->screen, region.x0, region.y0)
+							  : SOFT_CLEAR_COLOR);
+		scratch.resize(base);
+		return;
+	}
+
+	// 分成四块，子区域只带着与这个区域相交的多边形。本线程递归的子区域直接引用草稿栈上的这一段，
+	// 入队的子区域可能被别的线程偷走，共享一份复制出来的列表（每个父区域最多复制一次）
+	int mx = (region.x0 + region.x1 + 1) / 2, my = (region.y0 + region.y1 + 1) / 2;
+	const int bounds[4][4] = {{region.x0, region.y0, mx, my}, {mx, region.y0, region.x1, my},
+							  {region.x0, my, mx, region.y1}, {mx, my, region.x1, region.y1}};
+	std::shared_ptr<const std::vector<unsigned int>> shared;
+	for (int q = 0; q < 4; q++)
+	{
+		Region child;
+		child.x0 = bounds[q][0];
+		child.y0 = bounds[q][1];
+		child.x1 = bounds[q][2];
+		child.y1 = bounds[q][3];
+		if (child.x0 >= child.x1 || child.y0 >= child.y1)
+			continue;
+		child.count = insideCount;
+		if (std::max(child.x1 - child.x0, child.y1 - child.y0) > STEAL_SIZE)
+		{
+			if (!shared)
+			{
+				shared = std::make_shared<const std::vector<unsigned int>>(scratch.begin() + base, scratch.end());
+				state.sharedBytes += insideCount * sizeof(unsigned int);
+			}
+			child.shared = shared;
+			push(child, worker);
+		}
+		else
+		{
+			child.first = base;
+			process(child, worker, frame);
+		}
+	}
+	scratch.resize(base);
+}
+
+void WarnockSubdivision::render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image)
+{
+	polygons.clear();
+	for (size_t i = 0; i < scene.triangles.size(); i++)
+	{
+		ScreenTriangle clipped[3];
+		int n = projectTriangle(scene.triangles[i], view.viewProjection, view.width, view.height, (unsigned int)i, clipped);
+		for (int j = 0; j < n; j++)
+		{
+			RasterTriangle triangle;
+			if (RasterTriangle::setup(clipped[j], view.width, view.height, triangle))
+				polygons.push_back(triangle);
+		}
+	}
+	image.resize(view.width, view.height);
+	// 草稿的容量留到下一帧
+	for (WorkerState &state : workers)
+	{
+		state.stats = Stats();
+		state.sharedBytes = state.peakListBytes = 0;
+	}
+
+	Region root;
+	root.x0 = root.y0 = 0;
+	root.x1 = view.width;
+	root.y1 = view.height;
+	std::vector<unsigned int> all(polygons.size());
+	for (size_t i = 0; i < polygons.size(); i++)
+		all[i] = (unsigned int)i;
+	root.count = all.size();
+	root.shared = std::make_shared<const std::vector<unsigned int>>(std::move(all));
+	size_t rootBytes = root.count * sizeof(unsigned int);
+	push(root, 0);
+
+	Frame frame = {&scene, &shadow, &view, &image};
+	pool.parallelFor(pool.size(), [&](int, int worker) { workerLoop(worker, frame); });
+
+	frameStats = Stats();
+	peakListBytes = rootBytes;
+	for (const WorkerState &state : workers)
+	{
+		frameStats.nodes += state.stats.nodes;
+		frameStats.emptyRegions += state.stats.emptyRegions;
+		frameStats.singleRegions += state.stats.singleRegions;
+		frameStats.surroundedRegions += state.stats.surroundedRegions;
+		frameStats.pixelRegions += state.stats.pixelRegions;
+		frameStats.steals += state.stats.steals;
+		frameStats.polygonTests += state.stats.polygonTests;
+		peakListBytes += state.peakListBytes;
+	}
+}
@@ -0,0 +1,93 @@
+#ifndef SOFT_WARNOCK_H
+#define SOFT_WARNOCK_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "soft_raster.h"
+#include "thread_pool.h"
+
+// Warnock区域细分：从整个屏幕开始，把区域按四叉树递归地分成4块，直到区域满足下列之一：
+//   空        没有多边形与它相交，填背景色
+//   单个多边形 只有一个多边形与它相交，逐像素画这一个
+//   被包围    有一个多边形覆盖整个区域，并且它在区域内的最远深度比其他所有多边形的最近深度还近
+//   单个像素  直接比较覆盖这个像素的多边形
+// 每个节点只带着与父区域相交的多边形往下走，越往下越少。四个子区域共用父区域的一份列表：
+// 本线程递归处理的子区域引用本线程草稿栈里的一段（父区域返回时弹出），入队的子区域共享一份堆上的列表。
+// 多线程：每个线程有自己的双端队列，分出来的子区域压在自己队列的底部，自己从底部取（深度优先，局部性好），
+// 空闲的线程从别人队列的顶部偷（偷到的是靠近根的大区域）。小于STEAL_SIZE的区域不再入队，直接在本线程递归。
+class WarnockSubdivision
+{
+public:
+	struct Stats
+	{
+		double nodes = 0;			// 访问过的四叉树节点
+		double emptyRegions = 0;
+		double singleRegions = 0;
+		double surroundedRegions = 0;
+		double pixelRegions = 0;
+		double steals = 0;			// 从别的线程偷到的节点
+		double polygonTests = 0;	// 多边形与区域的分类测试
+	};
+
+	explicit WarnockSubdivision(ThreadPool &pool);
+
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image);
+
+	// 多边形表和四叉树节点上的多边形列表（取峰值）
+	size_t tableBytes() const;
+	const Stats &stats() const { return frameStats; }
+
+private:
+	static const int STEAL_SIZE = 64;
+
+	struct Region
+	{
+		int x0, y0, x1, y1;		// 像素范围[x0, x1) x [y0, y1)
+		// 与父区域相交的多边形：shared不为空时是它的全部，否则是处理它的线程的scratch中[first, first + count)
+		std::shared_ptr<const std::vector<unsigned int>> shared;
+		size_t first = 0, count = 0;
+	};
+
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<Region> regions;
+	};
+
+	// 一个线程的统计、草稿和列表内存
+	struct WorkerState
+	{
+		Stats stats;
+		std::vector<unsigned int> scratch;	// 递归路径上各层与区域相交的多边形，按栈使用
+		std::vector<float> nearZ, farZ;		// 当前节点里各多边形在区域内的深度范围
+		size_t sharedBytes = 0;				// 本线程为入队的子区域分配的列表（上界：不减去已经处理完的）
+		size_t peakListBytes = 0;
+	};
+
+	struct Frame
+	{
+		const SoftScene *scene;
+		const SoftShadowMap *shadow;
+		const SoftView *view;
+		SoftImage *image;
+	};
+
+	void process(Region &region, int worker, const Frame &frame);
+	void fill(const Region &region, const RasterTriangle *polygon, const Frame &frame) const;
+	void push(Region &region, int worker);
+	bool take(Region &region, int worker);
+	void workerLoop(int worker, const Frame &frame);
+
+	ThreadPool &pool;
+	std::vector<RasterTriangle> polygons;
+	std::vector<WorkQueue> queues;
+	std::vector<WorkerState> workers;
+	std::atomic<int> pending{0};
+	Stats frameStats;
+	size_t peakListBytes = 0;
+};
+
+#endif
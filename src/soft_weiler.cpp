@@ -0,0 +1,396 @@
+#include "soft_weiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+// ------------------------arena----------------------------
+
+PolygonArena::PolygonArena(size_t blockBytes) : blockBytes(blockBytes)
+{
+}
+
+void PolygonArena::reset()
+{
+	current = 0;
+	offset = 0;
+	frameBytes = 0;
+}
+
+void *PolygonArena::allocateBytes(size_t size, size_t alignment)
+{
+	while (true)
+	{
+		if (current < blocks.size())
+		{
+			size_t aligned = (offset + alignment - 1) / alignment * alignment;
+			if (aligned + size <= blocks[current].size)
+			{
+				offset = aligned + size;
+				frameBytes += size;
+				return blocks[current].data.get() + aligned;
+			}
+			// 当前块放不下，换下一块（已有的块下一帧还会从头用）
+			if (offset > 0 || blocks[current].size >= size)
+			{
+				current++;
+				offset = 0;
+				continue;
+			}
+		}
+		Block block;
+		block.size = std::max(blockBytes, size);
+		block.data.reset(new char[block.size]);
+		reservedBytes += block.size;
+		blocks.insert(blocks.begin() + current, std::move(block));
+		offset = 0;
+	}
+}
+
+// ------------------------裁剪----------------------------
+
+// 面积小于这个值（平方像素）的碎片直接丢掉，公共边两侧切出来的细条都是这样
+static const double MIN_AREA = 1e-4;
+// 深度差在这个范围内算作在平面上
+static const double PLANE_TOLERANCE = 1e-7;
+// 距离小于这个值（像素）的相邻顶点合并成一个：切点落在顶点附近时会产生几乎重合的两个顶点，
+// 它们之间那条边的方向完全是舍入误差，拿它当裁剪边会沿一条随意的直线切开别的多边形
+static const float MIN_EDGE = 1e-3f;
+// 换裁剪多边形的链最长多少步，精度出问题时防止来回换
+static const int MAX_CHAIN = 64;
+
+static double signedArea(const glm::vec3 *v, int count)
+{
+	double area = 0.0;
+	for (int i = 0; i < count; i++)
+	{
+		const glm::vec3 &a = v[i], &b = v[(i + 1) % count];
+		area += (double)a.x * b.y - (double)b.x * a.y;
+	}
+	return area * 0.5;
+}
+
+WeilerAtherton::WeilerAtherton(ThreadPool &pool) : pool(pool)
+{
+}
+
+size_t WeilerAtherton::tableBytes() const
+{
+	return arena.bytes() + projected.capacity() * sizeof(ScreenTriangle) + planes.capacity() * sizeof(DepthPlane) +
+		   (polygons.capacity() + kept.capacity() + fronts.capacity() + visible.capacity()) * sizeof(AreaPolygon) +
+		   colors.capacity() * sizeof(glm::vec3) + rasterized.capacity() * sizeof(RasterTriangle) + buffer.bytes();
+}
+
+bool WeilerAtherton::makePolygon(const glm::vec3 *v, int count, int triangle, AreaPolygon &out)
+{
+	if (count < 3)
+		return false;
+	double area = signedArea(v, count);
+	if (!(std::fabs(area) >= MIN_AREA))
+		return false;
+	out.v = arena.allocate<glm::vec3>(count);
+	out.count = 0;
+	out.triangle = triangle;
+	out.zNear = 2.0f;
+	out.minX = out.minY = 1e30f;
+	out.maxX = out.maxY = -1e30f;
+	for (int i = 0; i < count; i++)
+	{
+		// 统一成逆时针
+		const glm::vec3 &p = area > 0.0 ? v[i] : v[count - 1 - i];
+		if (out.count > 0 && std::fabs(p.x - out.v[out.count - 1].x) < MIN_EDGE &&
+			std::fabs(p.y - out.v[out.count - 1].y) < MIN_EDGE)
+			continue;
+		out.v[out.count++] = p;
+		out.zNear = std::min(out.zNear, p.z);
+		out.minX = std::min(out.minX, p.x);
+		out.maxX = std::max(out.maxX, p.x);
+		out.minY = std::min(out.minY, p.y);
+		out.maxY = std::max(out.maxY, p.y);
+	}
+	while (out.count > 1 && std::fabs(out.v[0].x - out.v[out.count - 1].x) < MIN_EDGE &&
+		   std::fabs(out.v[0].y - out.v[out.count - 1].y) < MIN_EDGE)
+		out.count--;
+	return out.count >= 3;
+}
+
+// 凸多边形沿直线 side(p) = 0 分成 side >= 0 和 side <= 0 两部分，直线上的顶点两边都有。
+// 舍入误差可能让多边形略微不凸、与直线交点多于两个，所以输出用vector而不是按凸多边形估计的定长数组
+static void splitPolygon(const glm::vec3 *v, int count, const double *side, std::vector<glm::vec3> &positive,
+						 std::vector<glm::vec3> &negative)
+{
+	positive.clear();
+	negative.clear();
+	for (int i = 0; i < count; i++)
+	{
+		int j = (i + 1) % count;
+		if (side[i] >= 0.0)
+			positive.push_back(v[i]);
+		if (side[i] <= 0.0)
+			negative.push_back(v[i]);
+		if ((side[i] > 0.0 && side[j] < 0.0) || (side[i] < 0.0 && side[j] > 0.0))
+		{
+			glm::vec3 p = glm::mix(v[i], v[j], (float)(side[i] / (side[i] - side[j])));
+			positive.push_back(p);
+			negative.push_back(p);
+		}
+	}
+}
+
+bool WeilerAtherton::clip(const AreaPolygon &polygon, const AreaPolygon &clipper, std::vector<AreaPolygon> &outside,
+						  AreaPolygon &inside)
+{
+	std::vector<glm::vec3> &current = scratch[0], &in = scratch[1], &out = scratch[2];
+	current.assign(polygon.v, polygon.v + polygon.count);
+	for (int e = 0; e < clipper.count; e++)
+	{
+		// 逆时针的clipper，内部在每条有向边的左侧
+		const glm::vec3 &a = clipper.v[e], &b = clipper.v[(e + 1) % clipper.count];
+		double ex = (double)b.x - a.x, ey = (double)b.y - a.y;
+		bool anyOutside = false;
+		sides.resize(current.size());
+		for (size_t i = 0; i < current.size(); i++)
+		{
+			sides[i] = ex * ((double)current[i].y - a.y) - ey * ((double)current[i].x - a.x);
+			anyOutside = anyOutside || sides[i] < 0.0;
+		}
+		if (!anyOutside)
+			continue;
+		splitPolygon(current.data(), (int)current.size(), sides.data(), in, out);
+		AreaPolygon piece;
+		if (makePolygon(out.data(), (int)out.size(), polygon.triangle, piece))
+			outside.push_back(piece);
+		current.swap(in);
+		if (current.size() < 3 || std::fabs(signedArea(current.data(), (int)current.size())) < MIN_AREA)
+			return false;
+	}
+	return makePolygon(current.data(), (int)current.size(), polygon.triangle, inside);
+}
+
+void WeilerAtherton::resolveInside(const AreaPolygon &inside, const AreaPolygon &clipper, std::vector<AreaPolygon> &front)
+{
+	// 两边的深度都用double的平面求，不用裁剪时插值出来的float顶点深度：公共边上的两个面要判成一样深，
+	// 否则A在B前面、B又在A前面，裁剪多边形会一直换下去
+	const DepthPlane &plane = planes[clipper.triangle], &own = planes[inside.triangle];
+	sides.resize(inside.count);
+	bool anyFront = false, anyBehind = false;
+	for (int i = 0; i < inside.count; i++)
+	{
+		const glm::vec3 &p = inside.v[i];
+		// 正数：比裁剪多边形近
+		double d = plane.at(p.x, p.y) - own.at(p.x, p.y);
+		sides[i] = std::fabs(d) <= PLANE_TOLERANCE ? 0.0 : d;
+		anyFront = anyFront || sides[i] > 0.0;
+		anyBehind = anyBehind || sides[i] < 0.0;
+	}
+	if (!anyFront)
+	{
+		frameStats.hiddenFragments++;
+		return;
+	}
+	if (!anyBehind)
+	{
+		frameStats.frontFragments++;
+		front.push_back(inside);
+		return;
+	}
+	// 相交：后面的部分被挡住，前面的部分留下
+	frameStats.planeSplits++;
+	frameStats.hiddenFragments++;
+	splitPolygon(inside.v, inside.count, sides.data(), scratch[1], scratch[2]);
+	AreaPolygon piece;
+	if (makePolygon(scratch[1].data(), (int)scratch[1].size(), inside.triangle, piece))
+	{
+		frameStats.frontFragments++;
+		front.push_back(piece);
+	}
+}
+
+void WeilerAtherton::render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image)
+{
+	width = view.width;
+	height = view.height;
+	frameStats = Stats();
+	arena.reset();
+
+	// 投影、裁剪近远平面
+	int chunks = std::max(1, std::min((int)scene.triangles.size() / 1024, pool.size() * 4));
+	std::vector<std::vector<ScreenTriangle>> chunkTriangles(chunks);
+	pool.parallelFor(chunks, [&](int chunk, int) {
+		size_t begin = scene.triangles.size() * chunk / chunks, end = scene.triangles.size() * (chunk + 1) / chunks;
+		for (size_t i = begin; i < end; i++)
+		{
+			ScreenTriangle clipped[3];
+			int n = projectTriangle(scene.triangles[i], view.viewProjection, view.width, view.height, (unsigned int)i, clipped);
+			chunkTriangles[chunk].insert(chunkTriangles[chunk].end(), clipped, clipped + n);
+		}
+	});
+	projected.clear();
+	for (const std::vector<ScreenTriangle> &chunk : chunkTriangles)
+		projected.insert(projected.end(), chunk.begin(), chunk.end());
+
+	// 截到屏幕矩形内（也是用逆时针的有向边裁剪），建立深度平面
+	glm::vec3 screenCorners[4] = {glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3((float)width, 0.0f, 0.0f),
+								  glm::vec3((float)width, (float)height, 0.0f), glm::vec3(0.0f, (float)height, 0.0f)};
+	AreaPolygon screen;
+	screen.v = screenCorners;
+	screen.count = 4;
+	screen.triangle = -1;
+	polygons.clear();
+	planes.resize(projected.size());
+	std::vector<AreaPolygon> offscreen;
+	for (size_t i = 0; i < projected.size(); i++)
+	{
+		const glm::vec3 *v = projected[i].screen;
+		double ax = (double)v[1].x - v[0].x, ay = (double)v[1].y - v[0].y, az = (double)v[1].z - v[0].z;
+		double bx = (double)v[2].x - v[0].x, by = (double)v[2].y - v[0].y, bz = (double)v[2].z - v[0].z;
+		double area = ax * by - ay * bx;
+		if (!(std::fabs(area) * 0.5 >= MIN_AREA))
+			continue;
+		planes[i] = {v[0].x, v[0].y, v[0].z, (az * by - bz * ay) / area, (bz * ax - az * bx) / area};
+		AreaPolygon triangle;
+		if (!makePolygon(v, 3, (int)i, triangle))
+			continue;
+		if (triangle.maxX <= 0.0f || triangle.minX >= width || triangle.maxY <= 0.0f || triangle.minY >= height)
+			continue;
+		offscreen.clear();
+		AreaPolygon inside;
+		if (clip(triangle, screen, offscreen, inside))
+			polygons.push_back(inside);
+	}
+	frameStats.inputPolygons = (double)polygons.size();
+
+	// 区域排序
+	visible.clear();
+	int forced = -1, chain = 0;
+	double passBudget = 16.0 * polygons.size() + 1024.0;	// 精度很差时防止一直切下去
+	while (!polygons.empty())
+	{
+		if (frameStats.clipperPasses >= passBudget)
+		{
+			// 剩下的按原样输出，可能互相重叠；光栅化时后面的覆盖前面的
+			visible.insert(visible.end(), polygons.begin(), polygons.end());
+			frameStats.unresolved += (double)polygons.size();
+			break;
+		}
+		int c = forced;
+		if (c < 0)
+		{
+			c = 0;
+			for (size_t i = 1; i < polygons.size(); i++)
+				if (polygons[i].zNear < polygons[c].zNear)
+					c = (int)i;
+		}
+		AreaPolygon clipper = polygons[c];
+		polygons[c] = polygons.back();
+		polygons.pop_back();
+		frameStats.clipperPasses++;
+
+		kept.clear();
+		fronts.clear();
+		for (const AreaPolygon &polygon : polygons)
+		{
+			if (polygon.maxX <= clipper.minX || clipper.maxX <= polygon.minX || polygon.maxY <= clipper.minY ||
+				clipper.maxY <= polygon.minY)
+			{
+				kept.push_back(polygon);
+				continue;
+			}
+			frameStats.clips++;
+			AreaPolygon inside;
+			if (clip(polygon, clipper, kept, inside))
+				resolveInside(inside, clipper, fronts);
+		}
+
+		forced = -1;
+		if (fronts.empty() || chain >= MAX_CHAIN)
+		{
+			// 链太长时clipper前面还有没消掉的部分，照样输出，与超出预算时一样记为没有消隐的多边形
+			if (!fronts.empty())
+				frameStats.unresolved++;
+			visible.push_back(clipper);
+			kept.insert(kept.end(), fronts.begin(), fronts.end());
+			chain = 0;
+		}
+		else
+		{
+			// clipper自己也被挡住了一部分：放回去，下一轮用最近的前面部分裁剪
+			kept.push_back(clipper);
+			forced = (int)kept.size();
+			for (size_t i = 1; i < fronts.size(); i++)
+				if (fronts[i].zNear < fronts[forced - (int)kept.size()].zNear)
+					forced = (int)(kept.size() + i);
+			kept.insert(kept.end(), fronts.begin(), fronts.end());
+			chain++;
+		}
+		polygons.swap(kept);
+	}
+	frameStats.visiblePolygons = (double)visible.size();
+	frameStats.arenaBytes = (double)arena.usedBytes();
+
+	if (vectorOnly)
+	{
+		// 每个可见多边形在重心所在的像素处着色
+		colors.resize(visible.size());
+		int tasks = std::max(1, std::min((int)visible.size() / 256, pool.size() * 4));
+		pool.parallelFor(tasks, [&](int task, int) {
+			for (size_t i = visible.size() * task / tasks; i < visible.size() * (task + 1) / tasks; i++)
+			{
+				const AreaPolygon &polygon = visible[i];
+				glm::vec3 center(0.0f);
+				for (int k = 0; k < polygon.count; k++)
+					center += polygon.v[k];
+				center /= (float)polygon.count;
+				int px = std::min(std::max((int)center.x, 0), width - 1), py = std::min(std::max((int)center.y, 0), height - 1);
+				colors[i] = shadePixel(scene, shadow, view, projected[polygon.triangle], px, py);
+			}
+		});
+		return;
+	}
+
+	// 光栅化：可见多边形按扇形拆成三角形，只用来判断覆盖；着色用投影后的源三角形
+	rasterized.clear();
+	for (const AreaPolygon &polygon : visible)
+		for (int k = 1; k + 1 < polygon.count; k++)
+		{
+			ScreenTriangle piece = projected[polygon.triangle];
+			piece.screen[0] = polygon.v[0];
+			piece.screen[1] = polygon.v[k];
+			piece.screen[2] = polygon.v[k + 1];
+			RasterTriangle raster;
+			if (!RasterTriangle::setup(piece, width, height, raster))
+				continue;
+			raster.screen = projected[polygon.triangle];
+			rasterized.push_back(raster);
+		}
+	buffer.paint(pool, rasterized, scene, shadow, view, image);
+}
+
+bool WeilerAtherton::writeSvg(const std::string &path) const
+{
+	FILE *file = fopen(path.c_str(), "w");
+	if (!file)
+	{
+		std::cout << "Failed to open " << path << " for writing" << std::endl;
+		return false;
+	}
+	// 可见多边形互不重叠，顺序无所谓；关掉抗锯齿免得相邻多边形之间露出背景的细缝
+	fprintf(file, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\" "
+				  "shape-rendering=\"crispEdges\">\n", width, height, width, height);
+	fprintf(file, "<rect width=\"%d\" height=\"%d\" fill=\"#%02x%02x%02x\"/>\n", width, height,
+			(int)(SOFT_CLEAR_COLOR.r * 255.0f + 0.5f), (int)(SOFT_CLEAR_COLOR.g * 255.0f + 0.5f),
+			(int)(SOFT_CLEAR_COLOR.b * 255.0f + 0.5f));
+	for (size_t i = 0; i < visible.size() && i < colors.size(); i++)
+	{
+		const AreaPolygon &polygon = visible[i];
+		glm::vec3 color = glm::clamp(colors[i], 0.0f, 1.0f) * 255.0f + 0.5f;
+		fprintf(file, "<path fill=\"#%02x%02x%02x\" d=\"M", (int)color.r, (int)color.g, (int)color.b);
+		// SVG的y轴向下
+		for (int k = 0; k < polygon.count; k++)
+			fprintf(file, "%s%.2f %.2f", k == 0 ? "" : " L", polygon.v[k].x, height - polygon.v[k].y);
+		fprintf(file, "Z\"/>\n");
+	}
+	fprintf(file, "</svg>\n");
+	fclose(file);
+	return true;
+}
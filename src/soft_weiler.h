@@ -0,0 +1,112 @@
+#ifndef SOFT_WEILER_H
+#define SOFT_WEILER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "soft_painter.h"
+#include "thread_pool.h"
+
+// 裁剪过程中不断产生又丢掉的小多边形的分配器：从大块内存里顺序切出，每帧开始时整体清空，不逐个释放。
+// 已经申请的块留着下一帧复用，稳定之后每帧不再向系统要内存
+class PolygonArena
+{
+public:
+	explicit PolygonArena(size_t blockBytes = 1 << 20);
+
+	template <typename T>
+	T *allocate(size_t count) { return static_cast<T *>(allocateBytes(count * sizeof(T), alignof(T))); }
+	void reset();
+
+	size_t bytes() const { return reservedBytes; }		// 申请的块的总大小
+	size_t usedBytes() const { return frameBytes; }		// 本帧切出去的
+
+private:
+	void *allocateBytes(size_t size, size_t alignment);
+
+	struct Block
+	{
+		std::unique_ptr<char[]> data;
+		size_t size;
+	};
+	std::vector<Block> blocks;
+	size_t blockBytes;
+	size_t current = 0;			// 正在切的块
+	size_t offset = 0;
+	size_t reservedBytes = 0;
+	size_t frameBytes = 0;
+};
+
+// Weiler-Atherton区域排序消隐，物体精度：结果是屏幕上互不重叠的可见多边形，而不是像素。
+// 每次取最近的多边形当裁剪多边形，把其余多边形沿它的每条有向边切成里、外两部分：
+// 外面的留在列表里，里面的再用它所在平面分成后面（被挡住，丢掉）和前面两部分。
+// 没有前面的部分时裁剪多边形整个可见；有的话说明它自己也被挡住了一部分，先放回列表，改用最近的那块前面的部分裁剪。
+// 顺着这条链深度在重叠区域里严格变小，所以不会循环；相交的多边形在平面处被切开。
+// 输出可以光栅化成图像（与其他引擎逐像素比较），也可以直接写成与分辨率无关的SVG
+class WeilerAtherton
+{
+public:
+	struct Stats
+	{
+		double inputPolygons = 0;		// 投影、截到屏幕内之后的多边形
+		double clipperPasses = 0;		// 当作裁剪多边形的次数
+		double clips = 0;				// 包围盒相交、真正做了裁剪的多边形
+		double hiddenFragments = 0;		// 在裁剪多边形后面被丢掉的部分
+		double frontFragments = 0;		// 在裁剪多边形前面、需要换裁剪多边形的部分
+		double planeSplits = 0;			// 与裁剪多边形相交、被它的平面切开
+		double visiblePolygons = 0;
+		double unresolved = 0;			// 裁剪次数超出预算或换裁剪多边形的链太长、没有消隐就直接输出的多边形（精度问题）
+		double arenaBytes = 0;			// 本帧从arena切出的字节
+	};
+
+	explicit WeilerAtherton(ThreadPool &pool);
+
+	// vectorOnly为true时只求可见多边形和它们的颜色，不光栅化，image不变
+	void render(const SoftScene &scene, const SoftShadowMap &shadow, const SoftView &view, SoftImage &image);
+	void setVectorOnly(bool enabled) { vectorOnly = enabled; }
+	// 上一帧的可见多边形写成SVG，每个多边形一种颜色（在它的重心处着色）
+	bool writeSvg(const std::string &path) const;
+
+	// arena、多边形列表，以及光栅化时整屏的三角形下标缓冲
+	size_t tableBytes() const;
+	const Stats &stats() const { return frameStats; }
+
+private:
+	struct AreaPolygon
+	{
+		glm::vec3 *v;				// 窗口坐标，逆时针（y向上）
+		int count;
+		int triangle;				// projected中的下标，着色和深度平面都用它
+		float zNear;
+		float minX, minY, maxX, maxY;
+	};
+
+	// 深度平面 z = z0 + zdx * (x - x0) + zdy * (y - y0)，用double从投影后的三角形算出
+	struct DepthPlane
+	{
+		double x0, y0, z0, zdx, zdy;
+		double at(double x, double y) const { return z0 + zdx * (x - x0) + zdy * (y - y0); }
+	};
+
+	bool makePolygon(const glm::vec3 *v, int count, int triangle, AreaPolygon &out);
+	// 沿clipper的每条有向边切开polygon：外面的部分放进outside，返回里面的部分是否存在
+	bool clip(const AreaPolygon &polygon, const AreaPolygon &clipper, std::vector<AreaPolygon> &outside, AreaPolygon &inside);
+	// 裁剪多边形里面的部分：在clipper平面后面的丢掉，前面的放进front
+	void resolveInside(const AreaPolygon &inside, const AreaPolygon &clipper, std::vector<AreaPolygon> &front);
+
+	ThreadPool &pool;
+	PolygonArena arena;
+	std::vector<ScreenTriangle> projected;
+	std::vector<DepthPlane> planes;
+	std::vector<AreaPolygon> polygons, kept, fronts, visible;
+	std::vector<glm::vec3> scratch[3];		// 裁剪时的临时顶点，只在串行的主循环里用
+	std::vector<double> sides;
+	std::vector<glm::vec3> colors;			// visible的颜色（只在vectorOnly时计算）
+	std::vector<RasterTriangle> rasterized;
+	PaintBuffer buffer;
+	int width = 0, height = 0;
+	bool vectorOnly = false;
+	Stats frameStats;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int threads)
+{
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	if (threads <= 0)
+		threads = 1;
+	// 调用parallelFor的线程也干活，所以只需再开threads-1个
+	for (int i = 1; i < threads; i++)
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+void ThreadPool::runTasks(int worker)
+{
+	for (;;)
+	{
+		int index = nextIndex.fetch_add(1);
+		if (index >= taskCount)
+			break;
+		(*task)(index, worker);
+	}
+}
+
+void ThreadPool::workerLoop(int worker)
+{
+	unsigned long long seen = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || generation != seen; });
+			if (stopping)
+				return;
+			seen = generation;
+		}
+		runTasks(worker);
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busyWorkers == 0)
+			done.notify_one();
+	}
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int, int)> &fn)
+{
+	if (count <= 0)
+		return;
+	// 只有一个线程或只有一个任务时直接在当前线程执行
+	if (workers.empty() || count == 1)
+	{
+		for (int i = 0; i < count; i++)
+			fn(i, 0);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		task = &fn;
+		taskCount = count;
+		nextIndex = 0;
+		busyWorkers = (int)workers.size();
+		generation++;
+	}
+	wake.notify_all();
+	runTasks(0);
+	// 等所有线程都离开runTasks，fn才能安全地销毁
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&] { return busyWorkers == 0; });
+	task = NULL;
+}
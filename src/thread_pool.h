@@ -0,0 +1,43 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 常驻线程池，CPU渲染器用它把tile、三角形块等任务分给所有核。
+// parallelFor把[0,count)动态分给各线程（谁先做完谁去取下一个），调用线程自己也参与，全部完成后才返回。
+class ThreadPool
+{
+public:
+	// threads为0时使用全部硬件线程
+	explicit ThreadPool(int threads = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	// 包括调用线程在内的线程数，worker编号范围是[0, size())
+	int size() const { return (int)workers.size() + 1; }
+	// fn(index, worker)
+	void parallelFor(int count, const std::function<void(int, int)> &fn);
+
+private:
+	void workerLoop(int worker);
+	void runTasks(int worker);
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(int, int)> *task = NULL;
+	int taskCount = 0;
+	std::atomic<int> nextIndex{0};
+	int busyWorkers = 0;
+	unsigned long long generation = 0;
+	bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+// 所有着色器共用的uniform块（std140布局）。
+// GLSL 3.30不能在着色器里写binding，链接后用ShaderProgram::bindUniformBlock把块绑到下面固定的绑定点。
+// 下面的C++结构体与GLSL声明逐字段对应，改动任何一边都要同时改另一边。
+
+// 把数值宏展开成字符串字面量，拼进着色器源码；C++和GLSL用同一个宏，两边的数就不会不一致
+#define GLSL_STRINGIFY(x) #x
+#define GLSL_LITERAL(x) GLSL_STRINGIFY(x)
+
+// 片段着色器最多支持的光源数量，多出的光源不参与着色
+#define MAX_LIGHTS_VALUE 16
+const int MAX_LIGHTS = MAX_LIGHTS_VALUE;
+// 级联阴影贴图最多的级联数（深度纹理数组的层数）
+#define MAX_CASCADES_VALUE 4
+const int MAX_CASCADES = MAX_CASCADES_VALUE;
+// 级联的远端距离和深度偏移系数各挤在一个vec4里
+static_assert(MAX_CASCADES <= 4, "cascadeSplits and cascadeDepthPerTexel hold one float per cascade in a vec4");
+
+const GLuint FRAME_UNIFORM_BINDING = 0;		// 每帧更新一次：相机、光源
+const GLuint MATERIAL_UNIFORM_BINDING = 1;	// 每个材质一份，绘制前用glBindBufferRange选中
+
+// 每帧数据：相机、各级联的光源空间矩阵、所有光源。std140下vec3数组的步长是16字节，所以统一用vec4；
+// float数组的步长也是16字节，级联的远端距离就挤在一个vec4里
+#define FRAME_DATA_GLSL                          \
+	"layout (std140) uniform FrameData\n"        \
+	"{\n"                                        \
+	"	mat4 projection;\n"                      \
+	"	mat4 view;\n"                            \
+	"	mat4 cascadeMatrices[" GLSL_LITERAL(MAX_CASCADES_VALUE) "];\n" \
+	"	vec4 cascadeSplits;\n"                   \
+	"	vec4 cascadeDepthPerTexel;\n"            \
+	"	vec4 shadowDirection;\n"                 \
+	"	vec4 viewPosition;\n"                    \
+	"	vec4 lightPositions[" GLSL_LITERAL(MAX_LIGHTS_VALUE) "];\n" \
+	"	vec4 lightColors[" GLSL_LITERAL(MAX_LIGHTS_VALUE) "];\n"  \
+	"	int lightCount;\n"                       \
+	"	int cascadeCount;\n"                     \
+	"};\n"
+
+struct FrameData
+{
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::mat4 cascadeMatrices[MAX_CASCADES];	// 世界空间 -> 各级联的光源裁剪空间，0号级联离相机最近
+	glm::vec4 cascadeSplits;					// 各级联在相机视线方向上的远端距离
+	glm::vec4 cascadeDepthPerTexel;				// 各级联的shadowDepthPerTexel，深度偏移按它缩放
+	glm::vec4 shadowDirection;					// 指向0号光源的光线方向，各级联相同
+	glm::vec4 viewPosition;
+	glm::vec4 lightPositions[MAX_LIGHTS];	// 0号光源投射阴影
+	glm::vec4 lightColors[MAX_LIGHTS];
+	GLint lightCount;
+	GLint cascadeCount;
+	GLint padding[2];						// std140块的大小按16字节对齐
+};
+
+// std140下mat4占64字节、vec4占16字节，偏移随MAX_CASCADES和MAX_LIGHTS变化
+static_assert(offsetof(FrameData, view) == 64, "FrameData must match the std140 layout");
+static_assert(offsetof(FrameData, cascadeSplits) == 128 + 64 * MAX_CASCADES, "FrameData must match the std140 layout");
+static_assert(offsetof(FrameData, shadowDirection) == offsetof(FrameData, cascadeSplits) + 32, "FrameData must match the std140 layout");
+static_assert(offsetof(FrameData, viewPosition) == offsetof(FrameData, cascadeSplits) + 48, "FrameData must match the std140 layout");
+static_assert(offsetof(FrameData, lightPositions) == offsetof(FrameData, cascadeSplits) + 64, "FrameData must match the std140 layout");
+static_assert(offsetof(FrameData, lightColors) == offsetof(FrameData, lightPositions) + 16 * MAX_LIGHTS, "FrameData must match the std140 layout");
+static_assert(offsetof(FrameData, lightCount) == offsetof(FrameData, lightColors) + 16 * MAX_LIGHTS, "FrameData must match the std140 layout");
+static_assert(sizeof(FrameData) == offsetof(FrameData, lightCount) + 16, "FrameData must match the std140 layout");
+
+// 材质数据
+#define MATERIAL_DATA_GLSL                       \
+	"layout (std140) uniform MaterialData\n"     \
+	"{\n"                                        \
+	"	vec4 objectColor;\n"                     \
+	"};\n"
+
+struct MaterialData
+{
+	glm::vec4 objectColor;
+};
+
+static_assert(sizeof(MaterialData) == 16, "MaterialData must match the std140 layout");
+
+#endif
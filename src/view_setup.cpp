@@ -0,0 +1,207 @@
+#include "view_setup.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include "meshes.h"
+
+static const float CAMERA_FOV = 45.0f;		// 垂直视角（度）
+static const float LIGHT_NEAR = 1.0f;		// 光源视角的近平面，与固定矩阵相同
+
+glm::mat4 cameraProjection(int width, int height)
+{
+	// 第一个参数通常设置为45.0f，以达到真实效果；第二个参数为屏幕的宽高比；第三、四个参数表示近远平面的z距离。
+	return glm::perspective(glm::radians(CAMERA_FOV), (float)width / (float)height, CAMERA_NEAR, CAMERA_FAR);
+}
+
+void cameraPose(double time, const CameraPath &path, glm::vec3 &eye, glm::vec3 &target)
+{
+	if (!path.empty())
+	{
+		path.evaluate(time, eye, target);
+		return;
+	}
+	// 相机在半径为8的圆上绕场景中心旋转
+	float radius = 8.0f;
+	float camX = static_cast<float>(sin(time) * radius);
+	float camZ = static_cast<float>(cos(time) * radius);
+	eye = glm::vec3(camX, 0.0f, camZ);
+	target = glm::vec3(0.0f, 0.5f, 0.0f);
+}
+
+glm::mat4 lightSpaceMatrixFor(const glm::vec3 &lightPos)
+{
+	// 1.首先，使用正向投影，所以正交投影矩阵
+	float near_floor = 1.0f, far_floor = 17.0f;
+	// 光源的投影矩阵
+	glm::mat4 lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, near_floor, far_floor);
+	// 利用lookAt函数生成view矩阵
+	glm::mat4 lightView = lightViewMatrix(lightPos);
+	// 从世界坐标转换到光源向外投影裁剪的复合变换矩阵
+	return lightProjection * lightView;
+}
+
+glm::mat4 lightViewMatrix(const glm::vec3 &lightPos)
+{
+	return glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+void cameraFrustumCorners(const glm::mat4 &cameraView, float aspect, float sliceNear, float sliceFar, glm::vec3 corners[8])
+{
+	float nearDepth = std::min(std::max(sliceNear, CAMERA_NEAR), CAMERA_FAR);
+	float farDepth = std::min(std::max(sliceFar, nearDepth + CAMERA_NEAR), CAMERA_FAR);
+	float tanHalf = std::tan(glm::radians(CAMERA_FOV) * 0.5f);
+	glm::mat4 cameraToWorld = glm::inverse(cameraView);
+	for (int corner = 0; corner < 8; corner++)
+	{
+		float depth = (corner & 4) ? farDepth : nearDepth;
+		glm::vec3 p(((corner & 1) ? 1.0f : -1.0f) * depth * tanHalf * aspect, ((corner & 2) ? 1.0f : -1.0f) * depth * tanHalf, -depth);
+		corners[corner] = glm::vec3(cameraToWorld * glm::vec4(p, 1.0f));
+	}
+}
+
+// 顶点数组（每个顶点8个float，前3个是位置）的包围盒
+static Bounds vertexBounds(const GLfloat *vertices, int count)
+{
+	Bounds bounds;
+	for (int i = 0; i < count; i++)
+		bounds.add(glm::vec3(vertices[i * 8], vertices[i * 8 + 1], vertices[i * 8 + 2]));
+	return bounds;
+}
+
+Bounds meshBounds(MeshType mesh)
+{
+	static const Bounds cube = vertexBounds(CUBE_VERTICES, CUBE_VERTEX_COUNT), floor = vertexBounds(FLOOR_VERTICES, FLOOR_VERTEX_COUNT);
+	return mesh == MESH_CUBE ? cube : floor;
+}
+
+// 把box经过transform之后的8个角加进out
+static void addTransformedBox(Bounds &out, const Bounds &box, const glm::mat4 &transform)
+{
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 p((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z);
+		out.add(glm::vec3(transform * glm::vec4(p, 1.0f)));
+	}
+}
+
+Bounds transformedBounds(const Bounds &box, const glm::mat4 &transform)
+{
+	Bounds bounds;
+	addTransformedBox(bounds, box, transform);
+	return bounds;
+}
+
+void cascadeSplitDistances(int count, CascadeSplit scheme, float lambda, float shadowDistance, float *splits)
+{
+	float nearDepth = CAMERA_NEAR, farDepth = std::max(shadowDistance, CAMERA_NEAR * 2.0f);
+	for (int i = 1; i <= count; i++)
+	{
+		float t = (float)i / count;
+		float uniform = nearDepth + (farDepth - nearDepth) * t;
+		float logarithmic = nearDepth * std::pow(farDepth / nearDepth, t);
+		float weight = scheme == CASCADE_SPLIT_UNIFORM ? 0.0f : scheme == CASCADE_SPLIT_LOG ? 1.0f : lambda;
+		splits[i - 1] = weight * logarithmic + (1.0f - weight) * uniform;
+	}
+	splits[count - 1] = farDepth;
+}
+
+Bounds casterBounds(const Scene &scene)
+{
+	Bounds bounds;
+	for (const SceneObject &object : scene.objects)
+		addTransformedBox(bounds, meshBounds(object.mesh), object.model());
+	return bounds;
+}
+
+glm::mat4 fittedLightSpaceMatrix(const glm::vec3 &lightPos, LightFit fit, const Bounds &casters, const glm::mat4 &cameraView,
+								 float aspect, float sliceNear, float sliceFar, int shadowSize, float &texelSize)
+{
+	if (fit == LIGHT_FIT_FIXED || casters.empty())
+	{
+		texelSize = 20.0f / shadowSize;
+		return lightSpaceMatrixFor(lightPos);
+	}
+	// 与lightSpaceMatrixFor相同的光源view矩阵，光源视角下物体在-z方向
+	glm::mat4 lightView = lightViewMatrix(lightPos);
+	Bounds range;
+	addTransformedBox(range, casters, lightView);
+
+	if (fit == LIGHT_FIT_CAMERA)
+	{
+		// 相机视锥体从sliceNear到sliceFar的一段，8个角变换到光源空间
+		glm::vec3 corners[8];
+		cameraFrustumCorners(cameraView, aspect, sliceNear, sliceFar, corners);
+		Bounds frustum;
+		for (const glm::vec3 &corner : corners)
+			frustum.add(glm::vec3(lightView * glm::vec4(corner, 1.0f)));
+		// 正交投影沿光线方向不变，视锥体外的投射者在xy上与视锥体不重叠就投不到看得见的地方；
+		// 深度方向上投射者可以在视锥体前面（靠近光源）挡光，只裁掉视锥体后面的部分
+		Bounds clipped = range;
+		clipped.min.x = std::max(range.min.x, frustum.min.x);
+		clipped.min.y = std::max(range.min.y, frustum.min.y);
+		clipped.min.z = std::max(range.min.z, frustum.min.z);
+		clipped.max.x = std::min(range.max.x, frustum.max.x);
+		clipped.max.y = std::min(range.max.y, frustum.max.y);
+		// 视锥体与投射者不相交时没有需要阴影的地方，退回投射者的包围盒
+		if (clipped.min.x < clipped.max.x && clipped.min.y < clipped.max.y && clipped.min.z < clipped.max.z)
+			range = clipped;
+	}
+
+	// 正方形的范围，边长落在2^(k/4)的台阶上；留出4个texel的余量，对齐之后仍然盖得住
+	float extent = std::max(range.max.x - range.min.x, range.max.y - range.min.y);
+	extent = std::max(extent * (1.0f + 4.0f / shadowSize), 1e-3f);
+	float size = std::exp2(std::ceil(std::log2(extent) * 4.0f) / 4.0f);
+	texelSize = size / shadowSize;
+	float x0 = std::floor(((range.min.x + range.max.x) * 0.5f - size * 0.5f) / texelSize) * texelSize;
+	float y0 = std::floor(((range.min.y + range.max.y) * 0.5f - size * 0.5f) / texelSize) * texelSize;
+	float nearPlane = std::max(std::floor(-range.max.z), LIGHT_NEAR);
+	float farPlane = std::max(std::ceil(-range.min.z), nearPlane + 1.0f);
+	return glm::ortho(x0, x0 + size, y0, y0 + size, nearPlane, farPlane) * lightView;
+}
+
+const char *shadowFilterName(ShadowFilter filter)
+{
+	static const char *NAMES[] = {"hard", "hardware", "poisson4", "poisson8", "poisson16", "poisson32"};
+	return NAMES[filter];
+}
+
+int shadowFilterTaps(ShadowFilter filter)
+{
+	return filter < SHADOW_FILTER_POISSON4 ? 1 : 4 << (filter - SHADOW_FILTER_POISSON4);
+}
+
+int shadowFilterTexels(ShadowFilter filter)
+{
+	return filter == SHADOW_FILTER_HARD ? 1 : 4 * shadowFilterTaps(filter);
+}
+
+float shadowFilterFootprint(ShadowFilter filter)
+{
+	if (filter == SHADOW_FILTER_HARD)
+		return 0.0f;
+	return filter == SHADOW_FILTER_HARDWARE ? 1.0f : 1.0f + SHADOW_POISSON_RADIUS;
+}
+
+float shadowDepthPerTexel(const glm::mat4 &lightSpace, int shadowSize)
+{
+	// 正交投影：裁剪空间x的一行是 (2 / 宽度) * 光源的右方向，z的一行是 (-2 / 深度范围) * 光源的后方向。
+	// 一个texel的世界边长是 宽度 / shadowSize，[0,1]深度每单位距离变化 1 / 深度范围
+	glm::vec3 rowX(lightSpace[0][0], lightSpace[1][0], lightSpace[2][0]);
+	glm::vec3 rowZ(lightSpace[0][2], lightSpace[1][2], lightSpace[2][2]);
+	return glm::length(rowZ) / (glm::length(rowX) * shadowSize);
+}
+
+glm::vec3 shadowDirection(const glm::mat4 &lightSpace)
+{
+	return -glm::normalize(glm::vec3(lightSpace[0][2], lightSpace[1][2], lightSpace[2][2]));
+}
+
+float shadowBias(ShadowFilter filter, float depthPerTexel, float cosTheta)
+{
+	float footprint = shadowFilterFootprint(filter);
+	if (footprint == 0.0f)
+		return 0.0f;
+	cosTheta = std::min(std::max(cosTheta, 0.0f), 1.0f);
+	float slope = std::min(std::sqrt(1.0f - cosTheta * cosTheta) / std::max(cosTheta, 1e-3f), SHADOW_MAX_SLOPE);
+	return depthPerTexel * (SHADOW_BIAS_TEXELS + footprint * slope);
+}
@@ -0,0 +1,109 @@
+#ifndef VIEW_SETUP_H
+#define VIEW_SETUP_H
+
+#include <glm/glm.hpp>
+#include "camera_path.h"
+#include "scene.h"
+
+// 相机和光源视角的矩阵。GL渲染和CPU渲染都从这里取，保证两条路径看到的是同一个画面
+
+// 相机的近远平面
+const float CAMERA_NEAR = 0.1f, CAMERA_FAR = 100.0f;
+
+// 相机的透视投影：45度视角，近平面0.1，远平面100
+glm::mat4 cameraProjection(int width, int height);
+// time时刻相机的位置和观察目标：有相机路径时沿路径移动，否则绕场景中心旋转
+void cameraPose(double time, const CameraPath &path, glm::vec3 &eye, glm::vec3 &target);
+// 世界空间 -> 光源视角裁剪空间的变换矩阵（阴影贴图用）：固定的20x20正交范围，近平面1，远平面17
+glm::mat4 lightSpaceMatrixFor(const glm::vec3 &lightPos);
+// 光源的view矩阵：从光源看向原点，所有光源矩阵共用这个朝向，光源视角下物体在-z方向
+glm::mat4 lightViewMatrix(const glm::vec3 &lightPos);
+// 相机视锥体从sliceNear到sliceFar（限制在相机的近远平面之间）一段的8个角，世界空间
+void cameraFrustumCorners(const glm::mat4 &cameraView, float aspect, float sliceNear, float sliceFar, glm::vec3 corners[8]);
+
+// 轴对齐包围盒
+struct Bounds
+{
+	glm::vec3 min = glm::vec3(1e30f);
+	glm::vec3 max = glm::vec3(-1e30f);
+
+	bool empty() const { return min.x > max.x; }
+	void add(const glm::vec3 &point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+};
+
+// 网格在模型空间的包围盒
+Bounds meshBounds(MeshType mesh);
+// box经过transform之后的包围盒（变换8个角）
+Bounds transformedBounds(const Bounds &box, const glm::mat4 &transform);
+// 投射阴影的几何体（正方体和地板，不含光源立方体）的包围盒；场景改变时重新计算
+Bounds casterBounds(const Scene &scene);
+
+// 光源视角的正交范围怎么定
+enum LightFit
+{
+	LIGHT_FIT_FIXED,	// lightSpaceMatrixFor的固定范围
+	LIGHT_FIT_SCENE,	// 投射者的包围盒：与相机无关，阴影缓存照样有效
+	LIGHT_FIT_CAMERA	// 投射者的包围盒与相机视锥体（前shadowDistance的一段）的交集，每帧随相机变化
+};
+
+// 级联阴影贴图把相机视锥体的前shadowDistance沿视线方向切成几段，每段拟合一张阴影贴图
+enum CascadeSplit
+{
+	CASCADE_SPLIT_UNIFORM,		// 等距：远处的级联与近处一样细，近处的阴影仍然粗糙
+	CASCADE_SPLIT_LOG,			// 等比：每个级联的远近平面之比相同，屏幕上texel的大小大致不变，但第一段很短
+	CASCADE_SPLIT_PRACTICAL		// 两者按lambda混合（lambda=1为等比）
+};
+
+// 各级联的远端距离（相机视线方向），splits[count - 1]就是shadowDistance；第一个级联从相机的近平面开始
+void cascadeSplitDistances(int count, CascadeSplit scheme, float lambda, float shadowDistance, float *splits);
+
+// 拟合的光源矩阵。光源的朝向与lightSpaceMatrixFor相同（从光源看向原点），只改正交范围：
+// 宽高取拟合范围的最大边，向上取到2的1/4次幂的台阶上，再把范围的左下角对齐到整texel，
+// 这样相机移动时范围只按整texel平移，阴影边缘不会闪烁；台阶之间尺寸不变，只有跨台阶时texel大小才变。
+// 近平面不小于1（光源后面的物体不投射阴影），远近平面取整。texelSize带回一个阴影贴图texel对应的世界空间边长。
+// LIGHT_FIT_CAMERA时只拟合相机视锥体从sliceNear到sliceFar的一段（单张阴影贴图时是CAMERA_NEAR到shadowDistance）
+glm::mat4 fittedLightSpaceMatrix(const glm::vec3 &lightPos, LightFit fit, const Bounds &casters, const glm::mat4 &cameraView,
+								 float aspect, float sliceNear, float sliceFar, int shadowSize, float &texelSize);
+
+// 阴影贴图的过滤方式（--shadow-filter），从便宜到贵
+enum ShadowFilter
+{
+	SHADOW_FILTER_HARD,			// 最近的一个texel，不加深度偏移：最便宜，有阴影痤疮和锯齿
+	SHADOW_FILTER_HARDWARE,		// 深度比较采样器 + GL_LINEAR：一次取样由硬件比较相邻的2x2个texel再双线性混合
+	SHADOW_FILTER_POISSON4,		// 在泊松圆盘上取4/8/16/32次硬件比较，圆盘按像素旋转，把条带换成噪点（只有gl）
+	SHADOW_FILTER_POISSON8,
+	SHADOW_FILTER_POISSON16,
+	SHADOW_FILTER_POISSON32
+};
+
+// 泊松圆盘的半径（texel）
+const float SHADOW_POISSON_RADIUS = 1.5f;
+// 深度偏移的斜率上限：掠射的表面偏移不会无限大，代价是那里的痤疮消不干净（那里漫反射也接近0）。
+// GL片段着色器用同一个宏拼进源码（见uniform_blocks.h的GLSL_LITERAL）
+#define SHADOW_MAX_SLOPE_VALUE 4.0
+const float SHADOW_MAX_SLOPE = (float)SHADOW_MAX_SLOPE_VALUE;
+// 深度偏移的常数项（texel），吸收深度的量化误差；同样拼进着色器
+#define SHADOW_BIAS_TEXELS_VALUE 0.5
+const float SHADOW_BIAS_TEXELS = (float)SHADOW_BIAS_TEXELS_VALUE;
+
+const char *shadowFilterName(ShadowFilter filter);
+// 每个片段对阴影贴图的取样次数
+int shadowFilterTaps(ShadowFilter filter);
+// 每个片段实际读到的texel数：线性过滤的一次比较读2x2个
+int shadowFilterTexels(ShadowFilter filter);
+// 过滤覆盖的半径（texel）：硬件2x2是1个texel，泊松圆盘再加上圆盘半径；最近点为0
+float shadowFilterFootprint(ShadowFilter filter);
+// 光源矩阵下，相邻两个texel之间一个与光线成45度的表面的深度差（阴影贴图的[0,1]深度）
+float shadowDepthPerTexel(const glm::mat4 &lightSpace, int shadowSize);
+// 光源矩阵的光线方向（指向光源，单位向量）
+glm::vec3 shadowDirection(const glm::mat4 &lightSpace);
+// 比较前从片段深度里减去的偏移。表面与光线的夹角为theta（cosTheta = dot(法线, 指向光源)），
+// 过滤范围内表面深度最多变化 footprint * tan(theta) 个depthPerTexel，再加SHADOW_BIAS_TEXELS的常数项。
+// 最近点不加偏移，保持原来的画面。与GL片段着色器的计算相同
+float shadowBias(ShadowFilter filter, float depthPerTexel, float cosTheta);
+
+#endif
@@ -0,0 +1,121 @@
+// diffScenes的测试：把场景文件改几行后重新加载，检查热重载只把改动的物体标成脏的
+// 用法：make test
+#include "scene.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                            \
+	do                                                                              \
+	{                                                                               \
+		if (!(condition))                                                           \
+		{                                                                           \
+			std::cout << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+			failures++;                                                             \
+		}                                                                           \
+	} while (0)
+
+static const char *BASE_SCENE =
+	"light main position 0.5 1.0 2.0\n"
+	"material box texture box.jpg\n"
+	"material floor texture floor.jpg\n"
+	"cube cube0 position 0 0 0 material box\n"
+	"cube cube1 position 1 0 0 material box\n"
+	"cube cube2 position 2 0 0 material box\n"
+	"cube cube3 position 3 0 0 material box\n"
+	"floor floor material floor\n";
+
+// 把text写进临时文件再用loadScene读回来，与热重载走同一条路径
+static Scene load(const std::string &text)
+{
+	std::string path = (std::filesystem::temp_directory_path() / "scene_diff_test.scene").string();
+	{
+		std::ofstream file(path);
+		file << text;
+	}
+	Scene scene;
+	bool ok = loadScene(path, scene);
+	CHECK(ok);
+	std::remove(path.c_str());
+	return scene;
+}
+
+// 把第一个from换成to
+static std::string replace(std::string text, const std::string &from, const std::string &to)
+{
+	size_t at = text.find(from);
+	CHECK(at != std::string::npos);
+	if (at != std::string::npos)
+		text.replace(at, from.size(), to);
+	return text;
+}
+
+int main()
+{
+	Scene base = load(BASE_SCENE);
+
+	// 没有改动
+	CHECK(diffScenes(base, base).empty());
+
+	// 把cube3那一行插到cube0前面，同时移动cube1：其他物体的下标都变了，但只有cube1是脏的
+	{
+		std::string text = replace(BASE_SCENE, "cube cube3 position 3 0 0 material box\n", "");
+		text = replace(text, "cube cube0", "cube cube3 position 3 0 0 material box\ncube cube0");
+		text = replace(text, "cube1 position 1 0 0", "cube1 position 1 5 0");
+		Scene edited = load(text);
+		SceneDiff diff = diffScenes(base, edited);
+		CHECK(!diff.layoutChanged);
+		CHECK(diff.movedObjects.size() == 1);
+		CHECK(diff.movedObjects.size() == 1 && edited.objects[diff.movedObjects[0]].name == "cube1");
+		CHECK(diff.oldObjects.size() == edited.objects.size());
+		for (size_t i = 0; i < diff.oldObjects.size() && i < edited.objects.size(); i++)
+			CHECK(base.objects[diff.oldObjects[i]].name == edited.objects[i].name);
+	}
+
+	// 在物体前面插入一个光源和一行注释：物体的下标不变，只有光源改了
+	{
+		Scene edited = load(replace(BASE_SCENE, "material box", "light fill position 0 5 0\n# comment\nmaterial box"));
+		SceneDiff diff = diffScenes(base, edited);
+		CHECK(diff.lightsChanged);
+		CHECK(!diff.layoutChanged);
+		CHECK(diff.movedObjects.empty());
+	}
+
+	// 新增一个物体：名字的集合变了，实例缓冲要重新排布
+	{
+		Scene edited = load(replace(BASE_SCENE, "cube cube0", "cube extra position 9 0 0 material box\ncube cube0"));
+		CHECK(diffScenes(base, edited).layoutChanged);
+	}
+
+	// 换材质也要重新排布（实例按材质分组）
+	{
+		Scene edited = load(replace(BASE_SCENE, "cube2 position 2 0 0 material box", "cube2 position 2 0 0 material floor"));
+		CHECK(diffScenes(base, edited).layoutChanged);
+	}
+
+	// 材质调整顺序：下标变了，同样要重新排布
+	{
+		std::string text = replace(BASE_SCENE, "material box texture box.jpg\n", "");
+		text = replace(text, "cube cube0", "material box texture box.jpg\ncube cube0");
+		SceneDiff diff = diffScenes(base, load(text));
+		CHECK(diff.materialsChanged);
+		CHECK(diff.layoutChanged);
+	}
+
+	// 名字重复时无法一一对应，退回到重新排布
+	{
+		Scene edited = load(replace(BASE_SCENE, "cube cube3", "cube cube2"));
+		CHECK(diffScenes(base, edited).layoutChanged);
+	}
+
+	if (failures)
+	{
+		std::cout << failures << " check(s) failed" << std::endl;
+		return 1;
+	}
+	std::cout << "scene_diff_test: all checks passed" << std::endl;
+	return 0;
+}